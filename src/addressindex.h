@@ -0,0 +1,206 @@
+// Copyright (c) 2014-2019 The Flashcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_ADDRESSINDEX_H
+#define BITCOIN_ADDRESSINDEX_H
+
+#include "amount.h"
+#include "script/script.h"
+#include "serialize.h"
+#include "uint256.h"
+
+/** Kinds of destinations tracked by -addressindex, stored as the first byte of the index keys */
+enum AddressIndexType
+{
+    ADDRESS_INDEX_NONE = 0,
+    ADDRESS_INDEX_PUBKEYHASH = 1,
+    ADDRESS_INDEX_SCRIPTHASH = 2,
+};
+
+/**
+ * Key of an address index entry: one per output paying to or input spending
+ * from an address. Integers are stored big endian so that the entries of an
+ * address are ordered by height and position in the block.
+ */
+struct CAddressIndexKey
+{
+    unsigned int type;
+    uint160 hashBytes;
+    int blockHeight;
+    unsigned int txindex;
+    uint256 txhash;
+    unsigned int index;
+    bool spending;
+
+    CAddressIndexKey() {
+        SetNull();
+    }
+
+    CAddressIndexKey(unsigned int typeIn, const uint160& hashBytesIn, int blockHeightIn, unsigned int txindexIn,
+                     const uint256& txhashIn, unsigned int indexIn, bool spendingIn) :
+        type(typeIn), hashBytes(hashBytesIn), blockHeight(blockHeightIn), txindex(txindexIn),
+        txhash(txhashIn), index(indexIn), spending(spendingIn) {}
+
+    void SetNull() {
+        type = ADDRESS_INDEX_NONE;
+        hashBytes.SetNull();
+        blockHeight = 0;
+        txindex = 0;
+        txhash.SetNull();
+        index = 0;
+        spending = false;
+    }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const {
+        return 1 + 20 + 4 + 4 + 32 + 4 + 1;
+    }
+
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        ser_writedata8(s, type);
+        hashBytes.Serialize(s, nType, nVersion);
+        ser_writedata32be(s, blockHeight);
+        ser_writedata32be(s, txindex);
+        txhash.Serialize(s, nType, nVersion);
+        ser_writedata32be(s, index);
+        ser_writedata8(s, spending);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        type = ser_readdata8(s);
+        hashBytes.Unserialize(s, nType, nVersion);
+        blockHeight = ser_readdata32be(s);
+        txindex = ser_readdata32be(s);
+        txhash.Unserialize(s, nType, nVersion);
+        index = ser_readdata32be(s);
+        spending = ser_readdata8(s) != 0;
+    }
+};
+
+/** Prefix of CAddressIndexKey used to seek to the first entry of an address, optionally from a given height */
+struct CAddressIndexIteratorKey
+{
+    unsigned int type;
+    uint160 hashBytes;
+    bool fHeight;
+    int blockHeight;
+
+    CAddressIndexIteratorKey(unsigned int typeIn, const uint160& hashBytesIn) :
+        type(typeIn), hashBytes(hashBytesIn), fHeight(false), blockHeight(0) {}
+
+    CAddressIndexIteratorKey(unsigned int typeIn, const uint160& hashBytesIn, int blockHeightIn) :
+        type(typeIn), hashBytes(hashBytesIn), fHeight(true), blockHeight(blockHeightIn) {}
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const {
+        return 1 + 20 + (fHeight ? 4 : 0);
+    }
+
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        ser_writedata8(s, type);
+        hashBytes.Serialize(s, nType, nVersion);
+        if (fHeight)
+            ser_writedata32be(s, blockHeight);
+    }
+};
+
+/** Key of an unspent output paying to an address */
+struct CAddressUnspentKey
+{
+    unsigned int type;
+    uint160 hashBytes;
+    uint256 txhash;
+    unsigned int index;
+
+    CAddressUnspentKey() {
+        SetNull();
+    }
+
+    CAddressUnspentKey(unsigned int typeIn, const uint160& hashBytesIn, const uint256& txhashIn, unsigned int indexIn) :
+        type(typeIn), hashBytes(hashBytesIn), txhash(txhashIn), index(indexIn) {}
+
+    void SetNull() {
+        type = ADDRESS_INDEX_NONE;
+        hashBytes.SetNull();
+        txhash.SetNull();
+        index = 0;
+    }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const {
+        return 1 + 20 + 32 + 4;
+    }
+
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        ser_writedata8(s, type);
+        hashBytes.Serialize(s, nType, nVersion);
+        txhash.Serialize(s, nType, nVersion);
+        ser_writedata32(s, index);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        type = ser_readdata8(s);
+        hashBytes.Unserialize(s, nType, nVersion);
+        txhash.Unserialize(s, nType, nVersion);
+        index = ser_readdata32(s);
+    }
+};
+
+/** Prefix of CAddressUnspentKey used to seek to the first unspent output of an address */
+struct CAddressUnspentIteratorKey
+{
+    unsigned int type;
+    uint160 hashBytes;
+
+    CAddressUnspentIteratorKey(unsigned int typeIn, const uint160& hashBytesIn) :
+        type(typeIn), hashBytes(hashBytesIn) {}
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const {
+        return 1 + 20;
+    }
+
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        ser_writedata8(s, type);
+        hashBytes.Serialize(s, nType, nVersion);
+    }
+};
+
+/** Value of an unspent output paying to an address; a null value erases the entry */
+struct CAddressUnspentValue
+{
+    CAmount satoshis;
+    CScript script;
+    int blockHeight;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(satoshis);
+        READWRITE(*(CScriptBase*)(&script));
+        READWRITE(blockHeight);
+    }
+
+    CAddressUnspentValue() {
+        SetNull();
+    }
+
+    CAddressUnspentValue(CAmount satoshisIn, const CScript& scriptIn, int blockHeightIn) :
+        satoshis(satoshisIn), script(scriptIn), blockHeight(blockHeightIn) {}
+
+    void SetNull() {
+        satoshis = -1;
+        script.clear();
+        blockHeight = 0;
+    }
+
+    bool IsNull() const {
+        return satoshis == -1;
+    }
+};
+
+#endif // BITCOIN_ADDRESSINDEX_H
@@ -0,0 +1,71 @@
+// Copyright (c) 2014-2019 The Flashcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <memory>
+
+#include "bench.h"
+#include "bls/blocksigning.h"
+#include "consensus/merkle.h"
+#include "primitives/block.h"
+#include "random.h"
+#include "script/script.h"
+#include "tinyformat.h"
+#include "utilstrencodings.h"
+
+/* Number of signed blocks to check per iteration */
+static const int BLS_BENCH_BLOCKS = 32;
+
+/** Build blocks whose coinbase carries a miner signature under a fresh key, return the verifier for that key */
+static CBlsBlockVerifier* CreateSignedBlocks(std::vector<CBlock>& vBlocks)
+{
+    bls::init();
+    bls::SecretKey seckey;
+    seckey.init();
+    bls::PublicKey pubkey;
+    seckey.getPublicKey(pubkey);
+
+    vBlocks.resize(BLS_BENCH_BLOCKS);
+    for (int i = 0; i < BLS_BENCH_BLOCKS; i++) {
+        int nHeight = 1000000 + i;
+        int nExtraNonce = 17 + i;
+        CBlock& block = vBlocks[i];
+        block.hashPrevBlock = GetRandHash();
+        block.nTime = BLS_SIGNING_START_TIME + 1 + i;
+
+        bls::Signature sig;
+        seckey.sign(sig, BlsSerializeMessage(strprintf("%d", nHeight), strprintf("%d", nExtraNonce), block.hashPrevBlock.ToString()));
+        CMutableTransaction coinbase;
+        coinbase.vin.resize(1);
+        coinbase.vin[0].prevout.SetNull();
+        coinbase.vin[0].scriptSig = CScript() << nHeight << CScriptNum(nExtraNonce) << ParseHex(sig.getStr(MCLBN_IO_SERIALIZE_HEX_STR));
+        coinbase.vout.resize(1);
+        block.vtx.push_back(coinbase);
+        block.hashMerkleRoot = BlockMerkleRoot(block);
+    }
+    return new CBlsBlockVerifier(pubkey.getStr(MCLBN_IO_SERIALIZE_HEX_STR));
+}
+
+static void BlsVerifySingle(benchmark::State& state)
+{
+    std::vector<CBlock> vBlocks;
+    std::unique_ptr<CBlsBlockVerifier> verifier(CreateSignedBlocks(vBlocks));
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < vBlocks.size(); i++)
+            assert(verifier->VerifyBlock(vBlocks[i], false));
+    }
+}
+
+static void BlsVerifyBatch(benchmark::State& state)
+{
+    std::vector<CBlock> vBlocks;
+    std::unique_ptr<CBlsBlockVerifier> verifier(CreateSignedBlocks(vBlocks));
+    std::vector<const CBlock*> vpblocks;
+    for (size_t i = 0; i < vBlocks.size(); i++)
+        vpblocks.push_back(&vBlocks[i]);
+    while (state.KeepRunning())
+        assert(verifier->VerifyBlocks(vpblocks));
+}
+
+BENCHMARK(BlsVerifySingle);
+BENCHMARK(BlsVerifyBatch);
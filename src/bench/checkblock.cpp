@@ -0,0 +1,85 @@
+// Copyright (c) 2014-2019 The Flashcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "consensus/merkle.h"
+#include "consensus/validation.h"
+#include "main.h"
+#include "random.h"
+#include "script/script.h"
+#include "util.h"
+
+#include <boost/thread.hpp>
+
+/* Serialized size of the synthetic block, just under MAX_BLOCK_BASE_SIZE */
+static const size_t CHECKBLOCK_BENCH_SIZE = MAX_BLOCK_BASE_SIZE - 10000;
+
+/** Build a block of one-input, two-output transactions filling CHECKBLOCK_BENCH_SIZE */
+static void CreateLargeBlock(CBlock& block)
+{
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vin[0].scriptSig = CScript() << 1000000 << OP_0;
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = 50 * COIN;
+    coinbase.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    block.vtx.push_back(coinbase);
+
+    size_t nSize = ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION);
+    while (true) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+        tx.vin[0].scriptSig = CScript() << std::vector<unsigned char>(72, 0x30) << std::vector<unsigned char>(33, 0x02);
+        tx.vout.resize(2);
+        for (int i = 0; i < 2; i++) {
+            tx.vout[i].nValue = COIN;
+            tx.vout[i].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, i) << OP_EQUALVERIFY << OP_CHECKSIG;
+        }
+        nSize += ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+        if (nSize > CHECKBLOCK_BENCH_SIZE)
+            break;
+        block.vtx.push_back(tx);
+    }
+    // Before BLS_SIGNING_START_TIME, so no miner signature is needed
+    block.nTime = 1500000000;
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+}
+
+static void CheckLargeBlock(benchmark::State& state, int nThreads)
+{
+    CBlock block;
+    CreateLargeBlock(block);
+    const Consensus::Params& consensusParams = Params(CBaseChainParams::MAIN).GetConsensus();
+
+    boost::thread_group threadGroup;
+    nScriptCheckThreads = nThreads;
+    for (int i = 0; i < nThreads - 1; i++)
+        threadGroup.create_thread(&ThreadBlockTxCheck);
+
+    while (state.KeepRunning()) {
+        CValidationState validationState;
+        assert(CheckBlock(block, validationState, consensusParams, false, true));
+    }
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+    nScriptCheckThreads = 0;
+}
+
+static void CheckBlockSerial(benchmark::State& state)
+{
+    CheckLargeBlock(state, 0);
+}
+
+static void CheckBlockParallel(benchmark::State& state)
+{
+    CheckLargeBlock(state, std::max(2, GetNumCores()));
+}
+
+BENCHMARK(CheckBlockSerial);
+BENCHMARK(CheckBlockParallel);
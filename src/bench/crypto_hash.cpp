@@ -10,6 +10,7 @@
 #include "uint256.h"
 #include "utiltime.h"
 #include "crypto/ripemd160.h"
+#include "crypto/scrypt.h"
 #include "crypto/sha1.h"
 #include "crypto/sha256.h"
 #include "crypto/sha512.h"
@@ -69,10 +70,38 @@ static void SipHash_32b(benchmark::State& state)
     }
 }
 
+/* Number of block headers to scrypt per iteration */
+static const size_t SCRYPT_HEADERS = 64;
+
+static void Scrypt_Single(benchmark::State& state)
+{
+    std::vector<char> in(SCRYPT_HEADERS * 80, 0);
+    std::vector<char> out(SCRYPT_HEADERS * 32);
+    for (size_t i = 0; i < SCRYPT_HEADERS; i++)
+        in[i * 80 + 76] = i;
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < SCRYPT_HEADERS; i++)
+            scrypt_1024_1_1_256(&in[i * 80], &out[i * 32]);
+    }
+}
+
+static void Scrypt_Batch(benchmark::State& state)
+{
+    std::vector<char> in(SCRYPT_HEADERS * 80, 0);
+    std::vector<char> out(SCRYPT_HEADERS * 32);
+    for (size_t i = 0; i < SCRYPT_HEADERS; i++)
+        in[i * 80 + 76] = i;
+    while (state.KeepRunning())
+        scrypt_1024_1_1_256_multi(&in[0], &out[0], SCRYPT_HEADERS);
+}
+
 BENCHMARK(RIPEMD160);
 BENCHMARK(SHA1);
 BENCHMARK(SHA256);
 BENCHMARK(SHA512);
 
+BENCHMARK(Scrypt_Single);
+BENCHMARK(Scrypt_Batch);
+
 BENCHMARK(SHA256_32b);
 BENCHMARK(SipHash_32b);
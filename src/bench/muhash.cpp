@@ -0,0 +1,39 @@
+// Copyright (c) 2014-2019 The Flashcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "muhash.h"
+
+#include <vector>
+
+/* About the size of the record of a pay-to-pubkey-hash output, key included */
+static const size_t RECORD_SIZE = 70;
+
+/* The cost -coinstats adds to a flush for every output written or erased */
+static void MuHashInsert(benchmark::State& state)
+{
+    MuHash3072 hash;
+    std::vector<unsigned char> record(RECORD_SIZE, 0);
+    uint32_t count = 0;
+    while (state.KeepRunning()) {
+        count++;
+        record[0] = count;
+        record[1] = count >> 8;
+        record[2] = count >> 16;
+        hash.Insert(record);
+    }
+}
+
+static void MuHashFinalize(benchmark::State& state)
+{
+    MuHash3072 hash;
+    std::vector<unsigned char> record(RECORD_SIZE, 1);
+    hash.Insert(record);
+    hash.Remove(std::vector<unsigned char>(RECORD_SIZE, 2));
+    while (state.KeepRunning())
+        hash.Finalize();
+}
+
+BENCHMARK(MuHashInsert);
+BENCHMARK(MuHashFinalize);
@@ -3,61 +3,141 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "blocksigning.h"
+#include "consensus/merkle.h"
+#include "core_io.h"
 #include "util.h"
 #include <iostream>
 #include <vector>
 #include <string>
-#include <sstream>  
 
 #include <fstream>  // read privkeyfile.dat
 #include <cstdlib>
 
 #include "primitives/block.h"
+#include "random.h"
+#include "script/script.h"
  
 using namespace std;
- 
-vector<string> split(string str, char delimiter) {
-  vector<string> internal;
-  stringstream ss(str); // Turn the string into a stream.
-  string tok;
- 
-  while(getline(ss, tok, delimiter)) {
-    internal.push_back(tok);
-  }
- 
-  return internal;
+
+CBlsBlockVerifier::CBlsBlockVerifier(const std::string& strPubKey) : setVerified(BLS_VERIFIED_CACHE_SIZE)
+{
+    bls::init(); // use BN254
+    pubkey.setStr(strPubKey, MCLBN_IO_SERIALIZE_HEX_STR);
+}
+
+bool CBlsBlockVerifier::ParseCoinbase(const CScript& scriptSig, const uint256& hashPrevBlock, bls::Signature& sig, std::string& strMessage) const
+{
+    // The fields are read the way they appear in the asm representation of the scriptSig,
+    // which is what the miner signs.
+    const bool fSighashDecode = !scriptSig.IsUnspendable();
+    string strField[3];
+    opcodetype opcode;
+    vector<unsigned char> vch;
+    CScript::const_iterator pc = scriptSig.begin();
+    for (int i = 0; i < 3; i++) {
+        if (pc >= scriptSig.end() || !scriptSig.GetOp(pc, opcode, vch))
+            return false;
+        strField[i] = ScriptOpToAsmStr(opcode, vch, fSighashDecode);
+    }
+
+    try {
+        sig.setStr(strField[2], MCLBN_IO_SERIALIZE_HEX_STR);
+    } catch (const exception& e) {
+        LogPrintf("Erorr! Exception: Miner Signature is not valid form: %s; e.what(): %s\n", strField[2], e.what());
+        return false;
+    }
+    strMessage = BlsSerializeMessage(strField[0], strField[1], hashPrevBlock.ToString());
+    return true;
 }
 
+bool CBlsBlockVerifier::VerifyCoinbase(const CScript& scriptSig, const uint256& hashPrevBlock) const
+{
+    bls::Signature sig;
+    std::string strMessage;
+    if (!ParseCoinbase(scriptSig, hashPrevBlock, sig, strMessage))
+        return false;
+    return sig.verify(pubkey, strMessage);
+}
 
-bool BlsVerifyCoinbaseTransaction(const std::string &scriptSig, const std::string _hashPrevBlock)
+bool CBlsBlockVerifier::VerifyBlock(const CBlock& block, bool fCache)
 {
-    bls::init(); // use BN254
-	// Init public key
-	bls::PublicKey _pubkey;
-    _pubkey.setStr(CONF_BLS_PUBKEY, MCLBN_IO_SERIALIZE_HEX_STR);
-	// Init Signature
-	bls::Signature sig;
-	// Parse data signature from ScriptSig
-	vector<std::string> arStr = split(scriptSig, ' ');
-
-	if(arStr.size() > 2)
-	{
-		// Set Signature
-		try{
-			sig.setStr(arStr[2], MCLBN_IO_SERIALIZE_HEX_STR);
-		}catch (exception& e){
-			//cout << "Erorr! Exception: Miner Signature is not valid form" << arStr[2].c_str() << e.what() << endl;
-			LogPrintf("Erorr! Exception: Miner Signature is not valid form: %s; e.what(): %s\n", arStr[2].c_str(), e.what());
-			return false;
-		}
-		std::string messageSign = BlsSerializeMessage(arStr[0], arStr[1], _hashPrevBlock);
-		if (sig.verify(_pubkey, messageSign)) {
-			return true;
-		} else {
-			return false;
-		}
-	}
-	return false; 
+    if (block.vtx.empty() || !block.vtx[0].IsCoinBase() || block.vtx[0].vin.empty())
+        return false;
+
+    uint256 hash = block.GetHash();
+    if (fCache) {
+        LOCK(cs);
+        if (setVerified.count(hash))
+            return true;
+    }
+
+    if (!VerifyCoinbase(block.vtx[0].vin[0].scriptSig, block.hashPrevBlock))
+        return false;
+
+    if (fCache) {
+        LOCK(cs);
+        setVerified.insert(hash);
+    }
+    return true;
+}
+
+bool CBlsBlockVerifier::VerifyBlocks(const std::vector<const CBlock*>& vBlocks)
+{
+    if (vBlocks.empty())
+        return true;
+
+    // All signatures are under the same public key, so e(sig_i, Q) == e(H(m_i), pubkey) for all i
+    // is checked as e(sum r_i * sig_i, Q) == e(sum r_i * H(m_i), pubkey) with random 128 bit r_i.
+    std::vector<unsigned char> vRand(16 * vBlocks.size());
+    GetRandBytes(&vRand[0], vRand.size());
+    blsSignature sigSum, hashSum;
+    for (size_t i = 0; i < vBlocks.size(); i++) {
+        const CBlock& block = *vBlocks[i];
+        if (block.vtx.empty() || !block.vtx[0].IsCoinBase() || block.vtx[0].vin.empty())
+            return false;
+        // The cache is keyed by block hash, which only covers this coinbase through an intact merkle root
+        bool fMutated;
+        if (BlockMerkleRoot(block, &fMutated) != block.hashMerkleRoot || fMutated)
+            return false;
+        bls::Signature sig;
+        std::string strMessage;
+        if (!ParseCoinbase(block.vtx[0].vin[0].scriptSig, block.hashPrevBlock, sig, strMessage))
+            return false;
+
+        mclBnFr r;
+        blsSignature hash, sigR, hashR;
+        mclBnFr_setLittleEndian(&r, &vRand[16 * i], 16);
+        if (blsHashToSignature(&hash, strMessage.data(), strMessage.size()) != 0)
+            return false;
+        mclBnG1_mul(&sigR.v, &sig.getPtr()->v, &r);
+        mclBnG1_mul(&hashR.v, &hash.v, &r);
+        if (i == 0) {
+            sigSum = sigR;
+            hashSum = hashR;
+        } else {
+            mclBnG1_add(&sigSum.v, &sigSum.v, &sigR.v);
+            mclBnG1_add(&hashSum.v, &hashSum.v, &hashR.v);
+        }
+    }
+    if (blsVerifyPairing(&sigSum, &hashSum, pubkey.getPtr()) != 1)
+        return false;
+
+    LOCK(cs);
+    for (size_t i = 0; i < vBlocks.size(); i++)
+        setVerified.insert(vBlocks[i]->GetHash());
+    return true;
+}
+
+bool CBlsBlockVerifier::IsVerified(const uint256& hash)
+{
+    LOCK(cs);
+    return setVerified.count(hash) > 0;
+}
+
+CBlsBlockVerifier& GetBlsBlockVerifier()
+{
+    static CBlsBlockVerifier verifier;
+    return verifier;
 }
 
 std::string BlsSerializeMessage(const std::string &nHeigh, const std::string &nExtraNonce, const std::string &_hashPrevBlock){
@@ -9,9 +9,69 @@
 #define MCLBN_IO_SERIALIZE_HEX_STR 2048
 #include <bls/bls.hpp>
 #include <fstream>
+
+#include "mruset.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <vector>
+
 #define  CONF_BLS_PUBKEY "84c3ad891b842ca6788bd79e0eb8d06da59fe94acc6a35382f3beee5b9032e177012ed91d5a4fe5f4fa717d8014cc377847ad5508769719b76d0e93e38a53d94"
 
-bool BlsVerifyCoinbaseTransaction(const std::string &scriptSig, const std::string _hashPrevBlock);
+class CBlock;
+class CScript;
+
+/** Blocks with a timestamp after this must carry a valid miner signature.
+ *  1557032400 - Human time (GMT): Sunday, May 5, 2019 5:00:00 AM */
+static const int64_t BLS_SIGNING_START_TIME = 1557032400;
+
+/** Number of blocks whose miner signature is remembered as valid */
+static const unsigned int BLS_VERIFIED_CACHE_SIZE = 1024;
+
+/**
+ * Verifies the miner signature carried in coinbase scriptSigs as
+ * "<height> <extranonce> <signature>" against CONF_BLS_PUBKEY.
+ * The pairing library and the public key are set up once, and the hashes
+ * of blocks that passed are cached so re-checking them is free.
+ */
+class CBlsBlockVerifier
+{
+private:
+    bls::PublicKey pubkey;
+
+    CCriticalSection cs;
+    mruset<uint256> setVerified;
+
+    /** Read the signature and the signed message from a coinbase scriptSig */
+    bool ParseCoinbase(const CScript& scriptSig, const uint256& hashPrevBlock, bls::Signature& sig, std::string& strMessage) const;
+
+public:
+    CBlsBlockVerifier(const std::string& strPubKey = CONF_BLS_PUBKEY);
+
+    /** Check the signature in a coinbase scriptSig for a block on top of hashPrevBlock */
+    bool VerifyCoinbase(const CScript& scriptSig, const uint256& hashPrevBlock) const;
+
+    /**
+     * Check the miner signature of a block. If fCache, the result is looked up in and stored
+     * to the cache, which the caller may only ask for once it checked the merkle root.
+     */
+    bool VerifyBlock(const CBlock& block, bool fCache = true);
+
+    /**
+     * Check the miner signatures of several blocks with a single pairing check over a random
+     * linear combination of them, and cache them all if they pass. Blocks whose merkle root
+     * doesn't match or is mutated fail the batch. A failure doesn't tell which block is bad,
+     * callers fall back to VerifyBlock for that.
+     */
+    bool VerifyBlocks(const std::vector<const CBlock*>& vBlocks);
+
+    /** Whether the block's signature is cached as valid */
+    bool IsVerified(const uint256& hash);
+};
+
+/** The verifier, set up on first use */
+CBlsBlockVerifier& GetBlsBlockVerifier();
+
 std::string BlsSerializeMessage(const std::string &nHeigh, const std::string &nExtraNonce, const std::string &_hashPrevBlock);
 
-#endif // FLASHCOIN_BLOCK_SIGNING_H
\ No newline at end of file
+#endif // FLASHCOIN_BLOCK_SIGNING_H
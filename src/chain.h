@@ -146,6 +146,8 @@ enum BlockStatus: uint32_t {
     BLOCK_FAILED_MASK        =   BLOCK_FAILED_VALID | BLOCK_FAILED_CHILD,
 
     BLOCK_OPT_WITNESS       =   128, //!< block data in blk*.data was received with a witness-enforcing client
+
+    BLOCK_HAVE_POWHASH      =   256, //!< scrypt PoW hash of the header is stored in hashPoW
 };
 
 /** The block chain is a tree shaped structure starting with the
@@ -199,6 +201,9 @@ public:
     unsigned int nBits;
     unsigned int nNonce;
 
+    //! scrypt PoW hash of the header, only set if nStatus & BLOCK_HAVE_POWHASH
+    uint256 hashPoW;
+
     //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
     uint32_t nSequenceId;
 
@@ -222,6 +227,7 @@ public:
         nTime          = 0;
         nBits          = 0;
         nNonce         = 0;
+        hashPoW        = uint256();
     }
 
     CBlockIndex()
@@ -278,9 +284,18 @@ public:
 
     uint256 GetBlockPoWHash() const
     {
+        if (nStatus & BLOCK_HAVE_POWHASH)
+            return hashPoW;
         return GetBlockHeader().GetPoWHash();
     }
 
+    //! Record the scrypt PoW hash so it does not have to be recomputed.
+    void SetBlockPoWHash(const uint256& hash)
+    {
+        hashPoW = hash;
+        nStatus |= BLOCK_HAVE_POWHASH;
+    }
+
     int64_t GetBlockTime() const
     {
         return (int64_t)nTime;
@@ -383,9 +398,14 @@ public:
         READWRITE(nTime);
         READWRITE(nBits);
         READWRITE(nNonce);
+
+        // Entries written before the PoW hash was persisted don't have the
+        // flag set and are upgraded in the background, see ThreadCheckBlockIndexPoW.
+        if (nStatus & BLOCK_HAVE_POWHASH)
+            READWRITE(hashPoW);
     }
 
-    uint256 GetBlockHash() const
+    CBlockHeader GetBlockHeader() const
     {
         CBlockHeader block;
         block.nVersion        = nVersion;
@@ -394,7 +414,12 @@ public:
         block.nTime           = nTime;
         block.nBits           = nBits;
         block.nNonce          = nNonce;
-        return block.GetHash();
+        return block;
+    }
+
+    uint256 GetBlockHash() const
+    {
+        return GetBlockHeader().GetHash();
     }
 
 
@@ -44,7 +44,7 @@ bool CCoins::Spend(uint32_t nPos)
 bool CCoinsView::GetCoins(const uint256 &txid, CCoins &coins) const { return false; }
 bool CCoinsView::HaveCoins(const uint256 &txid) const { return false; }
 uint256 CCoinsView::GetBestBlock() const { return uint256(); }
-bool CCoinsView::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) { return false; }
+bool CCoinsView::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool fErase) { return false; }
 CCoinsViewCursor *CCoinsView::Cursor() const { return 0; }
 
 
@@ -53,12 +53,13 @@ bool CCoinsViewBacked::GetCoins(const uint256 &txid, CCoins &coins) const { retu
 bool CCoinsViewBacked::HaveCoins(const uint256 &txid) const { return base->HaveCoins(txid); }
 uint256 CCoinsViewBacked::GetBestBlock() const { return base->GetBestBlock(); }
 void CCoinsViewBacked::SetBackend(CCoinsView &viewIn) { base = &viewIn; }
-bool CCoinsViewBacked::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) { return base->BatchWrite(mapCoins, hashBlock); }
+bool CCoinsViewBacked::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool fErase) { return base->BatchWrite(mapCoins, hashBlock, fErase); }
 CCoinsViewCursor *CCoinsViewBacked::Cursor() const { return base->Cursor(); }
 
 SaltedTxidHasher::SaltedTxidHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
 
-CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), hasModifier(false), cachedCoinsUsage(0) { }
+CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), hasModifier(false),
+    cacheCoins(0, SaltedTxidHasher(), CCoinsMap::key_equal(), &cacheCoinsMemoryResource), cachedCoinsUsage(0), nTrimBucket(0) { }
 
 CCoinsViewCache::~CCoinsViewCache()
 {
@@ -69,19 +70,26 @@ size_t CCoinsViewCache::DynamicMemoryUsage() const {
     return memusage::DynamicUsage(cacheCoins) + cachedCoinsUsage;
 }
 
+size_t CCoinsViewCache::ActiveMemoryUsage() const {
+    return DynamicMemoryUsage() - cacheCoinsMemoryResource.FreeBytes();
+}
+
 CCoinsMap::const_iterator CCoinsViewCache::FetchCoins(const uint256 &txid) const {
     CCoinsMap::iterator it = cacheCoins.find(txid);
-    if (it != cacheCoins.end())
+    if (it != cacheCoins.end()) {
+        it->second.flags |= CCoinsCacheEntry::USED;
         return it;
+    }
     CCoins tmp;
     if (!base->GetCoins(txid, tmp))
         return cacheCoins.end();
     CCoinsMap::iterator ret = cacheCoins.insert(std::make_pair(txid, CCoinsCacheEntry())).first;
     tmp.swap(ret->second.coins);
+    ret->second.flags = CCoinsCacheEntry::USED;
     if (ret->second.coins.IsPruned()) {
         // The parent only has an empty entry for this txid; we can consider our
         // version as fresh.
-        ret->second.flags = CCoinsCacheEntry::FRESH;
+        ret->second.flags |= CCoinsCacheEntry::FRESH;
     }
     cachedCoinsUsage += ret->second.coins.DynamicMemoryUsage();
     return ret;
@@ -155,6 +163,24 @@ bool CCoinsViewCache::HaveCoinsInCache(const uint256 &txid) const {
     return it != cacheCoins.end();
 }
 
+bool CCoinsViewCache::GetCoinsFromBase(const uint256 &txid, CCoins &coins) const {
+    return base->GetCoins(txid, coins);
+}
+
+void CCoinsViewCache::CacheCoins(const uint256 &txid, CCoins &coins) {
+    std::pair<CCoinsMap::iterator, bool> ret = cacheCoins.insert(std::make_pair(txid, CCoinsCacheEntry()));
+    if (!ret.second)
+        return;
+    coins.swap(ret.first->second.coins);
+    // Prefetched for upcoming blocks, so spare it from the next Trim()
+    ret.first->second.flags = CCoinsCacheEntry::USED;
+    if (ret.first->second.coins.IsPruned()) {
+        // Nothing to write back for this entry unless it gets modified.
+        ret.first->second.flags |= CCoinsCacheEntry::FRESH;
+    }
+    cachedCoinsUsage += ret.first->second.coins.DynamicMemoryUsage();
+}
+
 uint256 CCoinsViewCache::GetBestBlock() const {
     if (hashBlock.IsNull())
         hashBlock = base->GetBestBlock();
@@ -165,7 +191,7 @@ void CCoinsViewCache::SetBestBlock(const uint256 &hashBlockIn) {
     hashBlock = hashBlockIn;
 }
 
-bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn) {
+bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn, bool fErase) {
     assert(!hasModifier);
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) { // Ignore non-dirty entries (optimization).
@@ -177,7 +203,10 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
                     // Otherwise we will need to create it in the parent
                     // and move the data up and mark it as dirty
                     CCoinsCacheEntry& entry = cacheCoins[it->first];
-                    entry.coins.swap(it->second.coins);
+                    if (fErase)
+                        entry.coins.swap(it->second.coins);
+                    else
+                        entry.coins = it->second.coins;
                     cachedCoinsUsage += entry.coins.DynamicMemoryUsage();
                     entry.flags = CCoinsCacheEntry::DIRTY;
                     // We can mark it FRESH in the parent if it was FRESH in the child
@@ -197,14 +226,21 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
                 } else {
                     // A normal modification.
                     cachedCoinsUsage -= itUs->second.coins.DynamicMemoryUsage();
-                    itUs->second.coins.swap(it->second.coins);
+                    if (fErase)
+                        itUs->second.coins.swap(it->second.coins);
+                    else
+                        itUs->second.coins = it->second.coins;
                     cachedCoinsUsage += itUs->second.coins.DynamicMemoryUsage();
                     itUs->second.flags |= CCoinsCacheEntry::DIRTY;
                 }
             }
         }
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
+        if (fErase) {
+            CCoinsMap::iterator itOld = it++;
+            mapCoins.erase(itOld);
+        } else {
+            ++it;
+        }
     }
     hashBlock = hashBlockIn;
     return true;
@@ -212,15 +248,73 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
 
 bool CCoinsViewCache::Flush() {
     bool fOk = base->BatchWrite(cacheCoins, hashBlock);
-    cacheCoins.clear();
+    ReallocateCache();
     cachedCoinsUsage = 0;
     return fOk;
 }
 
+bool CCoinsViewCache::Sync() {
+    // Entries stay dirty unless the base really has them
+    if (!base->BatchWrite(cacheCoins, hashBlock, false))
+        return false;
+    for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end();) {
+        if (it->second.flags & CCoinsCacheEntry::DIRTY) {
+            if (it->second.coins.IsPruned()) {
+                cachedCoinsUsage -= it->second.coins.DynamicMemoryUsage();
+                it = cacheCoins.erase(it);
+                continue;
+            }
+            // The base has it now; it was just modified, so keep it around for a while
+            it->second.flags = CCoinsCacheEntry::USED;
+        }
+        ++it;
+    }
+    return true;
+}
+
+size_t CCoinsViewCache::Trim(size_t nTargetUsage) {
+    assert(!hasModifier);
+    // A clock sweep over the buckets: the first time an entry is passed only
+    // its USED flag is cleared, the second time it is evicted.
+    size_t nEvicted = 0;
+    const size_t nBuckets = cacheCoins.bucket_count();
+    if (nBuckets == 0)
+        return 0;
+    std::vector<uint256> vEvict;
+    for (size_t nVisited = 0; nVisited < 2 * nBuckets && ActiveMemoryUsage() > nTargetUsage; nVisited++) {
+        const size_t nBucket = nTrimBucket++ % nBuckets;
+        vEvict.clear();
+        for (CCoinsMap::local_iterator it = cacheCoins.begin(nBucket); it != cacheCoins.end(nBucket); ++it) {
+            if (it->second.flags & CCoinsCacheEntry::DIRTY)
+                continue;
+            if (it->second.flags & CCoinsCacheEntry::USED)
+                it->second.flags &= ~CCoinsCacheEntry::USED;
+            else
+                vEvict.push_back(it->first);
+        }
+        BOOST_FOREACH(const uint256& txid, vEvict) {
+            CCoinsMap::iterator it = cacheCoins.find(txid);
+            cachedCoinsUsage -= it->second.coins.DynamicMemoryUsage();
+            cacheCoins.erase(it);
+        }
+        nEvicted += vEvict.size();
+    }
+    return nEvicted;
+}
+
+void CCoinsViewCache::ReallocateCache()
+{
+    // The map has to go before the pool it was allocated from
+    cacheCoins.~CCoinsMap();
+    cacheCoinsMemoryResource.~CCoinsMapMemoryResource();
+    ::new (&cacheCoinsMemoryResource) CCoinsMapMemoryResource();
+    ::new (&cacheCoins) CCoinsMap(0, SaltedTxidHasher(), CCoinsMap::key_equal(), &cacheCoinsMemoryResource);
+}
+
 void CCoinsViewCache::Uncache(const uint256& hash)
 {
     CCoinsMap::iterator it = cacheCoins.find(hash);
-    if (it != cacheCoins.end() && it->second.flags == 0) {
+    if (it != cacheCoins.end() && !(it->second.flags & (CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::FRESH))) {
         cachedCoinsUsage -= it->second.coins.DynamicMemoryUsage();
         cacheCoins.erase(it);
     }
@@ -230,6 +324,15 @@ unsigned int CCoinsViewCache::GetCacheSize() const {
     return cacheCoins.size();
 }
 
+size_t CCoinsViewCache::GetDirtyCount() const {
+    size_t nDirty = 0;
+    for (CCoinsMap::const_iterator it = cacheCoins.begin(); it != cacheCoins.end(); ++it) {
+        if (it->second.flags & CCoinsCacheEntry::DIRTY)
+            nDirty++;
+    }
+    return nDirty;
+}
+
 const CTxOut &CCoinsViewCache::GetOutputFor(const CTxIn& input) const
 {
     const CCoins* coins = AccessCoins(input.prevout.hash);
@@ -11,11 +11,14 @@
 #include "hash.h"
 #include "memusage.h"
 #include "serialize.h"
+#include "support/allocators/pool.h"
 #include "uint256.h"
 
 #include <assert.h>
 #include <stdint.h>
 
+#include <functional>
+
 #include <boost/foreach.hpp>
 #include <boost/unordered_map.hpp>
 
@@ -292,12 +295,21 @@ struct CCoinsCacheEntry
     enum Flags {
         DIRTY = (1 << 0), // This cache entry is potentially different from the version in the parent view.
         FRESH = (1 << 1), // The parent view does not have this entry (or it is pruned).
+        USED = (1 << 2), // This cache entry was looked up since CCoinsViewCache::Trim() last passed it.
     };
 
     CCoinsCacheEntry() : coins(), flags(0) {}
 };
 
-typedef boost::unordered_map<uint256, CCoinsCacheEntry, SaltedTxidHasher> CCoinsMap;
+/**
+ * The entries of a CCoinsMap come from a pool owned by its cache, saving the
+ * malloc overhead of millions of equally sized nodes. Blocks are sized for
+ * the map's nodes, which add a few pointers to the key and entry.
+ */
+typedef boost::unordered_map<uint256, CCoinsCacheEntry, SaltedTxidHasher, std::equal_to<uint256>,
+    PoolAllocator<std::pair<const uint256, CCoinsCacheEntry>,
+                  sizeof(std::pair<const uint256, CCoinsCacheEntry>) + sizeof(void*) * 4> > CCoinsMap;
+typedef CCoinsMap::allocator_type::ResourceType CCoinsMapMemoryResource;
 
 /** Cursor for iterating over CoinsView state */
 class CCoinsViewCursor
@@ -335,8 +347,8 @@ public:
     virtual uint256 GetBestBlock() const;
 
     //! Do a bulk modification (multiple CCoins changes + BestBlock change).
-    //! The passed mapCoins can be modified.
-    virtual bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
+    //! With fErase the passed mapCoins can be modified, otherwise it is left as it is.
+    virtual bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool fErase = true);
 
     //! Get a cursor to iterate over the whole state
     virtual CCoinsViewCursor *Cursor() const;
@@ -358,7 +370,7 @@ public:
     bool HaveCoins(const uint256 &txid) const;
     uint256 GetBestBlock() const;
     void SetBackend(CCoinsView &viewIn);
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool fErase = true);
     CCoinsViewCursor *Cursor() const;
 };
 
@@ -398,11 +410,16 @@ protected:
      * declared as "const".  
      */
     mutable uint256 hashBlock;
+    //! Backs the nodes of cacheCoins, so it is declared first
+    mutable CCoinsMapMemoryResource cacheCoinsMemoryResource;
     mutable CCoinsMap cacheCoins;
 
     /* Cached dynamic memory usage for the inner CCoins objects. */
     mutable size_t cachedCoinsUsage;
 
+    /* Bucket at which the next Trim() continues. */
+    size_t nTrimBucket;
+
 public:
     CCoinsViewCache(CCoinsView *baseIn);
     ~CCoinsViewCache();
@@ -412,7 +429,7 @@ public:
     bool HaveCoins(const uint256 &txid) const;
     uint256 GetBestBlock() const;
     void SetBestBlock(const uint256 &hashBlock);
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool fErase = true);
 
     /**
      * Check if we have the given tx already loaded in this cache.
@@ -421,6 +438,20 @@ public:
      */
     bool HaveCoinsInCache(const uint256 &txid) const;
 
+    /**
+     * Read the coins of txid from the backing view, without looking at or
+     * filling this cache. Unlike the other methods this may be called from
+     * several threads at once, as long as the backing view supports
+     * concurrent reads and nothing modifies it meanwhile.
+     */
+    bool GetCoinsFromBase(const uint256 &txid, CCoins &coins) const;
+
+    /**
+     * Add coins obtained through GetCoinsFromBase to the cache, unless txid
+     * is cached already. Pass empty coins for a txid that wasn't found.
+     */
+    void CacheCoins(const uint256 &txid, CCoins &coins);
+
     /**
      * Return a pointer to CCoins in the cache, or NULL if not found. This is
      * more efficient than GetCoins. Modifications to other cache entries are
@@ -453,6 +484,19 @@ public:
      */
     bool Flush();
 
+    /**
+     * Like Flush(), but keep the cache: written entries stay as clean entries,
+     * spent ones are dropped.
+     */
+    bool Sync();
+
+    /**
+     * Evict unmodified entries until ActiveMemoryUsage() is at most
+     * nTargetUsage, or only modified entries are left. Entries looked up since
+     * the previous call are passed over once. Returns the number evicted.
+     */
+    size_t Trim(size_t nTargetUsage);
+
     /**
      * Removes the transaction with the given hash from the cache, if it is
      * not modified.
@@ -462,9 +506,15 @@ public:
     //! Calculate the size of the cache (in number of transactions)
     unsigned int GetCacheSize() const;
 
+    //! Calculate the number of cached transactions that the base doesn't have yet
+    size_t GetDirtyCount() const;
+
     //! Calculate the size of the cache (in bytes)
     size_t DynamicMemoryUsage() const;
 
+    //! Same, but without pool memory freed by spends and evictions, which new entries take first
+    size_t ActiveMemoryUsage() const;
+
     /** 
      * Amount of bitcoins coming in to a transaction
      * Note that lightweight clients may not know anything besides the hash of previous transactions,
@@ -490,6 +540,12 @@ public:
     friend class CCoinsModifier;
 
 private:
+    /**
+     * Replace cacheCoins and its pool by new, empty ones. Clearing the map
+     * would keep all pool memory around for reuse.
+     */
+    void ReallocateCache();
+
     CCoinsMap::iterator FetchCoins(const uint256 &txid);
     CCoinsMap::const_iterator FetchCoins(const uint256 &txid) const;
 
@@ -108,6 +108,8 @@ static const unsigned int BLOCK_STALLING_TIMEOUT = 2;
 /** Number of headers sent in one getheaders result. We rely on the assumption that if a peer sends
  *  less than this number, we reached its tip. Changing this value is a protocol upgrade. */
 static const unsigned int MAX_HEADERS_RESULTS = 2000;
+/** Most headers of a message hashed in parallel before accepting them, from a peer that hasn't sent a valid header yet */
+static const unsigned int MAX_HEADERS_POW_AHEAD_NEW_PEER = 16;
 /** Maximum depth of blocks we're willing to serve as compact blocks to peers
  *  when requested. For older blocks, a regular BLOCK response will be sent. */
 static const int MAX_CMPCTBLOCK_DEPTH = 5;
@@ -151,6 +153,9 @@ static const int64_t DEFAULT_MAX_TIP_AGE = 24 * 60 * 60;
 static const bool DEFAULT_PERMIT_BAREMULTISIG = true;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 static const bool DEFAULT_TXINDEX = false;
+static const bool DEFAULT_ADDRESSINDEX = false;
+static const bool DEFAULT_SPENTINDEX = false;
+static const bool DEFAULT_TIMESTAMPINDEX = false;
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 
 static const bool DEFAULT_TESTSAFEMODE = false;
@@ -211,6 +216,12 @@ static const bool DEFAULT_BLOCKSONLY = false;
 static const bool DEFAULT_FORCEDNSSEED = false;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER    = 1 * 1000;
+/** Default for -msghandlerthreads: threads handling messages such as ping and addr next to the main message handler */
+static const int DEFAULT_MESSAGE_HANDLER_THREADS = 2;
+/** Maximum for -msghandlerthreads */
+static const int MAX_MESSAGE_HANDLER_THREADS = 16;
+/** Default for -socketpoll: watch peer sockets with epoll instead of select() where available */
+static const bool DEFAULT_SOCKET_POLL = true;
 
 
 //txmempool.h
@@ -130,6 +130,17 @@ static void MerkleComputation(const std::vector<uint256>& leaves, uint256* proot
     if (proot) *proot = h;
 }
 
+void ComputeMerkleLevel(const uint256* nodes, size_t nCount, uint256* parents, bool* mutated) {
+    bool fMutated = false;
+    for (size_t i = 0; i < nCount; i += 2) {
+        const uint256& right = i + 1 < nCount ? nodes[i + 1] : nodes[i];
+        if (i + 1 < nCount)
+            fMutated |= (nodes[i] == right);
+        CHash256().Write(nodes[i].begin(), 32).Write(right.begin(), 32).Finalize(parents[i / 2].begin());
+    }
+    if (mutated) *mutated = fMutated;
+}
+
 uint256 ComputeMerkleRoot(const std::vector<uint256>& leaves, bool* mutated) {
     uint256 hash;
     MerkleComputation(leaves, &hash, mutated, -1, NULL);
@@ -16,6 +16,13 @@ uint256 ComputeMerkleRoot(const std::vector<uint256>& leaves, bool* mutated = NU
 std::vector<uint256> ComputeMerkleBranch(const std::vector<uint256>& leaves, uint32_t position);
 uint256 ComputeMerkleRootFromBranch(const uint256& leaf, const std::vector<uint256>& branch, uint32_t position);
 
+/*
+ * Hash nCount nodes of one level of a Merkle tree pairwise into their
+ * (nCount + 1) / 2 parents, an odd last node being paired with itself.
+ * *mutated is set to true if two paired nodes are equal.
+ */
+void ComputeMerkleLevel(const uint256* nodes, size_t nCount, uint256* parents, bool* mutated = NULL);
+
 /*
  * Compute the Merkle root of the transactions in a block.
  * *mutated is set to true if a duplicated subtree was found.
@@ -5,11 +5,12 @@
 #ifndef BITCOIN_CORE_IO_H
 #define BITCOIN_CORE_IO_H
 
+#include "script/script.h"
+
 #include <string>
 #include <vector>
 
 class CBlock;
-class CScript;
 class CTransaction;
 class uint256;
 class UniValue;
@@ -25,6 +26,7 @@ extern std::vector<unsigned char> ParseHexUV(const UniValue& v, const std::strin
 
 // core_write.cpp
 extern std::string FormatScript(const CScript& script);
+extern std::string ScriptOpToAsmStr(opcodetype opcode, std::vector<unsigned char> vch, const bool fAttemptSighashDecode = false);
 extern std::string EncodeHexTx(const CTransaction& tx, const int serializeFlags = 0);
 extern void ScriptPubKeyToUniv(const CScript& scriptPubKey, UniValue& out, bool fIncludeHex);
 extern void TxToUniv(const CTransaction& tx, const uint256& hashBlock, UniValue& entry);
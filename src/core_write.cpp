@@ -65,6 +65,41 @@ const map<unsigned char, string> mapSigHashTypes =
     (static_cast<unsigned char>(SIGHASH_SINGLE|SIGHASH_ANYONECANPAY), string("SINGLE|ANYONECANPAY"))
     ;
 
+/**
+ * Create the assembly string representation of a single script operation, as it appears in ScriptToAsmStr.
+ * @param[in] opcode    Opcode of the operation.
+ * @param[in] vch       Data pushed by the operation, if any.
+ * @param[in] fAttemptSighashDecode    Whether to attempt to decode a sighash type if the data matches the format of a signature.
+ */
+string ScriptOpToAsmStr(opcodetype opcode, vector<unsigned char> vch, const bool fAttemptSighashDecode)
+{
+    if (0 <= opcode && opcode <= OP_PUSHDATA4) {
+        if (vch.size() <= static_cast<vector<unsigned char>::size_type>(4)) {
+            return strprintf("%d", CScriptNum(vch, false).getint());
+        } else {
+            if (fAttemptSighashDecode) {
+                string strSigHashDecode;
+                // goal: only attempt to decode a defined sighash type from data that looks like a signature within a scriptSig.
+                // this won't decode correctly formatted public keys in Pubkey or Multisig scripts due to
+                // the restrictions on the pubkey formats (see IsCompressedOrUncompressedPubKey) being incongruous with the
+                // checks in CheckSignatureEncoding.
+                if (CheckSignatureEncoding(vch, SCRIPT_VERIFY_STRICTENC, NULL)) {
+                    const unsigned char chSigHashType = vch.back();
+                    if (mapSigHashTypes.count(chSigHashType)) {
+                        strSigHashDecode = "[" + mapSigHashTypes.find(chSigHashType)->second + "]";
+                        vch.pop_back(); // remove the sighash type byte. it will be replaced by the decode.
+                    }
+                }
+                return HexStr(vch) + strSigHashDecode;
+            } else {
+                return HexStr(vch);
+            }
+        }
+    } else {
+        return GetOpName(opcode);
+    }
+}
+
 /**
  * Create the assembly string representation of a CScript object.
  * @param[in] script    CScript object to convert into the asm string representation.
@@ -77,6 +112,8 @@ string ScriptToAsmStr(const CScript& script, const bool fAttemptSighashDecode)
     string str;
     opcodetype opcode;
     vector<unsigned char> vch;
+    // the IsUnspendable check makes sure not to try to decode OP_RETURN data that may match the format of a signature
+    const bool fSighashDecode = fAttemptSighashDecode && !script.IsUnspendable();
     CScript::const_iterator pc = script.begin();
     while (pc < script.end()) {
         if (!str.empty()) {
@@ -86,32 +123,7 @@ string ScriptToAsmStr(const CScript& script, const bool fAttemptSighashDecode)
             str += "[error]";
             return str;
         }
-        if (0 <= opcode && opcode <= OP_PUSHDATA4) {
-            if (vch.size() <= static_cast<vector<unsigned char>::size_type>(4)) {
-                str += strprintf("%d", CScriptNum(vch, false).getint());
-            } else {
-                // the IsUnspendable check makes sure not to try to decode OP_RETURN data that may match the format of a signature
-                if (fAttemptSighashDecode && !script.IsUnspendable()) {
-                    string strSigHashDecode;
-                    // goal: only attempt to decode a defined sighash type from data that looks like a signature within a scriptSig.
-                    // this won't decode correctly formatted public keys in Pubkey or Multisig scripts due to
-                    // the restrictions on the pubkey formats (see IsCompressedOrUncompressedPubKey) being incongruous with the
-                    // checks in CheckSignatureEncoding.
-                    if (CheckSignatureEncoding(vch, SCRIPT_VERIFY_STRICTENC, NULL)) {
-                        const unsigned char chSigHashType = vch.back();
-                        if (mapSigHashTypes.count(chSigHashType)) {
-                            strSigHashDecode = "[" + mapSigHashTypes.find(chSigHashType)->second + "]";
-                            vch.pop_back(); // remove the sighash type byte. it will be replaced by the decode.
-                        }
-                    }
-                    str += HexStr(vch) + strSigHashDecode;
-                } else {
-                    str += HexStr(vch);
-                }
-            }
-        } else {
-            str += GetOpName(opcode);
-        }
+        str += ScriptOpToAsmStr(opcode, vch, fSighashDecode);
     }
     return str;
 }
@@ -0,0 +1,210 @@
+/*
+ * Copyright 2009 Colin Percival, 2011 ArtForz, 2012-2013 pooler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file was originally written by Colin Percival as part of the Tarsnap
+ * online backup system.
+ */
+
+/*
+ * Multi-buffer scrypt(1024, 1, 1) for hashing many block headers at once.
+ *
+ * The salsa20/8 state of SCRYPT_MULTI_WAYS independent hashes is kept
+ * interleaved ("vertically"): each vector register holds the same state word
+ * of every hash, one hash per 32-bit lane, so one salsa20/8 round advances all
+ * of them. The data dependent reads from the scratchpad differ per lane and
+ * are done with scalar loads.
+ */
+
+#include "crypto/scrypt.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+
+#define SCRYPT_MULTI_SIMD 1
+#define SCRYPT_MULTI_WAYS 8
+
+typedef __m256i lane_t;
+
+static inline lane_t lane_add(lane_t a, lane_t b) { return _mm256_add_epi32(a, b); }
+static inline lane_t lane_xor(lane_t a, lane_t b) { return _mm256_xor_si256(a, b); }
+static inline lane_t lane_rotl(lane_t a, int n) { return _mm256_or_si256(_mm256_slli_epi32(a, n), _mm256_srli_epi32(a, 32 - n)); }
+
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+
+#define SCRYPT_MULTI_SIMD 1
+#define SCRYPT_MULTI_WAYS 4
+
+typedef __m128i lane_t;
+
+static inline lane_t lane_add(lane_t a, lane_t b) { return _mm_add_epi32(a, b); }
+static inline lane_t lane_xor(lane_t a, lane_t b) { return _mm_xor_si128(a, b); }
+static inline lane_t lane_rotl(lane_t a, int n) { return _mm_or_si128(_mm_slli_epi32(a, n), _mm_srli_epi32(a, 32 - n)); }
+
+#else
+#define SCRYPT_MULTI_WAYS 1
+#endif
+
+size_t scrypt_1024_1_1_256_multi_ways()
+{
+	return SCRYPT_MULTI_WAYS;
+}
+
+#if defined(SCRYPT_MULTI_SIMD)
+
+#define QR(a, b, c, n) a = lane_xor(a, lane_rotl(lane_add(b, c), n))
+
+static inline void xor_salsa8_multi(lane_t B[16], const lane_t Bx[16])
+{
+	lane_t x[16];
+	int i;
+
+	for (i = 0; i < 16; i++)
+		x[i] = B[i] = lane_xor(B[i], Bx[i]);
+
+	for (i = 0; i < 8; i += 2) {
+		/* Operate on columns. */
+		QR(x[ 4], x[ 0], x[12],  7);  QR(x[ 9], x[ 5], x[ 1],  7);
+		QR(x[14], x[10], x[ 6],  7);  QR(x[ 3], x[15], x[11],  7);
+
+		QR(x[ 8], x[ 4], x[ 0],  9);  QR(x[13], x[ 9], x[ 5],  9);
+		QR(x[ 2], x[14], x[10],  9);  QR(x[ 7], x[ 3], x[15],  9);
+
+		QR(x[12], x[ 8], x[ 4], 13);  QR(x[ 1], x[13], x[ 9], 13);
+		QR(x[ 6], x[ 2], x[14], 13);  QR(x[11], x[ 7], x[ 3], 13);
+
+		QR(x[ 0], x[12], x[ 8], 18);  QR(x[ 5], x[ 1], x[13], 18);
+		QR(x[10], x[ 6], x[ 2], 18);  QR(x[15], x[11], x[ 7], 18);
+
+		/* Operate on rows. */
+		QR(x[ 1], x[ 0], x[ 3],  7);  QR(x[ 6], x[ 5], x[ 4],  7);
+		QR(x[11], x[10], x[ 9],  7);  QR(x[12], x[15], x[14],  7);
+
+		QR(x[ 2], x[ 1], x[ 0],  9);  QR(x[ 7], x[ 6], x[ 5],  9);
+		QR(x[ 8], x[11], x[10],  9);  QR(x[13], x[12], x[15],  9);
+
+		QR(x[ 3], x[ 2], x[ 1], 13);  QR(x[ 4], x[ 7], x[ 6], 13);
+		QR(x[ 9], x[ 8], x[11], 13);  QR(x[14], x[13], x[12], 13);
+
+		QR(x[ 0], x[ 3], x[ 2], 18);  QR(x[ 5], x[ 4], x[ 7], 18);
+		QR(x[10], x[ 9], x[ 8], 18);  QR(x[15], x[14], x[13], 18);
+	}
+
+	for (i = 0; i < 16; i++)
+		B[i] = lane_add(B[i], x[i]);
+}
+
+#undef QR
+
+/* Hash SCRYPT_MULTI_WAYS inputs, V must hold 1024 * 32 aligned lane_t. */
+static void scrypt_1024_1_1_256_sp_multi(const char *input[SCRYPT_MULTI_WAYS], char *output[SCRYPT_MULTI_WAYS], lane_t *V)
+{
+	uint8_t B[SCRYPT_MULTI_WAYS][128];
+	union {
+		lane_t v[32];
+		uint32_t u32[32][SCRYPT_MULTI_WAYS];
+	} X;
+	uint32_t (*V32)[SCRYPT_MULTI_WAYS] = (uint32_t (*)[SCRYPT_MULTI_WAYS])V;
+	uint32_t i, j, k, l;
+
+	for (l = 0; l < SCRYPT_MULTI_WAYS; l++) {
+		PBKDF2_SHA256((const uint8_t *)input[l], 80, (const uint8_t *)input[l], 80, 1, B[l], 128);
+		for (k = 0; k < 32; k++)
+			X.u32[k][l] = le32dec(&B[l][4 * k]);
+	}
+
+	for (i = 0; i < 1024; i++) {
+		memcpy(&V[i * 32], X.v, sizeof(X.v));
+		xor_salsa8_multi(&X.v[0], &X.v[16]);
+		xor_salsa8_multi(&X.v[16], &X.v[0]);
+	}
+	for (i = 0; i < 1024; i++) {
+		for (l = 0; l < SCRYPT_MULTI_WAYS; l++) {
+			j = 32 * (X.u32[16][l] & 1023);
+			for (k = 0; k < 32; k++)
+				X.u32[k][l] ^= V32[j + k][l];
+		}
+		xor_salsa8_multi(&X.v[0], &X.v[16]);
+		xor_salsa8_multi(&X.v[16], &X.v[0]);
+	}
+
+	for (l = 0; l < SCRYPT_MULTI_WAYS; l++) {
+		for (k = 0; k < 32; k++)
+			le32enc(&B[l][4 * k], X.u32[k][l]);
+		PBKDF2_SHA256((const uint8_t *)input[l], 80, B[l], 128, 1, (uint8_t *)output[l], 32);
+	}
+}
+
+void scrypt_1024_1_1_256_multi(const char *input, char *output, size_t count)
+{
+	const char *in[SCRYPT_MULTI_WAYS];
+	char *out[SCRYPT_MULTI_WAYS];
+	char discard[SCRYPT_MULTI_WAYS - 1][32];
+	char *scratchpad;
+	lane_t *V;
+	size_t n, l;
+
+	if (count == 1) {
+		scrypt_1024_1_1_256(input, output);
+		return;
+	}
+
+	scratchpad = (char *)malloc(1024 * 32 * sizeof(lane_t) + 63);
+	if (scratchpad == NULL)
+		abort();
+	V = (lane_t *)(((uintptr_t)(scratchpad) + 63) & ~ (uintptr_t)(63));
+
+	for (n = 0; n < count; n += SCRYPT_MULTI_WAYS) {
+		/* Fill the unused lanes of the last group with copies of its first input. */
+		for (l = 0; l < SCRYPT_MULTI_WAYS; l++) {
+			if (n + l < count) {
+				in[l] = input + (n + l) * 80;
+				out[l] = output + (n + l) * 32;
+			} else {
+				in[l] = input + n * 80;
+				out[l] = discard[l - 1];
+			}
+		}
+		scrypt_1024_1_1_256_sp_multi(in, out, V);
+	}
+
+	free(scratchpad);
+}
+
+#else // SCRYPT_MULTI_SIMD
+
+void scrypt_1024_1_1_256_multi(const char *input, char *output, size_t count)
+{
+	char scratchpad[SCRYPT_SCRATCHPAD_SIZE];
+	size_t n;
+
+	for (n = 0; n < count; n++)
+		scrypt_1024_1_1_256_sp(input + n * 80, output + n * 32, scratchpad);
+}
+
+#endif // SCRYPT_MULTI_SIMD
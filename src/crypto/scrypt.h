@@ -8,6 +8,11 @@ static const int SCRYPT_SCRATCHPAD_SIZE = 131072 + 63;
 void scrypt_1024_1_1_256(const char *input, char *output);
 void scrypt_1024_1_1_256_sp_generic(const char *input, char *output, char *scratchpad);
 
+/** Hash count consecutive 80 byte inputs into count consecutive 32 byte outputs,
+ *  interleaving scrypt_1024_1_1_256_multi_ways() of them per pass through the SIMD kernel. */
+void scrypt_1024_1_1_256_multi(const char *input, char *output, size_t count);
+size_t scrypt_1024_1_1_256_multi_ways();
+
 #if defined(USE_SSE2)
 #if defined(_M_X64) || defined(__x86_64__) || defined(_M_AMD64) || (defined(MAC_OSX) && defined(__i386__))
 #define USE_SSE2_ALWAYS 1
@@ -7,6 +7,7 @@
 #include "base58.h"
 #include "chainparams.h"
 #include "httpserver.h"
+#include "rpc/jsonstream.h"
 #include "rpc/protocol.h"
 #include "rpc/server.h"
 #include "random.h"
@@ -19,6 +20,7 @@
 #include "utilstrencodings.h"
 
 #include <boost/algorithm/string.hpp> // boost::trim
+#include <boost/bind.hpp>
 #include <boost/foreach.hpp> //BOOST_FOREACH
 
 /** WWW-Authenticate to present with 401 Unauthorized response */
@@ -83,6 +85,48 @@ static void JSONErrorReply(HTTPRequest* req, const UniValue& objError, const Uni
     req->WriteReply(nStatus, strReply);
 }
 
+/** Sink of a streamed JSON-RPC reply, the first chunk starts the reply */
+static void WriteJSONChunk(HTTPRequest* req, const std::string& strChunk)
+{
+    if (!req->IsChunked())
+        req->WriteHeader("Content-Type", "application/json");
+    req->WriteReplyChunk(strChunk);
+}
+
+/**
+ * Reply to a single request through the streaming actor of its command, so that
+ * large results go out as they are produced. Returns false if the command has no
+ * streaming form for this call, without having written anything.
+ */
+static bool JSONRPCStreamReply(HTTPRequest* req, const JSONRequest& jreq)
+{
+    CJSONStreamWriter writer(boost::bind(&WriteJSONChunk, req, _1));
+    writer.BeginObject();
+    writer.Key("result");
+    try {
+        if (!tableRPC.executeStream(jreq.strMethod, jreq.params, writer))
+            return false;
+    } catch (...) {
+        if (!writer.Flushed())
+            throw;
+        // The status line has gone out already, all that is left is to cut the reply short
+        LogPrintf("%s: error while streaming reply to %s, reply truncated\n", __func__, jreq.strMethod);
+        req->WriteReplyEnd();
+        return true;
+    }
+    writer.Key("error");
+    writer.Value(NullUniValue);
+    writer.Key("id");
+    writer.Value(jreq.id);
+    writer.EndObject();
+    writer.Raw("\n");
+
+    if (!req->IsChunked())
+        req->WriteHeader("Content-Type", "application/json");
+    req->WriteReplyEnd(writer.TakeBuffer());
+    return true;
+}
+
 //This function checks username and password against -rpcauth
 //entries from config file.
 static bool multiUserAuthorized(std::string strUserPass)
@@ -184,6 +228,9 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
         if (valRequest.isObject()) {
             jreq.parse(valRequest);
 
+            if (JSONRPCStreamReply(req, jreq))
+                return true;
+
             UniValue result = tableRPC.execute(jreq.strMethod, jreq.params);
 
             // Send reply
@@ -191,7 +238,7 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
 
         // array of requests
         } else if (valRequest.isArray())
-            strReply = JSONRPCExecBatch(valRequest.get_array());
+            strReply = JSONRPCExecBatch(valRequest.get_array(), &HTTPEnqueueTask);
         else
             throw JSONRPCError(RPC_PARSE_ERROR, "Top-level object parse error");
 
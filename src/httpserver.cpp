@@ -19,6 +19,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <signal.h>
+#include <unistd.h>
 
 #include <event2/event.h>
 #include <event2/http.h>
@@ -60,6 +61,22 @@ private:
     HTTPRequestHandler func;
 };
 
+/** Generic task work item, used to spread a request over several workers */
+class HTTPTaskItem : public HTTPClosure
+{
+public:
+    HTTPTaskItem(const boost::function<void(void)>& task): task(task)
+    {
+    }
+    void operator()()
+    {
+        task();
+    }
+
+private:
+    boost::function<void(void)> task;
+};
+
 /** Simple work queue for distributing work over multiple threads.
  * Work items are simply callable objects.
  */
@@ -473,6 +490,7 @@ void StopHTTPServer()
         LogPrint("http", "Waiting for HTTP worker threads to exit\n");
         workQueue->WaitExit();
         delete workQueue;
+        workQueue = 0;
     }
     if (eventBase) {
         LogPrint("http", "Waiting for HTTP event thread to exit\n");
@@ -535,7 +553,9 @@ void HTTPEvent::trigger(struct timeval* tv)
         evtimer_add(ev, tv); // trigger after timeval passed
 }
 HTTPRequest::HTTPRequest(struct evhttp_request* req) : req(req),
-                                                       replySent(false)
+                                                       replySent(false),
+                                                       replyChunked(false),
+                                                       chunkFlow(0)
 {
 }
 HTTPRequest::~HTTPRequest()
@@ -543,7 +563,10 @@ HTTPRequest::~HTTPRequest()
     if (!replySent) {
         // Keep track of whether reply was sent to avoid request leaks
         LogPrintf("%s: Unhandled request\n", __func__);
-        WriteReply(HTTP_INTERNAL, "Unhandled request");
+        if (replyChunked)
+            WriteReplyEnd();
+        else
+            WriteReply(HTTP_INTERNAL, "Unhandled request");
     }
     // evhttpd cleans up the request, as long as a reply was sent.
 }
@@ -593,7 +616,7 @@ void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
  */
 void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
 {
-    assert(!replySent && req);
+    assert(!replySent && !replyChunked && req);
     // Send event to main http thread to send reply message
     struct evbuffer* evb = evhttp_request_get_output_buffer(req);
     assert(evb);
@@ -605,6 +628,142 @@ void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
     req = 0; // transferred back to main thread
 }
 
+/**
+ * Flow control of a chunked reply. The worker writing the reply waits while
+ * too many chunks are queued, so a slow client does not make a large reply pile
+ * up in memory or hold many open block files. Owned by the main http thread
+ * from the first chunk on, which deletes it when the reply ends.
+ */
+struct HTTPChunkFlow
+{
+    CWaitableCriticalSection cs;
+    CConditionVariable cond;
+    //! Chunks the worker has queued
+    uint64_t nQueued;
+    //! Chunks handed to evhttp by the main thread
+    uint64_t nHanded;
+    //! Chunks known to be written to the connection
+    uint64_t nWritten;
+    //! Set when the client stopped reading, further chunks are dropped
+    bool fAbandoned;
+
+    HTTPChunkFlow() : nQueued(0), nHanded(0), nWritten(0), fAbandoned(false) {}
+};
+
+#if LIBEVENT_VERSION_NUMBER >= 0x02010100
+/** Called by evhttp when the connection's output buffer has drained */
+static void http_reply_chunks_written(struct evhttp_connection* evcon, void* arg)
+{
+    HTTPChunkFlow* flow = (HTTPChunkFlow*)arg;
+    boost::unique_lock<boost::mutex> lock(flow->cs);
+    flow->nWritten = flow->nHanded;
+    flow->cond.notify_all();
+}
+#endif
+
+/** Send one chunk of a reply from the main http thread, then free its buffer */
+static void http_send_reply_chunk(struct evhttp_request* req, struct evbuffer* evb, HTTPChunkFlow* flow)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(flow->cs);
+        flow->nHanded++;
+#if LIBEVENT_VERSION_NUMBER < 0x02010100
+        // No write notification before libevent 2.1.1, so chunks count as written once handed over
+        flow->nWritten = flow->nHanded;
+        flow->cond.notify_all();
+#endif
+    }
+#if LIBEVENT_VERSION_NUMBER >= 0x02010100
+    evhttp_send_reply_chunk_with_cb(req, evb, http_reply_chunks_written, flow);
+#else
+    evhttp_send_reply_chunk(req, evb);
+#endif
+    evbuffer_free(evb);
+}
+
+static void http_send_reply_end(struct evhttp_request* req, HTTPChunkFlow* flow)
+{
+    // Replaces the write callback, so flow is not referenced after this
+    evhttp_send_reply_end(req);
+    delete flow;
+}
+
+bool HTTPRequest::WriteReplyBuffer(struct evbuffer* evb)
+{
+    assert(!replySent && req);
+    if (!replyChunked) {
+        chunkFlow = new HTTPChunkFlow();
+        HTTPEvent* ev = new HTTPEvent(eventBase, true,
+            boost::bind(evhttp_send_reply_start, req, (int)HTTP_OK, (const char*)NULL));
+        ev->trigger(0);
+        replyChunked = true;
+    }
+    {
+        // Wait for the client to catch up, giving up when it makes no progress for -rpcservertimeout
+        boost::unique_lock<boost::mutex> lock(chunkFlow->cs);
+        int64_t nTimeout = GetArg("-rpcservertimeout", DEFAULT_HTTP_SERVER_TIMEOUT);
+        int64_t nLastProgress = GetTime();
+        uint64_t nWritten = chunkFlow->nWritten;
+        while (!chunkFlow->fAbandoned && chunkFlow->nQueued - chunkFlow->nWritten >= MAX_HTTP_CHUNKS_IN_FLIGHT) {
+            chunkFlow->cond.timed_wait(lock, boost::posix_time::seconds(1));
+            if (chunkFlow->nWritten != nWritten) {
+                nWritten = chunkFlow->nWritten;
+                nLastProgress = GetTime();
+            } else if (GetTime() - nLastProgress > nTimeout) {
+                LogPrint("http", "Client stopped reading chunked reply to %s\n", GetURI());
+                chunkFlow->fAbandoned = true;
+            }
+        }
+        if (chunkFlow->fAbandoned) {
+            evbuffer_free(evb);
+            return false;
+        }
+        chunkFlow->nQueued++;
+    }
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, boost::bind(http_send_reply_chunk, req, evb, chunkFlow));
+    ev->trigger(0);
+    return true;
+}
+
+/** Chunks are handed to the main http thread as events of the same priority,
+ * which libevent runs in the order they were activated.
+ */
+bool HTTPRequest::WriteReplyChunk(const std::string& strChunk)
+{
+    struct evbuffer* evb = evbuffer_new();
+    assert(evb);
+    evbuffer_add(evb, strChunk.data(), strChunk.size());
+    return WriteReplyBuffer(evb);
+}
+
+bool HTTPRequest::WriteReplyFileChunk(int fd, int64_t nOffset, int64_t nLength)
+{
+    struct evbuffer* evb = evbuffer_new();
+    assert(evb);
+    if (evbuffer_add_file(evb, fd, nOffset, nLength) != 0) {
+        // The buffer only takes ownership of fd on success
+        close(fd);
+        evbuffer_free(evb);
+        return false;
+    }
+    return WriteReplyBuffer(evb);
+}
+
+void HTTPRequest::WriteReplyEnd(const std::string& strLast)
+{
+    if (!replyChunked) {
+        WriteReply(HTTP_OK, strLast);
+        return;
+    }
+    if (!strLast.empty())
+        WriteReplyChunk(strLast);
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, boost::bind(http_send_reply_end, req, chunkFlow));
+    ev->trigger(0);
+    chunkFlow = 0;
+    replySent = true;
+    req = 0; // transferred back to main thread
+}
+
 CService HTTPRequest::GetPeer()
 {
     evhttp_connection* con = evhttp_request_get_connection(req);
@@ -651,6 +810,17 @@ void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPR
     pathHandlers.push_back(HTTPPathHandler(prefix, exactMatch, handler));
 }
 
+bool HTTPEnqueueTask(const boost::function<void(void)>& task)
+{
+    if (!workQueue)
+        return false;
+    std::unique_ptr<HTTPTaskItem> item(new HTTPTaskItem(task));
+    if (!workQueue->Enqueue(item.get()))
+        return false;
+    item.release(); /* queue took ownership */
+    return true;
+}
+
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch)
 {
     std::vector<HTTPPathHandler>::iterator i = pathHandlers.begin();
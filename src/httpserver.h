@@ -14,9 +14,13 @@
 static const int DEFAULT_HTTP_THREADS=4;
 static const int DEFAULT_HTTP_WORKQUEUE=16;
 static const int DEFAULT_HTTP_SERVER_TIMEOUT=30;
+/** Chunks of a chunked reply that may be queued before the worker waits for the client */
+static const unsigned int MAX_HTTP_CHUNKS_IN_FLIGHT=64;
 
+struct evbuffer;
 struct evhttp_request;
 struct event_base;
+struct HTTPChunkFlow;
 class CService;
 class HTTPRequest;
 
@@ -44,6 +48,12 @@ void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPR
 /** Unregister handler for prefix */
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch);
 
+/** Run a task on one of the HTTP worker threads.
+ * Returns false if the server is not running or the work queue is full; callers
+ * must then do the work themselves.
+ */
+bool HTTPEnqueueTask(const boost::function<void(void)>& task);
+
 /** Return evhttp event base. This can be used by submodules to
  * queue timers or custom events.
  */
@@ -57,6 +67,11 @@ class HTTPRequest
 private:
     struct evhttp_request* req;
     bool replySent;
+    bool replyChunked;
+    HTTPChunkFlow* chunkFlow;
+
+    /** Queue a chunk of the reply, taking ownership of evb */
+    bool WriteReplyBuffer(struct evbuffer* evb);
 
 public:
     HTTPRequest(struct evhttp_request* req);
@@ -112,6 +127,34 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Write part of a reply with status HTTP_OK, using chunked transfer encoding.
+     * The status line and headers go out with the first chunk, so write headers before.
+     * Blocks while the client is more than MAX_HTTP_CHUNKS_IN_FLIGHT chunks behind.
+     *
+     * @note Finish the reply with WriteReplyEnd. Chunks are sent in the order written.
+     * @returns false if the client stopped reading; the chunk is dropped, and so
+     * will be any further ones.
+     */
+    bool WriteReplyChunk(const std::string& strChunk);
+
+    /**
+     * Like WriteReplyChunk, sending nLength bytes of the file fd from nOffset on
+     * without copying them through memory. Takes ownership of fd.
+     */
+    bool WriteReplyFileChunk(int fd, int64_t nOffset, int64_t nLength);
+
+    /**
+     * Finish a reply started with WriteReplyChunk, sending strLast as the final
+     * chunk. If no chunk was written, send strLast as a whole HTTP_OK reply instead.
+     *
+     * @note Like WriteReply, do not call any other HTTPRequest methods after this.
+     */
+    void WriteReplyEnd(const std::string& strLast = "");
+
+    /** Whether WriteReplyChunk has been called */
+    bool IsChunked() const { return replyChunked; }
 };
 
 /** Event handler closure.
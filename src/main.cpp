@@ -14,8 +14,11 @@
 #include "consensus/consensus.h"
 #include "consensus/merkle.h"
 #include "consensus/validation.h"
+#include "crypto/common.h"
+#include "crypto/scrypt.h"
 #include "hash.h"
 #include "init.h"
+#include "mappedfile.h"
 #include "merkleblock.h"
 #include "net.h"
 #include "policy/fees.h"
@@ -23,6 +26,7 @@
 #include "pow.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
+#include "pubkey.h"
 #include "random.h"
 #include "script/script.h"
 #include "script/sigcache.h"
@@ -63,6 +67,12 @@ using namespace std;
 CCriticalSection cs_main;
 
 BlockMap mapBlockIndex;
+/** Held together with cs_main while entries are added to or removed from mapBlockIndex, so it can be searched without cs_main */
+static CCriticalSection cs_mapBlockIndex;
+/** Published snapshot of chainActive, only accessed through std::atomic_load/atomic_store */
+static std::shared_ptr<const CChainSnapshot> pchainSnapshot(new CChainSnapshot(NULL));
+/** Recently read block and undo files, mapped into memory */
+static CMappedFileCache mappedBlockFiles(MAX_MAPPED_BLOCK_FILES);
 CChain chainActive;
 CBlockIndex *pindexBestHeader = NULL;
 int64_t nTimeBestReceived = 0;
@@ -72,6 +82,9 @@ int nScriptCheckThreads = 0;
 bool fImporting = false;
 bool fReindex = false;
 bool fTxIndex = false;
+bool fAddressIndex = false;
+bool fSpentIndex = false;
+bool fTimestampIndex = false;
 bool fHavePruned = false;
 bool fPruneMode = false;
 bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
@@ -79,6 +92,7 @@ bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
 size_t nCoinCacheUsage = 5000 * 300;
+bool fPartialFlush = DEFAULT_PARTIAL_FLUSH;
 uint64_t nPruneTarget = 0;
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
 bool fEnableReplacement = DEFAULT_ENABLE_REPLACEMENT;
@@ -698,6 +712,8 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 }
 
 CCoinsViewCache *pcoinsTip = NULL;
+CCoinsViewAsyncWriter *pcoinsWriter = NULL;
+CCoinsViewDB *pcoinsdbview = NULL;
 CBlockTreeDB *pblocktree = NULL;
 
 //////////////////////////////////////////////////////////////////////////////
@@ -1656,6 +1672,56 @@ bool GetTransaction(const uint256 &hash, CTransaction &txOut, const Consensus::P
     return false;
 }
 
+unsigned int GetAddressIndexDestination(const CScript& script, uint160& hashBytes)
+{
+    CTxDestination dest;
+    if (!ExtractDestination(script, dest))
+        return ADDRESS_INDEX_NONE;
+    if (const CKeyID* keyID = boost::get<CKeyID>(&dest)) {
+        hashBytes = *keyID;
+        return ADDRESS_INDEX_PUBKEYHASH;
+    }
+    if (const CScriptID* scriptID = boost::get<CScriptID>(&dest)) {
+        hashBytes = *scriptID;
+        return ADDRESS_INDEX_SCRIPTHASH;
+    }
+    return ADDRESS_INDEX_NONE;
+}
+
+bool GetAddressIndex(unsigned int type, const uint160& addressHash, std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex, int start, int end)
+{
+    if (!fAddressIndex)
+        return error("%s: address index not enabled", __func__);
+    if (!pblocktree->ReadAddressIndex(type, addressHash, addressIndex, start, end))
+        return error("%s: unable to get txids for address", __func__);
+    return true;
+}
+
+bool GetAddressUnspent(unsigned int type, const uint160& addressHash, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& unspentOutputs)
+{
+    if (!fAddressIndex)
+        return error("%s: address index not enabled", __func__);
+    if (!pblocktree->ReadAddressUnspentIndex(type, addressHash, unspentOutputs))
+        return error("%s: unable to get unspent outputs for address", __func__);
+    return true;
+}
+
+bool GetSpentIndex(const CSpentIndexKey& key, CSpentIndexValue& value)
+{
+    if (!fSpentIndex)
+        return false;
+    return pblocktree->ReadSpentIndex(key, value);
+}
+
+bool GetTimestampIndex(unsigned int high, unsigned int low, std::vector<uint256>& hashes)
+{
+    if (!fTimestampIndex)
+        return error("%s: timestamp index not enabled", __func__);
+    if (!pblocktree->ReadTimestampIndex(high, low, hashes))
+        return error("%s: unable to get hashes for timestamps", __func__);
+    return true;
+}
+
 
 
 
@@ -1687,21 +1753,64 @@ bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHea
     return true;
 }
 
+/**
+ * Find the block or undo data stored at pos in a mapped block or undo file.
+ * Its size comes from the index header in front of it, and nTrailer bytes
+ * after it are included as well. Returns false if the file can't be mapped or
+ * the header does not check out; callers then read the file through stdio.
+ */
+static bool MapDiskRecord(const CDiskBlockPos& pos, const char* prefix, size_t nTrailer,
+                          std::shared_ptr<const CMappedFile>& file, const char*& pdata, size_t& nSize)
+{
+    const size_t nHeaderSize = MESSAGE_START_SIZE + sizeof(uint32_t);
+    if (pos.IsNull() || pos.nPos < nHeaderSize)
+        return false;
+    boost::filesystem::path path = GetBlockPosFilename(pos, prefix);
+    file = mappedBlockFiles.Get(path, pos.nPos);
+    if (!file)
+        return false;
+
+    const char* pheader = file->data() + pos.nPos - nHeaderSize;
+    if (memcmp(pheader, Params().MessageStart(), MESSAGE_START_SIZE) != 0)
+        return false;
+    nSize = ReadLE32((const unsigned char*)pheader + MESSAGE_START_SIZE) + nTrailer;
+    if (pos.nPos + nSize > file->size()) {
+        file = mappedBlockFiles.Get(path, pos.nPos + nSize);
+        if (!file)
+            return false;
+    }
+    pdata = file->data() + pos.nPos;
+    return true;
+}
+
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams)
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+    std::shared_ptr<const CMappedFile> mapped;
+    const char* pdata;
+    size_t nSize;
+    if (MapDiskRecord(pos, "blk", 0, mapped, pdata, nSize)) {
+        CMemoryReader reader(pdata, nSize, SER_DISK, CLIENT_VERSION);
+        try {
+            reader >> block;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize error - %s at %s", __func__, e.what(), pos.ToString());
+        }
+    } else {
+        // Open history file to read
+        CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
 
-    // Read block
-    try {
-        filein >> block;
-    }
-    catch (const std::exception& e) {
-        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        // Read block
+        try {
+            filein >> block;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        }
     }
 
     // Check the header
@@ -1722,6 +1831,78 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
     return true;
 }
 
+/** Open the block file at the index header preceding the block at pos and read the block size from it */
+static FILE* OpenBlockIndexHeader(const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart, unsigned int& nSize)
+{
+    // WriteBlockToDisk stores the message start and the size in front of each block
+    if (pos.nPos < MESSAGE_START_SIZE + sizeof(nSize)) {
+        error("%s: no index header before %s", __func__, pos.ToString());
+        return NULL;
+    }
+    CAutoFile filein(OpenBlockFile(CDiskBlockPos(pos.nFile, pos.nPos - MESSAGE_START_SIZE - sizeof(nSize)), true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull()) {
+        error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
+        return NULL;
+    }
+    try {
+        CMessageHeader::MessageStartChars fileStart;
+        filein >> FLATDATA(fileStart) >> nSize;
+        if (memcmp(fileStart, messageStart, MESSAGE_START_SIZE) != 0) {
+            error("%s: bad index header before %s", __func__, pos.ToString());
+            return NULL;
+        }
+    }
+    catch (const std::exception& e) {
+        error("%s: I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        return NULL;
+    }
+    if (nSize > MAX_BLOCK_SERIALIZED_SIZE) {
+        error("%s: bad block size %u at %s", __func__, nSize, pos.ToString());
+        return NULL;
+    }
+    return filein.release();
+}
+
+bool ReadBlockSizeFromDisk(unsigned int& nSize, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
+{
+    std::shared_ptr<const CMappedFile> mapped;
+    const char* pdata;
+    size_t nMappedSize;
+    if (MapDiskRecord(pos, "blk", 0, mapped, pdata, nMappedSize) && nMappedSize <= MAX_BLOCK_SERIALIZED_SIZE) {
+        nSize = nMappedSize;
+        return true;
+    }
+
+    CAutoFile filein(OpenBlockIndexHeader(pos, messageStart, nSize), SER_DISK, CLIENT_VERSION);
+    return !filein.IsNull();
+}
+
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& vchBlock, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
+{
+    std::shared_ptr<const CMappedFile> mapped;
+    const char* pdata;
+    size_t nMappedSize;
+    if (MapDiskRecord(pos, "blk", 0, mapped, pdata, nMappedSize) && nMappedSize <= MAX_BLOCK_SERIALIZED_SIZE) {
+        vchBlock.assign(pdata, pdata + nMappedSize);
+        return true;
+    }
+
+    unsigned int nSize;
+    CAutoFile filein(OpenBlockIndexHeader(pos, messageStart, nSize), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return false;
+
+    vchBlock.resize(nSize);
+    try {
+        filein.read((char*)vchBlock.data(), nSize);
+    }
+    catch (const std::exception& e) {
+        vchBlock.clear();
+        return error("%s: I/O error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+    return true;
+}
+
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams)
 {
     int halvings = nHeight / consensusParams.nSubsidyHalvingInterval;
@@ -1954,6 +2135,41 @@ bool CScriptCheck::operator()() {
     return true;
 }
 
+bool CHeaderPoWCheck::operator()() {
+    GetBlockPoWHashes(pheaders, nCount, phashPoW);
+    for (size_t i = 0; i < nCount; i++) {
+        if (!CheckProofOfWork(phashPoW[i], pheaders[i].nBits, *params, pheaders[i]))
+            return false;
+    }
+    return true;
+}
+
+bool CBlockPrefetchCheck::operator()() {
+    for (size_t i = 0; i < nCount; i++) {
+        if (view) {
+            if (!view->GetCoinsFromBase(ptxid[i], pcoins[i]))
+                pcoins[i].Clear();
+        } else {
+            ptxdata[i] = PrecomputedTransactionData(ptx[i]);
+        }
+    }
+    return true;
+}
+
+bool CBlockTxCheck::operator()() {
+    if (pnodes) {
+        ComputeMerkleLevel(pnodes, nCount, pparents, pmutated);
+        return true;
+    }
+    *pnSigOps = 0;
+    for (size_t i = 0; i < nCount; i++) {
+        if (!CheckTransaction(ptx[i], *pstate))
+            return false;
+        *pnSigOps += GetLegacySigOpCount(ptx[i]);
+    }
+    return true;
+}
+
 int GetSpendHeight(const CCoinsViewCache& inputs)
 {
     LOCK(cs_main);
@@ -2098,19 +2314,34 @@ bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint
 
 bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock)
 {
-    // Open history file to read
-    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("%s: OpenUndoFile failed", __func__);
-
-    // Read block
     uint256 hashChecksum;
-    try {
-        filein >> blockundo;
-        filein >> hashChecksum;
-    }
-    catch (const std::exception& e) {
-        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+    std::shared_ptr<const CMappedFile> mapped;
+    const char* pdata;
+    size_t nSize;
+    // The checksum follows the undo data
+    if (MapDiskRecord(pos, "rev", sizeof(hashChecksum), mapped, pdata, nSize)) {
+        CMemoryReader reader(pdata, nSize, SER_DISK, CLIENT_VERSION);
+        try {
+            reader >> blockundo;
+            reader >> hashChecksum;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize error - %s", __func__, e.what());
+        }
+    } else {
+        // Open history file to read
+        CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("%s: OpenUndoFile failed", __func__);
+
+        // Read block
+        try {
+            filein >> blockundo;
+            filein >> hashChecksum;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+        }
     }
 
     // Verify checksum
@@ -2184,6 +2415,8 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
         *pfClean = false;
 
     bool fClean = true;
+    // The optional indexes are only updated when disconnecting from pcoinsTip, not while verifying the database
+    bool fUpdateIndexes = pfClean == NULL;
 
     CBlockUndo blockUndo;
     CDiskBlockPos pos = pindex->GetUndoPos();
@@ -2195,6 +2428,10 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
     if (blockUndo.vtxundo.size() + 1 != block.vtx.size())
         return error("DisconnectBlock(): block and undo data inconsistent");
 
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+
     // undo transactions in reverse order
     for (int i = block.vtx.size() - 1; i >= 0; i--) {
         const CTransaction &tx = block.vtx[i];
@@ -2219,6 +2456,17 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
         outs->Clear();
         }
 
+        if (fAddressIndex && fUpdateIndexes) {
+            for (unsigned int k = 0; k < tx.vout.size(); k++) {
+                uint160 hashBytes;
+                unsigned int addressType = GetAddressIndexDestination(tx.vout[k].scriptPubKey, hashBytes);
+                if (addressType == ADDRESS_INDEX_NONE)
+                    continue;
+                addressIndex.push_back(std::make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, hash, k, false), tx.vout[k].nValue));
+                addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, hash, k), CAddressUnspentValue()));
+            }
+        }
+
         // restore inputs
         if (i > 0) { // not coinbases
             const CTxUndo &txundo = blockUndo.vtxundo[i-1];
@@ -2229,6 +2477,19 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
                 const CTxInUndo &undo = txundo.vprevout[j];
                 if (!ApplyTxInUndo(undo, view, out))
                     fClean = false;
+
+                if (fUpdateIndexes && (fAddressIndex || fSpentIndex)) {
+                    uint160 hashBytes;
+                    unsigned int addressType = GetAddressIndexDestination(undo.txout.scriptPubKey, hashBytes);
+                    if (fAddressIndex && addressType != ADDRESS_INDEX_NONE) {
+                        const CCoins* coins = view.AccessCoins(out.hash);
+                        addressIndex.push_back(std::make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, hash, j, true), -undo.txout.nValue));
+                        addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, out.hash, out.n),
+                                                                     CAddressUnspentValue(undo.txout.nValue, undo.txout.scriptPubKey, coins ? coins->nHeight : 0)));
+                    }
+                    if (fSpentIndex)
+                        spentIndex.push_back(std::make_pair(CSpentIndexKey(out.hash, out.n), CSpentIndexValue()));
+                }
             }
         }
     }
@@ -2236,6 +2497,19 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
     // move best block pointer to prevout block
     view.SetBestBlock(pindex->pprev->GetBlockHash());
 
+    if (fUpdateIndexes) {
+        if (fAddressIndex) {
+            if (!pblocktree->EraseAddressIndex(addressIndex))
+                return AbortNode(state, "Failed to delete address index");
+            if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex))
+                return AbortNode(state, "Failed to write address unspent index");
+        }
+        if (fSpentIndex && !pblocktree->UpdateSpentIndex(spentIndex))
+            return AbortNode(state, "Failed to write spent index");
+        if (fTimestampIndex && !pblocktree->EraseTimestampIndex(CTimestampIndexKey(pindex->nTime, pindex->GetBlockHash())))
+            return AbortNode(state, "Failed to delete timestamp index");
+    }
+
     if (pfClean) {
         *pfClean = fClean;
         return true;
@@ -2276,6 +2550,53 @@ void ThreadScriptCheck() {
     scriptcheckqueue.Thread();
 }
 
+static CCheckQueue<CHeaderPoWCheck> headerpowcheckqueue(4);
+
+void ThreadHeaderPoWCheck() {
+    RenameThread("flashcoin-hdrpow");
+    headerpowcheckqueue.Thread();
+}
+
+static CCheckQueue<CBlockPrefetchCheck> blockprefetchqueue(16);
+
+void ThreadBlockPrefetch() {
+    RenameThread("flashcoin-prefetch");
+    blockprefetchqueue.Thread();
+}
+
+static CCheckQueue<CBlockTxCheck> blocktxcheckqueue(16);
+/** Taken by the thread using blocktxcheckqueue, CheckBlock falls back to checking serially if it's busy */
+static CCriticalSection cs_blocktxcheckqueue;
+
+void ThreadBlockTxCheck() {
+    RenameThread("flashcoin-blockch");
+    blocktxcheckqueue.Thread();
+}
+
+/**
+ * Compute the scrypt hashes of a run of headers into phashPoW and check them
+ * against their targets, spread over the header check threads. Meant to be
+ * called without cs_main, from the message handler thread only.
+ */
+static bool CheckHeadersPoW(const CBlockHeader* pheaders, size_t nCount, uint256* phashPoW, const Consensus::Params& consensusParams)
+{
+    if (nCount == 0)
+        return true;
+    if (!nScriptCheckThreads)
+        return CHeaderPoWCheck(pheaders, phashPoW, nCount, consensusParams)();
+
+    // Cut the run into chunks of whole multi-buffer groups, a few per thread so they finish together.
+    size_t nWays = scrypt_1024_1_1_256_multi_ways();
+    size_t nChunk = nWays * std::max((size_t)1, nCount / (nWays * nScriptCheckThreads * 4));
+    std::vector<CHeaderPoWCheck> vChecks;
+    for (size_t n = 0; n < nCount; n += nChunk)
+        vChecks.push_back(CHeaderPoWCheck(pheaders + n, phashPoW + n, std::min(nChunk, nCount - n), consensusParams));
+
+    CCheckQueueControl<CHeaderPoWCheck> control(&headerpowcheckqueue);
+    control.Add(vChecks);
+    return control.Wait();
+}
+
 // Protected by cs_main
 VersionBitsCache versionbitscache;
 
@@ -2322,6 +2643,7 @@ public:
 static ThresholdConditionCache warningcache[VERSIONBITS_NUM_BITS];
 
 static int64_t nTimeCheck = 0;
+static int64_t nTimePrefetch = 0;
 static int64_t nTimeForks = 0;
 static int64_t nTimeVerify = 0;
 static int64_t nTimeConnect = 0;
@@ -2329,6 +2651,55 @@ static int64_t nTimeIndex = 0;
 static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
 
+/**
+ * Load the coins that connecting block will look up into pcoinsTip, and compute
+ * the signature hash precomputation data of its transactions into txdata, spread
+ * over the prefetch threads. Does nothing and returns false if there are no
+ * threads to spread over, or view isn't on top of the current pcoinsTip state.
+ */
+static bool PrefetchBlock(const CBlock& block, const CCoinsViewCache& view, std::vector<PrecomputedTransactionData>& txdata)
+{
+    AssertLockHeld(cs_main);
+    if (!nScriptCheckThreads || view.GetBestBlock() != pcoinsTip->GetBestBlock())
+        return false;
+
+    // The txids of the block itself are looked up for BIP30.
+    std::vector<uint256> vTxid;
+    BOOST_FOREACH(const CTransaction& tx, block.vtx) {
+        vTxid.push_back(tx.GetHash());
+        if (tx.IsCoinBase())
+            continue;
+        BOOST_FOREACH(const CTxIn& txin, tx.vin)
+            vTxid.push_back(txin.prevout.hash);
+    }
+    std::sort(vTxid.begin(), vTxid.end());
+    vTxid.erase(std::unique(vTxid.begin(), vTxid.end()), vTxid.end());
+    size_t nMissing = 0;
+    for (size_t i = 0; i < vTxid.size(); i++) {
+        if (!view.HaveCoinsInCache(vTxid[i]) && !pcoinsTip->HaveCoinsInCache(vTxid[i]))
+            vTxid[nMissing++] = vTxid[i];
+    }
+    vTxid.resize(nMissing);
+    std::vector<CCoins> vCoins(vTxid.size());
+
+    // A few chunks of each kind per thread, so they finish together.
+    std::vector<CBlockPrefetchCheck> vChecks;
+    size_t nChunk = std::max((size_t)1, vTxid.size() / (nScriptCheckThreads * 4));
+    for (size_t n = 0; n < vTxid.size(); n += nChunk)
+        vChecks.push_back(CBlockPrefetchCheck(*pcoinsTip, &vTxid[n], &vCoins[n], std::min(nChunk, vTxid.size() - n)));
+    nChunk = std::max((size_t)1, block.vtx.size() / (nScriptCheckThreads * 4));
+    for (size_t n = 0; n < block.vtx.size(); n += nChunk)
+        vChecks.push_back(CBlockPrefetchCheck(&block.vtx[n], &txdata[n], std::min(nChunk, block.vtx.size() - n)));
+
+    CCheckQueueControl<CBlockPrefetchCheck> control(&blockprefetchqueue);
+    control.Add(vChecks);
+    control.Wait();
+
+    for (size_t i = 0; i < vTxid.size(); i++)
+        pcoinsTip->CacheCoins(vTxid[i], vCoins[i]);
+    return true;
+}
+
 bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex,
                   CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck)
 {
@@ -2364,6 +2735,14 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     int64_t nTime1 = GetTimeMicros(); nTimeCheck += nTime1 - nTimeStart;
     LogPrint("bench", "    - Sanity checks: %.2fms [%.2fs]\n", 0.001 * (nTime1 - nTimeStart), nTimeCheck * 0.000001);
 
+    // Read the block's coins and precompute its sighash data on all cores,
+    // instead of one by one as the transactions are connected below.
+    std::vector<PrecomputedTransactionData> txdata(block.vtx.size());
+    bool fPrefetched = PrefetchBlock(block, view, txdata);
+
+    int64_t nTime1b = GetTimeMicros(); nTimePrefetch += nTime1b - nTime1;
+    LogPrint("bench", "    - Prefetch: %.2fms [%.2fs]\n", 0.001 * (nTime1b - nTime1), nTimePrefetch * 0.000001);
+
     // Do not allow blocks that contain transactions which 'overwrite' older transactions,
     // unless those are already completely spent.
     // If such overwrites are allowed, coinbases and transactions depending upon those
@@ -2431,8 +2810,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         flags |= SCRIPT_VERIFY_NULLDUMMY;
     }
 
-    int64_t nTime2 = GetTimeMicros(); nTimeForks += nTime2 - nTime1;
-    LogPrint("bench", "    - Fork checks: %.2fms [%.2fs]\n", 0.001 * (nTime2 - nTime1), nTimeForks * 0.000001);
+    int64_t nTime2 = GetTimeMicros(); nTimeForks += nTime2 - nTime1b;
+    LogPrint("bench", "    - Fork checks: %.2fms [%.2fs]\n", 0.001 * (nTime2 - nTime1b), nTimeForks * 0.000001);
 
     CBlockUndo blockundo;
 
@@ -2447,8 +2826,9 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     std::vector<std::pair<uint256, CDiskTxPos> > vPos;
     vPos.reserve(block.vtx.size());
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
-    std::vector<PrecomputedTransactionData> txdata;
-    txdata.reserve(block.vtx.size()); // Required so that pointers to individual PrecomputedTransactionData don't get invalidated
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
     for (unsigned int i = 0; i < block.vtx.size(); i++)
     {
         const CTransaction &tx = block.vtx[i];
@@ -2495,7 +2875,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             return state.DoS(100, error("ConnectBlock(): too many sigops"),
                              REJECT_INVALID, "bad-blk-sigops");
 
-        txdata.emplace_back(tx);
+        if (!fPrefetched)
+            txdata[i] = PrecomputedTransactionData(tx);
         if (!tx.IsCoinBase())
         {
             nFees += view.GetValueIn(tx)-tx.GetValueOut();
@@ -2506,6 +2887,32 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                 return error("ConnectBlock(): CheckInputs on %s failed with %s",
                     tx.GetHash().ToString(), FormatStateMessage(state));
             control.Add(vChecks);
+
+            if (!fJustCheck && (fAddressIndex || fSpentIndex)) {
+                for (unsigned int j = 0; j < tx.vin.size(); j++) {
+                    const COutPoint& prevout = tx.vin[j].prevout;
+                    const CTxOut& txout = view.GetOutputFor(tx.vin[j]);
+                    uint160 hashBytes;
+                    unsigned int addressType = GetAddressIndexDestination(txout.scriptPubKey, hashBytes);
+                    if (fAddressIndex && addressType != ADDRESS_INDEX_NONE) {
+                        addressIndex.push_back(std::make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, tx.GetHash(), j, true), -txout.nValue));
+                        addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, prevout.hash, prevout.n), CAddressUnspentValue()));
+                    }
+                    if (fSpentIndex)
+                        spentIndex.push_back(std::make_pair(CSpentIndexKey(prevout.hash, prevout.n), CSpentIndexValue(tx.GetHash(), j, pindex->nHeight, txout.nValue, addressType, hashBytes)));
+                }
+            }
+        }
+
+        if (!fJustCheck && fAddressIndex) {
+            for (unsigned int k = 0; k < tx.vout.size(); k++) {
+                uint160 hashBytes;
+                unsigned int addressType = GetAddressIndexDestination(tx.vout[k].scriptPubKey, hashBytes);
+                if (addressType == ADDRESS_INDEX_NONE)
+                    continue;
+                addressIndex.push_back(std::make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, tx.GetHash(), k, false), tx.vout[k].nValue));
+                addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, tx.GetHash(), k), CAddressUnspentValue(tx.vout[k].nValue, tx.vout[k].scriptPubKey, pindex->nHeight)));
+            }
         }
 
         CTxUndo undoDummy;
@@ -2560,6 +2967,21 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         if (!pblocktree->WriteTxIndex(vPos))
             return AbortNode(state, "Failed to write transaction index");
 
+    if (fAddressIndex) {
+        if (!pblocktree->WriteAddressIndex(addressIndex))
+            return AbortNode(state, "Failed to write address index");
+        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex))
+            return AbortNode(state, "Failed to write address unspent index");
+    }
+
+    if (fSpentIndex)
+        if (!pblocktree->UpdateSpentIndex(spentIndex))
+            return AbortNode(state, "Failed to write spent index");
+
+    if (fTimestampIndex)
+        if (!pblocktree->WriteTimestampIndex(CTimestampIndexKey(pindex->nTime, pindex->GetBlockHash())))
+            return AbortNode(state, "Failed to write timestamp index");
+
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
 
@@ -2590,9 +3012,22 @@ enum FlushStateMode {
     FLUSH_STATE_NONE,
     FLUSH_STATE_IF_NEEDED,
     FLUSH_STATE_PERIODIC,
-    FLUSH_STATE_ALWAYS
+    FLUSH_STATE_ALWAYS,
+    //! Like FLUSH_STATE_ALWAYS, but a partial flush that keeps the coins cache loaded
+    FLUSH_STATE_SYNC
 };
 
+/** Number of times pcoinsTip was flushed to the database, protected by cs_main */
+static uint64_t nCoinsTipFlushes = 0;
+/** Flush statistics for getcoinscacheinfo, protected by cs_main */
+static CCoinsFlushStats coinsFlushStats;
+
+CCoinsFlushStats GetCoinsFlushStats()
+{
+    LOCK(cs_main);
+    return coinsFlushStats;
+}
+
 /**
  * Update the on-disk chain state.
  * The caches and indexes are flushed depending on the mode we're called with
@@ -2630,7 +3065,8 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
     if (nLastSetChain == 0) {
         nLastSetChain = nNow;
     }
-    size_t cacheSize = pcoinsTip->DynamicMemoryUsage();
+    // Memory the pool allocator holds on to for later entries does not count.
+    size_t cacheSize = pcoinsTip->ActiveMemoryUsage();
     // The cache is large and close to the limit, but we have time now (not in the middle of a block processing).
     bool fCacheLarge = mode == FLUSH_STATE_PERIODIC && cacheSize * (10.0/9) > nCoinCacheUsage;
     // The cache is over the limit, we have to write now.
@@ -2640,7 +3076,7 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
     // It's been very long since we flushed the cache. Do this infrequently, to optimize cache usage.
     bool fPeriodicFlush = mode == FLUSH_STATE_PERIODIC && nNow > nLastFlush + (int64_t)DATABASE_FLUSH_INTERVAL * 1000000;
     // Combine all conditions that result in a full cache flush.
-    bool fDoFullFlush = (mode == FLUSH_STATE_ALWAYS) || fCacheLarge || fCacheCritical || fPeriodicFlush || fFlushForPrune;
+    bool fDoFullFlush = (mode == FLUSH_STATE_ALWAYS) || (mode == FLUSH_STATE_SYNC) || fCacheLarge || fCacheCritical || fPeriodicFlush || fFlushForPrune;
     // Write blocks and block index to disk.
     if (fDoFullFlush || fPeriodicWrite) {
         // Depend on nMinDiskSpace to ensure we can write block index
@@ -2666,9 +3102,12 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
                 return AbortNode(state, "Files to write to block index database");
             }
         }
-        // Finally remove any pruned files
-        if (fFlushForPrune)
+        // Finally remove any pruned files, once earlier coin flushes are committed
+        if (fFlushForPrune) {
+            if (!pcoinsWriter->Wait())
+                return AbortNode(state, "Failed to write to coin database");
             UnlinkPrunedFiles(setFilesToPrune);
+        }
         nLastWrite = nNow;
     }
     // Flush best chain related state. This can only be done if the blocks / block index write was also done.
@@ -2681,7 +3120,39 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
         if (!CheckDiskSpace(128 * 2 * 2 * pcoinsTip->GetCacheSize()))
             return state.Error("out of disk space");
         // Flush the chainstate (which may refer to block index entries).
-        if (!pcoinsTip->Flush())
+        // In partial mode only the dirty entries are written and the cache
+        // stays warm; if it is over the limit, the coldest clean entries are
+        // evicted. Shutdown always empties it.
+        bool fPartial = fPartialFlush && mode != FLUSH_STATE_ALWAYS;
+        size_t nDirty = pcoinsTip->GetDirtyCount();
+        size_t nEvicted = 0;
+        int64_t nFlushStart = GetTimeMicros();
+        nCoinsTipFlushes++;
+        if (fPartial) {
+            if (!pcoinsTip->Sync())
+                return AbortNode(state, "Failed to write to coin database");
+            if (fCacheLarge || fCacheCritical)
+                nEvicted = pcoinsTip->Trim(nCoinCacheUsage / 100 * COINS_CACHE_TRIM_PERCENT);
+        } else {
+            nEvicted = pcoinsTip->GetCacheSize();
+            if (!pcoinsTip->Flush())
+                return AbortNode(state, "Failed to write to coin database");
+        }
+        int64_t nFlushMicros = GetTimeMicros() - nFlushStart;
+        coinsFlushStats.nFlushes++;
+        if (fPartial)
+            coinsFlushStats.nPartialFlushes++;
+        coinsFlushStats.nLastFlushTime = GetTime();
+        coinsFlushStats.nLastFlushMicros = nFlushMicros;
+        coinsFlushStats.fLastFlushPartial = fPartial;
+        coinsFlushStats.nLastDirty = nDirty;
+        coinsFlushStats.nLastEvicted = nEvicted;
+        LogPrint("coindb", "%s: %s flush wrote %u dirty coins, evicted %u, %u left in cache (%.2fms)\n", __func__,
+            fPartial ? "partial" : "full", nDirty, nEvicted, pcoinsTip->GetCacheSize(), nFlushMicros * 0.001);
+        // The dirty coins may still be being committed in the background. Wait
+        // for that when the caller expects everything on disk, and when block
+        // files were pruned, so the chainstate does not lag behind for long.
+        if ((mode == FLUSH_STATE_ALWAYS || mode == FLUSH_STATE_SYNC || fFlushForPrune) && !pcoinsWriter->Wait())
             return AbortNode(state, "Failed to write to coin database");
         nLastFlush = nNow;
     }
@@ -2701,15 +3172,76 @@ void FlushStateToDisk() {
     FlushStateToDisk(state, FLUSH_STATE_ALWAYS);
 }
 
+void SyncStateToDisk() {
+    CValidationState state;
+    FlushStateToDisk(state, FLUSH_STATE_SYNC);
+}
+
 void PruneAndFlush() {
     CValidationState state;
     fCheckForPruning = true;
     FlushStateToDisk(state, FLUSH_STATE_NONE);
 }
 
+/** Publish a new snapshot of chainActive for readers without cs_main. */
+static void PublishChainSnapshot()
+{
+    std::shared_ptr<const CChainSnapshot> chain(new CChainSnapshot(chainActive.Tip()));
+    std::atomic_store(&pchainSnapshot, chain);
+}
+
+std::shared_ptr<const CChainSnapshot> GetChainSnapshot()
+{
+    return std::atomic_load(&pchainSnapshot);
+}
+
+const CBlockIndex* LookupBlockIndexInSnapshot(const CChainSnapshot& chain, const uint256& hash)
+{
+    const CBlockIndex* pindex;
+    {
+        LOCK(cs_mapBlockIndex);
+        BlockMap::const_iterator it = mapBlockIndex.find(hash);
+        if (it == mapBlockIndex.end())
+            return NULL;
+        pindex = it->second;
+    }
+    return chain.Contains(pindex) ? pindex : NULL;
+}
+
+const CBlockIndex* ReadBlockByHash(const uint256& hash, std::shared_ptr<const CChainSnapshot>& chain, CBlock& block)
+{
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+    block.SetNull();
+    chain = GetChainSnapshot();
+    const CBlockIndex* pindex = LookupBlockIndexInSnapshot(*chain, hash);
+    CDiskBlockPos pos;
+    if (pindex != NULL && !fHavePruned) {
+        // Connected blocks stay where they were written as long as nothing gets pruned
+        pos = CDiskBlockPos(pindex->nFile, pindex->nDataPos);
+    } else {
+        LOCK(cs_main);
+        BlockMap::const_iterator it = mapBlockIndex.find(hash);
+        if (it == mapBlockIndex.end())
+            return NULL;
+        pindex = it->second;
+        chain = GetChainSnapshot();
+        if (fHavePruned) {
+            // Keep the file from being pruned while reading
+            if (!(pindex->nStatus & BLOCK_HAVE_DATA) || !ReadBlockFromDisk(block, pindex, consensusParams))
+                block.SetNull();
+            return pindex;
+        }
+        pos = pindex->GetBlockPos();
+    }
+    if (pos.IsNull() || !ReadBlockFromDisk(block, pos, consensusParams) || block.GetHash() != pindex->GetBlockHash())
+        block.SetNull();
+    return pindex;
+}
+
 /** Update chainActive and related internal data structures. */
 void static UpdateTip(CBlockIndex *pindexNew, const CChainParams& chainParams) {
     chainActive.SetTip(pindexNew);
+    PublishChainSnapshot();
 
     // New best block
     nTimeBestReceived = GetTime();
@@ -2959,6 +3491,53 @@ static void PruneBlockIndexCandidates() {
     assert(!setBlockIndexCandidates.empty());
 }
 
+/**
+ * Verify the miner signatures of a run of blocks as one batch, so CheckBlock finds
+ * them in the verifier's cache. If the batch fails nothing is cached, and CheckBlock
+ * verifies each block on its own, pinpointing the bad one.
+ */
+static void BatchVerifyBlockSignatures(const std::vector<CBlock>& vBlocks)
+{
+    std::vector<const CBlock*> vSigned;
+    BOOST_FOREACH(const CBlock& block, vBlocks) {
+        if (block.GetBlockTime() > BLS_SIGNING_START_TIME && !GetBlsBlockVerifier().IsVerified(block.GetHash()))
+            vSigned.push_back(&block);
+    }
+    if (vSigned.size() < 2)
+        return;
+
+    int64_t nTimeStart = GetTimeMicros();
+    bool fValid = GetBlsBlockVerifier().VerifyBlocks(vSigned);
+    LogPrint("bench", "    - Verify %u block signatures: %.2fms (%s)\n", vSigned.size(), (GetTimeMicros() - nTimeStart) * 0.001,
+             fValid ? "valid" : "invalid, falling back to single checks");
+}
+
+/**
+ * Batch verify the miner signatures of the blocks about to be connected, ordered from
+ * the highest to the lowest as in ActivateBestChainStep. A new batch is only started
+ * once the next block to connect isn't covered by the previous one. The blocks read
+ * are left in vBlocks from the lowest up, for the caller to connect without reading
+ * them again.
+ */
+static void BatchVerifyBlockSignatures(const std::vector<CBlockIndex*>& vpindex, const Consensus::Params& consensusParams, std::vector<CBlock>& vBlocks)
+{
+    if (vpindex.empty() || vpindex.back()->GetBlockTime() <= BLS_SIGNING_START_TIME ||
+        GetBlsBlockVerifier().IsVerified(vpindex.back()->GetBlockHash()))
+        return;
+
+    vBlocks.reserve(vpindex.size());
+    BOOST_REVERSE_FOREACH(const CBlockIndex* pindex, vpindex) {
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA))
+            break;
+        vBlocks.push_back(CBlock());
+        if (!ReadBlockFromDisk(vBlocks.back(), pindex, consensusParams)) {
+            vBlocks.pop_back();
+            break;
+        }
+    }
+    BatchVerifyBlockSignatures(vBlocks);
+}
+
 /**
  * Try to make some progress towards making pindexMostWork the active block.
  * pblock is either NULL or a pointer to a CBlock corresponding to pindexMostWork.
@@ -2994,9 +3573,18 @@ static bool ActivateBestChainStep(CValidationState& state, const CChainParams& c
         }
         nHeight = nTargetHeight;
 
+        std::vector<CBlock> vBlocks;
+        if (IsInitialBlockDownload())
+            BatchVerifyBlockSignatures(vpindexToConnect, chainparams.GetConsensus(), vBlocks);
+
         // Connect new blocks.
+        size_t nConnect = 0;
         BOOST_REVERSE_FOREACH(CBlockIndex *pindexConnect, vpindexToConnect) {
-            if (!ConnectTip(state, chainparams, pindexConnect, pindexConnect == pindexMostWork ? pblock : NULL)) {
+            const CBlock *pblockConnect = pindexConnect == pindexMostWork ? pblock : NULL;
+            if (!pblockConnect && nConnect < vBlocks.size())
+                pblockConnect = &vBlocks[nConnect];
+            nConnect++;
+            if (!ConnectTip(state, chainparams, pindexConnect, pblockConnect)) {
                 if (state.IsInvalid()) {
                     // The block violates a consensus rule.
                     if (!state.CorruptionPossible())
@@ -3233,16 +3821,20 @@ CBlockIndex* AddToBlockIndex(const CBlockHeader& block)
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
     pindexNew->nSequenceId = 0;
-    BlockMap::iterator mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
-    pindexNew->phashBlock = &((*mi).first);
-    BlockMap::iterator miPrev = mapBlockIndex.find(block.hashPrevBlock);
-    if (miPrev != mapBlockIndex.end())
     {
-        pindexNew->pprev = (*miPrev).second;
-        pindexNew->nHeight = pindexNew->pprev->nHeight + 1;
-        pindexNew->BuildSkip();
+        // Readers without cs_main may find the entry as soon as it's inserted, finish the immutable fields first.
+        LOCK(cs_mapBlockIndex);
+        BlockMap::iterator mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
+        pindexNew->phashBlock = &((*mi).first);
+        BlockMap::iterator miPrev = mapBlockIndex.find(block.hashPrevBlock);
+        if (miPrev != mapBlockIndex.end())
+        {
+            pindexNew->pprev = (*miPrev).second;
+            pindexNew->nHeight = pindexNew->pprev->nHeight + 1;
+            pindexNew->BuildSkip();
+        }
+        pindexNew->nChainWork = (pindexNew->pprev ? pindexNew->pprev->nChainWork : 0) + GetBlockProof(*pindexNew);
     }
-    pindexNew->nChainWork = (pindexNew->pprev ? pindexNew->pprev->nChainWork : 0) + GetBlockProof(*pindexNew);
     pindexNew->RaiseValidity(BLOCK_VALID_TREE);
     if (pindexBestHeader == NULL || pindexBestHeader->nChainWork < pindexNew->nChainWork)
         pindexBestHeader = pindexNew;
@@ -3392,14 +3984,101 @@ bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigne
 bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW)
 {
     // WL re-enable check POW because TFlashcoin miner could generate block with difficulty of mining < Target
+    if (fCheckPOW)
+        return CheckBlockHeader(block, state, consensusParams, block.GetPoWHash());
+
+    return true;
+}
+
+bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, const Consensus::Params& consensusParams, const uint256& hashPoW)
+{
 	// Check proof of work matches claimed amount
-    if (fCheckPOW && !CheckProofOfWork(block.GetPoWHash(), block.nBits, consensusParams, block))
+    if (!CheckProofOfWork(hashPoW, block.nBits, consensusParams, block))
         return state.DoS(50, false, REJECT_INVALID, "high-hash", false, "proof of work failed");
 
     return true;
 }
 
-bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW, bool fCheckMerkleRoot)
+/** Whether the context-free checks of block are worth spreading over the block check threads */
+static bool UseParallelBlockCheck(const CBlock& block)
+{
+    if (!nScriptCheckThreads)
+        return false;
+    if (block.vtx.size() >= PARALLEL_CHECK_BLOCK_MIN_TXS)
+        return true;
+    return block.vtx.size() >= PARALLEL_CHECK_BLOCK_MIN_TXS_IBD && IsInitialBlockDownload();
+}
+
+/**
+ * BlockMerkleRoot, with the lower levels of the tree (which hold nearly all of
+ * its nodes) hashed over the block check threads. Requires cs_blocktxcheckqueue.
+ */
+static uint256 ParallelBlockMerkleRoot(const CBlock& block, bool* mutated)
+{
+    std::vector<uint256> level(block.vtx.size());
+    for (size_t i = 0; i < block.vtx.size(); i++)
+        level[i] = block.vtx[i].GetHash();
+
+    // The top levels are too small to be worth spreading.
+    static const size_t nMinParallelNodes = 256;
+    bool fMutated = false;
+    while (level.size() >= nMinParallelNodes) {
+        std::vector<uint256> parents((level.size() + 1) / 2);
+        size_t nChunk = 2 * std::max((size_t)1, parents.size() / (nScriptCheckThreads * 4));
+        size_t nChecks = (level.size() + nChunk - 1) / nChunk;
+        std::unique_ptr<bool[]> vMutated(new bool[nChecks]());
+        std::vector<CBlockTxCheck> vChecks;
+        for (size_t n = 0; n < level.size(); n += nChunk)
+            vChecks.push_back(CBlockTxCheck(&level[n], &parents[n / 2], &vMutated[n / nChunk], std::min(nChunk, level.size() - n)));
+
+        CCheckQueueControl<CBlockTxCheck> control(&blocktxcheckqueue);
+        control.Add(vChecks);
+        control.Wait();
+        for (size_t i = 0; i < nChecks; i++)
+            fMutated |= vMutated[i];
+        level.swap(parents);
+    }
+
+    bool fMutatedTop;
+    uint256 hash = ComputeMerkleRoot(level, &fMutatedTop);
+    if (mutated)
+        *mutated = fMutated || fMutatedTop;
+    return hash;
+}
+
+/**
+ * The CheckTransaction and legacy sigop counting loops of CheckBlock, over the
+ * block check threads. Requires cs_blocktxcheckqueue.
+ */
+static bool ParallelCheckTransactions(const CBlock& block, CValidationState& state, unsigned int& nSigOps)
+{
+    size_t nChunk = std::max((size_t)1, block.vtx.size() / (nScriptCheckThreads * 4));
+    size_t nChecks = (block.vtx.size() + nChunk - 1) / nChunk;
+    std::vector<CValidationState> vState(nChecks);
+    std::vector<unsigned int> vSigOps(nChecks, 0);
+    std::vector<CBlockTxCheck> vChecks;
+    for (size_t n = 0; n < block.vtx.size(); n += nChunk)
+        vChecks.push_back(CBlockTxCheck(&block.vtx[n], &vState[n / nChunk], &vSigOps[n / nChunk], std::min(nChunk, block.vtx.size() - n)));
+
+    CCheckQueueControl<CBlockTxCheck> control(&blocktxcheckqueue);
+    control.Add(vChecks);
+    if (!control.Wait()) {
+        // Report the first bad transaction, as the serial loop does
+        for (size_t i = 0; i < block.vtx.size(); i++) {
+            const CTransaction& tx = block.vtx[i];
+            if (!CheckTransaction(tx, state))
+                return state.Invalid(false, state.GetRejectCode(), state.GetRejectReason(),
+                                     strprintf("Transaction check failed (tx hash %s) %s", tx.GetHash().ToString(), state.GetDebugMessage()));
+        }
+    }
+
+    nSigOps = 0;
+    for (size_t i = 0; i < nChecks; i++)
+        nSigOps += vSigOps[i];
+    return true;
+}
+
+bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckMinerSignature)
 {
     // These are checks that are independent of context.
 
@@ -3411,10 +4090,15 @@ bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::P
     if (!CheckBlockHeader(block, state, consensusParams, fCheckPOW))
         return false;
 
+    // Large blocks are checked on all cores, unless another thread is using them already
+    bool fParallel = UseParallelBlockCheck(block);
+    TRY_LOCK(cs_blocktxcheckqueue, lockParallel);
+    fParallel = fParallel && lockParallel;
+
     // Check the merkle root.
     if (fCheckMerkleRoot) {
         bool mutated;
-        uint256 hashMerkleRoot2 = BlockMerkleRoot(block, &mutated);
+        uint256 hashMerkleRoot2 = fParallel ? ParallelBlockMerkleRoot(block, &mutated) : BlockMerkleRoot(block, &mutated);
         if (block.hashMerkleRoot != hashMerkleRoot2)
             return state.DoS(100, false, REJECT_INVALID, "bad-txnmrklroot", true, "hashMerkleRoot mismatch");
 
@@ -3443,39 +4127,32 @@ bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::P
             return state.DoS(100, false, REJECT_INVALID, "bad-cb-multiple", false, "more than one coinbase");
 
     // WL miner signature in coinbase must be valid
-	// Block timestapm from which we apply block-signing.
-	// 1557032400 - Human time (GMT): Sunday, May 5, 2019 5:00:00 AM
-    int64_t timestamp_R3 = 1557032400;
-    if(block.vtx[0].IsCoinBase()){
-        std::string strScriptSig = ScriptToAsmStr(block.vtx[0].vin[0].scriptSig, true);
-        //cout << "scriptSig miner Signature: " << strScriptSig.c_str() << endl;
-        if((block.GetBlockTime() > timestamp_R3)){
-            if(BlsVerifyCoinbaseTransaction(strScriptSig, block.hashPrevBlock.ToString())){
-                //cout << "Miner Signature is VALID: " << strScriptSig.c_str() << endl;
-                LogPrintf("Miner Signature is VALID: %s\n", strScriptSig.c_str());
-            }else {
-                //cout << "Miner Signature is INVALID: " << strScriptSig.c_str() << endl;
-                LogPrintf("Miner Signature is INVALID: %s\n", strScriptSig.c_str());
-                return state.DoS(100, false, REJECT_INVALID, "bad-cb-signature-miner", false, "miner signature is not valid");
-            }
-        }
+    // The cached result is only used once the merkle root ties the coinbase to the block hash.
+    if (fCheckMinerSignature && block.GetBlockTime() > BLS_SIGNING_START_TIME && !GetBlsBlockVerifier().VerifyBlock(block, fCheckMerkleRoot)) {
+        LogPrintf("Miner Signature is INVALID: %s\n", ScriptToAsmStr(block.vtx[0].vin[0].scriptSig, true));
+        return state.DoS(100, false, REJECT_INVALID, "bad-cb-signature-miner", false, "miner signature is not valid");
     }
 
     // Check transactions
-    BOOST_FOREACH(const CTransaction& tx, block.vtx)
-        if (!CheckTransaction(tx, state))
-            return state.Invalid(false, state.GetRejectCode(), state.GetRejectReason(),
-                                 strprintf("Transaction check failed (tx hash %s) %s", tx.GetHash().ToString(), state.GetDebugMessage()));
-
     unsigned int nSigOps = 0;
-    BOOST_FOREACH(const CTransaction& tx, block.vtx)
-    {
-        nSigOps += GetLegacySigOpCount(tx);
+    if (fParallel) {
+        if (!ParallelCheckTransactions(block, state, nSigOps))
+            return false;
+    } else {
+        BOOST_FOREACH(const CTransaction& tx, block.vtx)
+            if (!CheckTransaction(tx, state))
+                return state.Invalid(false, state.GetRejectCode(), state.GetRejectReason(),
+                                     strprintf("Transaction check failed (tx hash %s) %s", tx.GetHash().ToString(), state.GetDebugMessage()));
+
+        BOOST_FOREACH(const CTransaction& tx, block.vtx)
+        {
+            nSigOps += GetLegacySigOpCount(tx);
+        }
     }
     if (nSigOps * WITNESS_SCALE_FACTOR > MAX_BLOCK_SIGOPS_COST)
         return state.DoS(100, false, REJECT_INVALID, "bad-blk-sigops", false, "out-of-bounds SigOpCount");
 
-    if (fCheckPOW && fCheckMerkleRoot)
+    if (fCheckPOW && fCheckMerkleRoot && fCheckMinerSignature)
         block.fChecked = true;
 
     return true;
@@ -3704,13 +4381,15 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
     return true;
 }
 
-static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex=NULL)
+/** If phashPoW is non-NULL, it is the already computed scrypt PoW hash of block */
+static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex=NULL, const uint256* phashPoW=NULL)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
     uint256 hash = block.GetHash();
     BlockMap::iterator miSelf = mapBlockIndex.find(hash);
     CBlockIndex *pindex = NULL;
+    uint256 hashPoW;
     if (hash != chainparams.GetConsensus().hashGenesisBlock) {
 
         if (miSelf != mapBlockIndex.end()) {
@@ -3723,7 +4402,8 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
             return true;
         }
 
-        if (!CheckBlockHeader(block, state, chainparams.GetConsensus()))
+        hashPoW = phashPoW ? *phashPoW : block.GetPoWHash();
+        if (!CheckBlockHeader(block, state, chainparams.GetConsensus(), hashPoW))
             return error("%s: Consensus::CheckBlockHeader: %s, %s", __func__, hash.ToString(), FormatStateMessage(state));
 
         // Get prev block index
@@ -3743,8 +4423,12 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
         if (!ContextualCheckBlockHeader(block, state, chainparams.GetConsensus(), pindexPrev, GetAdjustedTime()))
             return error("%s: Consensus::ContextualCheckBlockHeader: %s, %s", __func__, hash.ToString(), FormatStateMessage(state));
     }
-    if (pindex == NULL)
+    if (pindex == NULL) {
         pindex = AddToBlockIndex(block);
+        // Persist the scrypt hash so the PoW can be checked on startup without recomputing it
+        if (!hashPoW.IsNull())
+            pindex->SetBlockPoWHash(hashPoW);
+    }
 
     if (ppindex)
         *ppindex = pindex;
@@ -3860,7 +4544,7 @@ bool ProcessNewBlock(CValidationState& state, const CChainParams& chainparams, C
     return true;
 }
 
-bool TestBlockValidity(CValidationState& state, const CChainParams& chainparams, const CBlock& block, CBlockIndex* pindexPrev, bool fCheckPOW, bool fCheckMerkleRoot)
+bool TestBlockValidity(CValidationState& state, const CChainParams& chainparams, const CBlock& block, CBlockIndex* pindexPrev, bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckMinerSignature)
 {
     AssertLockHeld(cs_main);
     assert(pindexPrev && pindexPrev == chainActive.Tip());
@@ -3875,7 +4559,7 @@ bool TestBlockValidity(CValidationState& state, const CChainParams& chainparams,
     // NOTE: CheckBlockHeader is called by CheckBlock
     if (!ContextualCheckBlockHeader(block, state, chainparams.GetConsensus(), pindexPrev, GetAdjustedTime()))
         return error("%s: Consensus::ContextualCheckBlockHeader: %s", __func__, FormatStateMessage(state));
-    if (!CheckBlock(block, state, chainparams.GetConsensus(), fCheckPOW, fCheckMerkleRoot))
+    if (!CheckBlock(block, state, chainparams.GetConsensus(), fCheckPOW, fCheckMerkleRoot, fCheckMinerSignature))
         return error("%s: Consensus::CheckBlock: %s", __func__, FormatStateMessage(state));
     if (!ContextualCheckBlock(block, state, pindexPrev))
         return error("%s: Consensus::ContextualCheckBlock: %s", __func__, FormatStateMessage(state));
@@ -3937,6 +4621,8 @@ void UnlinkPrunedFiles(std::set<int>& setFilesToPrune)
 {
     for (set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
         CDiskBlockPos pos(*it, 0);
+        mappedBlockFiles.Erase(GetBlockPosFilename(pos, "blk"));
+        mappedBlockFiles.Erase(GetBlockPosFilename(pos, "rev"));
         boost::filesystem::remove(GetBlockPosFilename(pos, "blk"));
         boost::filesystem::remove(GetBlockPosFilename(pos, "rev"));
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
@@ -4052,6 +4738,7 @@ CBlockIndex * InsertBlockIndex(uint256 hash)
     CBlockIndex* pindexNew = new CBlockIndex();
     if (!pindexNew)
         throw runtime_error(std::string(__func__) + ": new CBlockIndex failed");
+    LOCK(cs_mapBlockIndex);
     mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
     pindexNew->phashBlock = &((*mi).first);
 
@@ -4152,11 +4839,20 @@ bool static LoadBlockIndexDB()
     pblocktree->ReadFlag("txindex", fTxIndex);
     LogPrintf("%s: transaction index %s\n", __func__, fTxIndex ? "enabled" : "disabled");
 
+    // Check whether we have the address, spent and timestamp indexes
+    pblocktree->ReadFlag("addressindex", fAddressIndex);
+    LogPrintf("%s: address index %s\n", __func__, fAddressIndex ? "enabled" : "disabled");
+    pblocktree->ReadFlag("spentindex", fSpentIndex);
+    LogPrintf("%s: spent index %s\n", __func__, fSpentIndex ? "enabled" : "disabled");
+    pblocktree->ReadFlag("timestampindex", fTimestampIndex);
+    LogPrintf("%s: timestamp index %s\n", __func__, fTimestampIndex ? "enabled" : "disabled");
+
     // Load pointer to end of best chain
     BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
     if (it == mapBlockIndex.end())
         return true;
     chainActive.SetTip(it->second);
+    PublishChainSnapshot();
 
     PruneBlockIndexCandidates();
 
@@ -4168,6 +4864,214 @@ bool static LoadBlockIndexDB()
     return true;
 }
 
+namespace {
+
+/** Recompute the PoW hashes of vIndex[nBegin, nEnd), counting mismatches and storing the computed hashes in vHashPoW. */
+void CheckBlockIndexPoWRange(const std::vector<std::pair<CBlockIndex*, uint256> >& vIndex, std::vector<uint256>& vHashPoW,
+                             std::atomic<size_t>& nNext, std::atomic<unsigned int>& nFailed, const Consensus::Params& consensusParams)
+{
+    static const size_t nBatchSize = 256;
+    try {
+        while (true) {
+            boost::this_thread::interruption_point();
+            size_t nBegin = nNext.fetch_add(nBatchSize);
+            if (nBegin >= vIndex.size())
+                return;
+            size_t nEnd = std::min(nBegin + nBatchSize, vIndex.size());
+            for (size_t i = nBegin; i < nEnd; i++) {
+                // Header fields and pprev of an indexed entry never change, so no lock is needed to read them.
+                CBlockHeader header = vIndex[i].first->GetBlockHeader();
+                vHashPoW[i] = header.GetPoWHash();
+                bool fMismatch = !vIndex[i].second.IsNull() && vIndex[i].second != vHashPoW[i];
+                if (fMismatch || !CheckProofOfWork(vHashPoW[i], header.nBits, consensusParams, header)) {
+                    LogPrintf("%s: PoW check failed for block %s (height %d)\n", __func__, vIndex[i].first->GetBlockHash().ToString(), vIndex[i].first->nHeight);
+                    nFailed++;
+                }
+            }
+        }
+    } catch (const boost::thread_interrupted&) {
+        // Shutting down; the caller notices the interruption itself.
+    }
+}
+
+} // anon namespace
+
+void ThreadCheckBlockIndexPoW(bool fCheckAll)
+{
+    RenameThread("flashcoin-powchk");
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+
+    // Snapshot the entries together with their stored hash, nStatus may be modified concurrently.
+    // Unless all of them are to be verified, only the entries that still lack the hash are
+    // included, so once those are upgraded and flushed later starts have nothing to do.
+    std::vector<std::pair<CBlockIndex*, uint256> > vIndex;
+    {
+        LOCK(cs_main);
+        vIndex.reserve(fCheckAll ? mapBlockIndex.size() : 0);
+        BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex) {
+            CBlockIndex* pindex = item.second;
+            if (item.first == consensusParams.hashGenesisBlock)
+                continue;
+            if (!fCheckAll && (pindex->nStatus & BLOCK_HAVE_POWHASH))
+                continue;
+            vIndex.push_back(std::make_pair(pindex, (pindex->nStatus & BLOCK_HAVE_POWHASH) ? pindex->hashPoW : uint256()));
+        }
+    }
+    if (vIndex.empty())
+        return;
+
+    int64_t nStart = GetTimeMillis();
+    int nThreads = std::max(GetNumCores(), 1);
+    LogPrintf("Verifying PoW hashes of %u block index entries using %d threads...\n", vIndex.size(), nThreads);
+
+    std::vector<uint256> vHashPoW(vIndex.size());
+    std::atomic<size_t> nNext(0);
+    std::atomic<unsigned int> nFailed(0);
+    boost::thread_group workers;
+    for (int i = 0; i < nThreads; i++)
+        workers.create_thread(boost::bind(&CheckBlockIndexPoWRange, boost::cref(vIndex), boost::ref(vHashPoW), boost::ref(nNext), boost::ref(nFailed), boost::cref(consensusParams)));
+    try {
+        workers.join_all();
+        boost::this_thread::interruption_point();
+    } catch (const boost::thread_interrupted&) {
+        workers.interrupt_all();
+        workers.join_all();
+        throw;
+    }
+
+    if (nFailed > 0) {
+        AbortNode(strprintf("Corrupted block database detected: %u block index entries failed the proof-of-work check", (unsigned int)nFailed),
+                  _("Corrupted block database detected") + "\n" + _("Please restart with -reindex to recover."));
+        return;
+    }
+
+    // Upgrade entries written before the PoW hash was persisted; they are written out on the next flush.
+    unsigned int nUpgraded = 0;
+    {
+        LOCK(cs_main);
+        for (size_t i = 0; i < vIndex.size(); i++) {
+            CBlockIndex* pindex = vIndex[i].first;
+            if (!(pindex->nStatus & BLOCK_HAVE_POWHASH)) {
+                pindex->SetBlockPoWHash(vHashPoW[i]);
+                setDirtyBlockIndex.insert(pindex);
+                nUpgraded++;
+            }
+        }
+    }
+
+    LogPrintf("Verified PoW hashes of %u block index entries (%u upgraded) in %dms\n", vIndex.size(), nUpgraded, GetTimeMillis() - nStart);
+}
+
+void ThreadCoinsWriter()
+{
+    RenameThread("flashcoin-coinswr");
+    pcoinsWriter->Run();
+}
+
+void ThreadCoinsPrefetch()
+{
+    RenameThread("flashcoin-coinspf");
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+    const int nPrefetchBlocks = GetArg("-prefetchblocks", DEFAULT_PREFETCH_BLOCKS);
+    if (nPrefetchBlocks <= 0)
+        return;
+
+    const CBlockIndex* pindexLastPrefetched = NULL;
+    while (true) {
+        {
+            boost::unique_lock<boost::mutex> lock(csBestBlock);
+            cvBlockChange.timed_wait(lock, boost::posix_time::milliseconds(500));
+        }
+        boost::this_thread::interruption_point();
+        if (!IsInitialBlockDownload())
+            continue;
+
+        // Pick the blocks on disk just ahead of the tip along the best header chain, skipping those done already.
+        std::vector<std::pair<const CBlockIndex*, CDiskBlockPos> > vBlocks;
+        uint64_t nFlushes;
+        {
+            LOCK(cs_main);
+            const CBlockIndex* pindexTip = chainActive.Tip();
+            if (pindexTip == NULL || pindexBestHeader == NULL || pindexBestHeader->nHeight <= pindexTip->nHeight)
+                continue;
+            if (pindexBestHeader->GetAncestor(pindexTip->nHeight) != pindexTip)
+                continue;
+            // Leave room for the blocks being connected, a flush would throw the prefetched coins away again.
+            if (pcoinsTip->ActiveMemoryUsage() * (10.0/9) > nCoinCacheUsage)
+                continue;
+            int nStart = pindexTip->nHeight + 1;
+            if (pindexLastPrefetched != NULL && pindexBestHeader->GetAncestor(pindexLastPrefetched->nHeight) == pindexLastPrefetched)
+                nStart = std::max(nStart, pindexLastPrefetched->nHeight + 1);
+            int nEnd = std::min(pindexBestHeader->nHeight, pindexTip->nHeight + nPrefetchBlocks);
+            for (int nHeight = nStart; nHeight <= nEnd; nHeight++) {
+                const CBlockIndex* pindex = pindexBestHeader->GetAncestor(nHeight);
+                if (!(pindex->nStatus & BLOCK_HAVE_DATA))
+                    break;
+                vBlocks.push_back(std::make_pair(pindex, pindex->GetBlockPos()));
+            }
+            nFlushes = nCoinsTipFlushes;
+        }
+        if (vBlocks.empty())
+            continue;
+
+        int64_t nTimeStart = GetTimeMicros();
+        std::vector<uint256> vTxid;
+        {
+            std::set<uint256> setCreated, setSpent;
+            CBlock block;
+            for (size_t i = 0; i < vBlocks.size(); i++) {
+                boost::this_thread::interruption_point();
+                if (!ReadBlockFromDisk(block, vBlocks[i].second, consensusParams))
+                    break;
+                pindexLastPrefetched = vBlocks[i].first;
+                BOOST_FOREACH(const CTransaction& tx, block.vtx) {
+                    if (!tx.IsCoinBase()) {
+                        BOOST_FOREACH(const CTxIn& txin, tx.vin) {
+                            // Outputs created within these blocks aren't in the database yet.
+                            if (!setCreated.count(txin.prevout.hash))
+                                setSpent.insert(txin.prevout.hash);
+                        }
+                    }
+                    setCreated.insert(tx.GetHash());
+                }
+            }
+            vTxid.reserve(setSpent.size());
+            {
+                LOCK(cs_main);
+                BOOST_FOREACH(const uint256& txid, setSpent) {
+                    if (!pcoinsTip->HaveCoinsInCache(txid))
+                        vTxid.push_back(txid);
+                }
+            }
+        }
+
+        // Read from the database without holding cs_main, which is the slow part this thread exists for.
+        std::vector<std::pair<uint256, CCoins> > vCoins;
+        vCoins.reserve(vTxid.size());
+        BOOST_FOREACH(const uint256& txid, vTxid) {
+            boost::this_thread::interruption_point();
+            CCoins coins;
+            if (pcoinsTip->GetCoinsFromBase(txid, coins) && !coins.IsPruned()) {
+                vCoins.push_back(std::make_pair(txid, CCoins()));
+                vCoins.back().second.swap(coins);
+            }
+        }
+
+        bool fStale;
+        {
+            LOCK(cs_main);
+            // After a flush the database may hold newer versions of what we read, drop it all.
+            fStale = nFlushes != nCoinsTipFlushes;
+            if (!fStale) {
+                for (size_t i = 0; i < vCoins.size(); i++)
+                    pcoinsTip->CacheCoins(vCoins[i].first, vCoins[i].second);
+            }
+        }
+        LogPrint("bench", "    - Prefetch coins of %u blocks up to height %d: %u/%u txs read%s [%.2fms]\n", vBlocks.size(), pindexLastPrefetched ? pindexLastPrefetched->nHeight : -1,
+                 vCoins.size(), vTxid.size(), fStale ? ", discarded after flush" : "", (GetTimeMicros() - nTimeStart) * 0.001);
+    }
+}
+
 CVerifyDB::CVerifyDB()
 {
     uiInterface.ShowProgress(_("Verifying blocks..."), 0);
@@ -4361,6 +5265,7 @@ void UnloadBlockIndex()
     LOCK(cs_main);
     setBlockIndexCandidates.clear();
     chainActive.SetTip(NULL);
+    PublishChainSnapshot();
     pindexBestInvalid = NULL;
     pindexBestHeader = NULL;
     mempool.clear();
@@ -4383,10 +5288,13 @@ void UnloadBlockIndex()
         warningcache[b].clear();
     }
 
-    BOOST_FOREACH(BlockMap::value_type& entry, mapBlockIndex) {
-        delete entry.second;
+    {
+        LOCK(cs_mapBlockIndex);
+        BOOST_FOREACH(BlockMap::value_type& entry, mapBlockIndex) {
+            delete entry.second;
+        }
+        mapBlockIndex.clear();
     }
-    mapBlockIndex.clear();
     fHavePruned = false;
 }
 
@@ -4412,6 +5320,12 @@ bool InitBlockIndex(const CChainParams& chainparams)
     // Use the provided setting for -txindex in the new database
     fTxIndex = GetBoolArg("-txindex", DEFAULT_TXINDEX);
     pblocktree->WriteFlag("txindex", fTxIndex);
+    fAddressIndex = GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
+    pblocktree->WriteFlag("addressindex", fAddressIndex);
+    fSpentIndex = GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
+    pblocktree->WriteFlag("spentindex", fSpentIndex);
+    fTimestampIndex = GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX);
+    pblocktree->WriteFlag("timestampindex", fTimestampIndex);
     LogPrintf("Initializing databases...\n");
 
     // Only add the genesis block if not reindexing (in which case we reuse the one already on disk)
@@ -4451,100 +5365,128 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
         CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION);
         uint64_t nRewind = blkdat.GetPos();
         while (!blkdat.eof()) {
-            boost::this_thread::interruption_point();
+            // Read a run of blocks first, so their miner signatures can be verified as one batch
+            std::vector<CBlock> vBlocks;
+            std::vector<CDiskBlockPos> vPos;
+            while (!blkdat.eof() && vBlocks.size() < BLS_BATCH_VERIFY_BLOCKS) {
+                boost::this_thread::interruption_point();
+
+                blkdat.SetPos(nRewind);
+                nRewind++; // start one byte further next time, in case of failure
+                blkdat.SetLimit(); // remove former limit
+                unsigned int nSize = 0;
+                try {
+                    // locate a header
+                    unsigned char buf[MESSAGE_START_SIZE];
+                    blkdat.FindByte(chainparams.MessageStart()[0]);
+                    nRewind = blkdat.GetPos()+1;
+                    blkdat >> FLATDATA(buf);
+                    if (memcmp(buf, chainparams.MessageStart(), MESSAGE_START_SIZE))
+                        continue;
+                    // read size
+                    blkdat >> nSize;
+                    if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
+                        continue;
+                } catch (const std::exception&) {
+                    // no valid block header found; don't complain
+                    break;
+                }
+                try {
+                    // read block
+                    uint64_t nBlockPos = blkdat.GetPos();
+                    blkdat.SetLimit(nBlockPos + nSize);
+                    blkdat.SetPos(nBlockPos);
+                    CBlock block;
+                    blkdat >> block;
+                    nRewind = blkdat.GetPos();
 
-            blkdat.SetPos(nRewind);
-            nRewind++; // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
-            try {
-                // locate a header
-                unsigned char buf[MESSAGE_START_SIZE];
-                blkdat.FindByte(chainparams.MessageStart()[0]);
-                nRewind = blkdat.GetPos()+1;
-                blkdat >> FLATDATA(buf);
-                if (memcmp(buf, chainparams.MessageStart(), MESSAGE_START_SIZE))
-                    continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
-                    continue;
-            } catch (const std::exception&) {
-                // no valid block header found; don't complain
-                break;
+                    vBlocks.push_back(std::move(block));
+                    if (dbp) {
+                        vPos.push_back(*dbp);
+                        vPos.back().nPos = nBlockPos;
+                    }
+                } catch (const std::exception& e) {
+                    LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+                }
             }
-            try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
+
+            BatchVerifyBlockSignatures(vBlocks);
+
+            bool fAbort = false;
+            for (size_t i = 0; i < vBlocks.size(); i++) {
+                boost::this_thread::interruption_point();
+
+                CBlock& block = vBlocks[i];
                 if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                CBlock block;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
-
-                // detect out of order blocks, and store them for later
-                uint256 hash = block.GetHash();
-                if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
-                    LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
-                            block.hashPrevBlock.ToString());
-                    if (dbp)
-                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
-                    continue;
-                }
+                    *dbp = vPos[i];
+                try {
+                    // detect out of order blocks, and store them for later
+                    uint256 hash = block.GetHash();
+                    if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
+                        LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
+                                block.hashPrevBlock.ToString());
+                        if (dbp)
+                            mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
+                        continue;
+                    }
 
-                // process in case the block isn't known yet
-                if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
-                    LOCK(cs_main);
-                    CValidationState state;
-                    if (AcceptBlock(block, state, chainparams, NULL, true, dbp, NULL))
-                        nLoaded++;
-                    if (state.IsError())
-                        break;
-                } else if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex[hash]->nHeight % 1000 == 0) {
-                    LogPrint("reindex", "Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
-                }
+                    // process in case the block isn't known yet
+                    if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
+                        LOCK(cs_main);
+                        CValidationState state;
+                        if (AcceptBlock(block, state, chainparams, NULL, true, dbp, NULL))
+                            nLoaded++;
+                        if (state.IsError()) {
+                            fAbort = true;
+                            break;
+                        }
+                    } else if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex[hash]->nHeight % 1000 == 0) {
+                        LogPrint("reindex", "Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
+                    }
 
-                // Activate the genesis block so normal node progress can continue
-                if (hash == chainparams.GetConsensus().hashGenesisBlock) {
-                    CValidationState state;
-                    if (!ActivateBestChain(state, chainparams)) {
-                        break;
+                    // Activate the genesis block so normal node progress can continue
+                    if (hash == chainparams.GetConsensus().hashGenesisBlock) {
+                        CValidationState state;
+                        if (!ActivateBestChain(state, chainparams)) {
+                            fAbort = true;
+                            break;
+                        }
                     }
-                }
 
-                NotifyHeaderTip();
-
-                // Recursively process earlier encountered successors of this block
-                deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
-                        if (ReadBlockFromDisk(block, it->second, chainparams.GetConsensus()))
-                        {
-                            LogPrint("reindex", "%s: Processing out of order child %s of %s\n", __func__, block.GetHash().ToString(),
-                                    head.ToString());
-                            LOCK(cs_main);
-                            CValidationState dummy;
-                            if (AcceptBlock(block, dummy, chainparams, NULL, true, &it->second, NULL))
+                    NotifyHeaderTip();
+
+                    // Recursively process earlier encountered successors of this block
+                    deque<uint256> queue;
+                    queue.push_back(hash);
+                    while (!queue.empty()) {
+                        uint256 head = queue.front();
+                        queue.pop_front();
+                        std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+                        while (range.first != range.second) {
+                            std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
+                            if (ReadBlockFromDisk(block, it->second, chainparams.GetConsensus()))
                             {
-                                nLoaded++;
-                                queue.push_back(block.GetHash());
+                                LogPrint("reindex", "%s: Processing out of order child %s of %s\n", __func__, block.GetHash().ToString(),
+                                        head.ToString());
+                                LOCK(cs_main);
+                                CValidationState dummy;
+                                if (AcceptBlock(block, dummy, chainparams, NULL, true, &it->second, NULL))
+                                {
+                                    nLoaded++;
+                                    queue.push_back(block.GetHash());
+                                }
                             }
+                            range.first++;
+                            mapBlocksUnknownParent.erase(it);
+                            NotifyHeaderTip();
                         }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
-                        NotifyHeaderTip();
                     }
+                } catch (const std::exception& e) {
+                    LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
                 }
-            } catch (const std::exception& e) {
-                LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
             }
+            if (fAbort)
+                break;
         }
     } catch (const std::runtime_error& e) {
         AbortNode(std::string("System error: ") + e.what());
@@ -4826,6 +5768,36 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
     return true;
 }
 
+/**
+ * Push a full block the way it is stored on disk, without deserializing it and
+ * serializing it again. Blocks are stored with their witness data, so this only
+ * works if the peer wants that, or if the block cannot have any because segwit
+ * was not active for it. Returns false if the block has to be sent the regular way.
+ */
+static bool PushRawBlock(CNode* pfrom, const CBlockIndex* pindex, bool fWitness, const Consensus::Params& consensusParams)
+{
+    if (!fWitness && IsWitnessEnabled(pindex->pprev, consensusParams))
+        return false;
+
+    std::vector<unsigned char> vchBlock;
+    if (!ReadRawBlockFromDisk(vchBlock, pindex->GetBlockPos(), Params().MessageStart()))
+        return false;
+
+    // Check that these are the bytes of the requested block, as ReadBlockFromDisk does
+    CBlockHeader header;
+    try {
+        CMemoryReader reader((const char*)begin_ptr(vchBlock), vchBlock.size(), SER_NETWORK, PROTOCOL_VERSION);
+        reader >> header;
+    } catch (const std::exception&) {
+        return false;
+    }
+    if (header.GetHash() != pindex->GetBlockHash())
+        return false;
+
+    pfrom->PushMessage(NetMsgType::BLOCK, CFlatData(vchBlock));
+    return true;
+}
+
 void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParams)
 {
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
@@ -4880,52 +5852,59 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                 // it's available before trying to send.
                 if (send && (mi->second->nStatus & BLOCK_HAVE_DATA))
                 {
-                    // Send block from disk
-                    CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second, consensusParams))
-                        assert(!"cannot load block from disk");
-                    if (inv.type == MSG_BLOCK)
-                        pfrom->PushMessageWithFlag(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, block);
-                    else if (inv.type == MSG_WITNESS_BLOCK)
-                        pfrom->PushMessage(NetMsgType::BLOCK, block);
-                    else if (inv.type == MSG_FILTERED_BLOCK)
+                    // Full blocks go out as they are stored on disk when no witness data has to be stripped
+                    bool fFullBlock = inv.type == MSG_BLOCK || inv.type == MSG_WITNESS_BLOCK ||
+                        (inv.type == MSG_CMPCT_BLOCK && !(CanDirectFetch(consensusParams) && mi->second->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH));
+                    bool fWitness = inv.type == MSG_WITNESS_BLOCK || (inv.type == MSG_CMPCT_BLOCK && State(pfrom->GetId())->fWantsCmpctWitness);
+                    if (!fFullBlock || !PushRawBlock(pfrom, mi->second, fWitness, consensusParams))
                     {
-                        bool send = false;
-                        CMerkleBlock merkleBlock;
+                        // Send block from disk
+                        CBlock block;
+                        if (!ReadBlockFromDisk(block, (*mi).second, consensusParams))
+                            assert(!"cannot load block from disk");
+                        if (inv.type == MSG_BLOCK)
+                            pfrom->PushMessageWithFlag(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, block);
+                        else if (inv.type == MSG_WITNESS_BLOCK)
+                            pfrom->PushMessage(NetMsgType::BLOCK, block);
+                        else if (inv.type == MSG_FILTERED_BLOCK)
                         {
-                            LOCK(pfrom->cs_filter);
-                            if (pfrom->pfilter) {
-                                send = true;
-                                merkleBlock = CMerkleBlock(block, *pfrom->pfilter);
+                            bool send = false;
+                            CMerkleBlock merkleBlock;
+                            {
+                                LOCK(pfrom->cs_filter);
+                                if (pfrom->pfilter) {
+                                    send = true;
+                                    merkleBlock = CMerkleBlock(block, *pfrom->pfilter);
+                                }
+                            }
+                            if (send) {
+                                pfrom->PushMessage(NetMsgType::MERKLEBLOCK, merkleBlock);
+                                // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
+                                // This avoids hurting performance by pointlessly requiring a round-trip
+                                // Note that there is currently no way for a node to request any single transactions we didn't send here -
+                                // they must either disconnect and retry or request the full block.
+                                // Thus, the protocol spec specified allows for us to provide duplicate txn here,
+                                // however we MUST always provide at least what the remote peer needs
+                                typedef std::pair<unsigned int, uint256> PairType;
+                                BOOST_FOREACH(PairType& pair, merkleBlock.vMatchedTxn)
+                                    pfrom->PushMessageWithFlag(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::TX, block.vtx[pair.first]);
                             }
+                            // else
+                                // no response
                         }
-                        if (send) {
-                            pfrom->PushMessage(NetMsgType::MERKLEBLOCK, merkleBlock);
-                            // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
-                            // This avoids hurting performance by pointlessly requiring a round-trip
-                            // Note that there is currently no way for a node to request any single transactions we didn't send here -
-                            // they must either disconnect and retry or request the full block.
-                            // Thus, the protocol spec specified allows for us to provide duplicate txn here,
-                            // however we MUST always provide at least what the remote peer needs
-                            typedef std::pair<unsigned int, uint256> PairType;
-                            BOOST_FOREACH(PairType& pair, merkleBlock.vMatchedTxn)
-                                pfrom->PushMessageWithFlag(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::TX, block.vtx[pair.first]);
+                        else if (inv.type == MSG_CMPCT_BLOCK)
+                        {
+                            // If a peer is asking for old blocks, we're almost guaranteed
+                            // they wont have a useful mempool to match against a compact block,
+                            // and we don't feel like constructing the object for them, so
+                            // instead we respond with the full, non-compact block.
+                            bool fPeerWantsWitness = State(pfrom->GetId())->fWantsCmpctWitness;
+                            if (CanDirectFetch(consensusParams) && mi->second->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH) {
+                                CBlockHeaderAndShortTxIDs cmpctblock(block, fPeerWantsWitness);
+                                pfrom->PushMessageWithFlag(fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::CMPCTBLOCK, cmpctblock);
+                            } else
+                                pfrom->PushMessageWithFlag(fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, block);
                         }
-                        // else
-                            // no response
-                    }
-                    else if (inv.type == MSG_CMPCT_BLOCK)
-                    {
-                        // If a peer is asking for old blocks, we're almost guaranteed
-                        // they wont have a useful mempool to match against a compact block,
-                        // and we don't feel like constructing the object for them, so
-                        // instead we respond with the full, non-compact block.
-                        bool fPeerWantsWitness = State(pfrom->GetId())->fWantsCmpctWitness;
-                        if (CanDirectFetch(consensusParams) && mi->second->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH) {
-                            CBlockHeaderAndShortTxIDs cmpctblock(block, fPeerWantsWitness);
-                            pfrom->PushMessageWithFlag(fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::CMPCTBLOCK, cmpctblock);
-                        } else
-                            pfrom->PushMessageWithFlag(fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, block);
                     }
 
                     // Trigger the peer node to send a getblocks request for the next batch of inventory
@@ -5981,6 +6960,42 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             ReadCompactSize(vRecv); // ignore tx count; assume it is 0.
         }
 
+        // Compute and check the proof of work of the new headers on the header check
+        // threads before taking cs_main to accept them. Only the unknown headers that
+        // connect to our block index and continue each other are checked, so a peer
+        // can't make us hash headers that would be rejected anyway. The first one is
+        // checked on its own first, and nothing is hashed ahead when it fails, so a
+        // bad message is still rejected after a single hash.
+        const Consensus::Params& consensusParams = chainparams.GetConsensus();
+        unsigned int nHashBegin = 0, nHashEnd = 0;
+        unsigned int nMaxRun = MAX_HEADERS_RESULTS;
+        std::vector<uint256> vHashPoW(nCount);
+        {
+            LOCK(cs_main);
+            while (nHashBegin < nCount && mapBlockIndex.count(headers[nHashBegin].GetHash()))
+                nHashBegin++;
+            BlockMap::iterator mi = nHashBegin < nCount ? mapBlockIndex.find(headers[nHashBegin].hashPrevBlock) : mapBlockIndex.end();
+            CValidationState state;
+            if (mi != mapBlockIndex.end() && !(mi->second->nStatus & BLOCK_FAILED_MASK) &&
+                ContextualCheckBlockHeader(headers[nHashBegin], state, consensusParams, mi->second, GetAdjustedTime()))
+                nHashEnd = nHashBegin + 1;
+            // Until a peer has sent a valid header, only a short run is hashed ahead
+            if (State(pfrom->GetId())->pindexBestKnownBlock == NULL)
+                nMaxRun = MAX_HEADERS_POW_AHEAD_NEW_PEER;
+        }
+        if (nHashEnd > nHashBegin && !CHeaderPoWCheck(&headers[nHashBegin], &vHashPoW[nHashBegin], 1, consensusParams)())
+            nMaxRun = 1;
+        // The run also stops at a header too far in the future, which will be rejected
+        int64_t nMaxTime = GetAdjustedTime() + 2 * 60 * 60;
+        while (nHashEnd > 0 && nHashEnd < nCount && nHashEnd - nHashBegin < nMaxRun &&
+               headers[nHashEnd].hashPrevBlock == headers[nHashEnd - 1].GetHash() && headers[nHashEnd].GetBlockTime() <= nMaxTime)
+            nHashEnd++;
+        if (nHashEnd > nHashBegin + 1 && !CheckHeadersPoW(&headers[nHashBegin + 1], nHashEnd - nHashBegin - 1, &vHashPoW[nHashBegin + 1], consensusParams)) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 50);
+            return error("invalid header received: proof of work failed");
+        }
+
         {
         LOCK(cs_main);
 
@@ -6019,13 +7034,14 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         }
 
         CBlockIndex *pindexLast = NULL;
-        BOOST_FOREACH(const CBlockHeader& header, headers) {
+        for (unsigned int n = 0; n < nCount; n++) {
+            const CBlockHeader& header = headers[n];
             CValidationState state;
             if (pindexLast != NULL && header.hashPrevBlock != pindexLast->GetBlockHash()) {
                 Misbehaving(pfrom->GetId(), 20);
                 return error("non-continuous headers sequence");
             }
-            if (!AcceptBlockHeader(header, state, chainparams, &pindexLast)) {
+            if (!AcceptBlockHeader(header, state, chainparams, &pindexLast, (n >= nHashBegin && n < nHashEnd) ? &vHashPoW[n] : NULL)) {
                 int nDoS;
                 if (state.IsInvalid(nDoS)) {
                     if (nDoS > 0)
@@ -6160,7 +7176,10 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         }
         pfrom->fSentAddr = true;
 
-        pfrom->vAddrToSend.clear();
+        {
+            LOCK(pfrom->cs_addrRelay);
+            pfrom->vAddrToSend.clear();
+        }
         vector<CAddress> vAddr = addrman.GetAddr();
         BOOST_FOREACH(const CAddress &addr, vAddr)
             pfrom->PushAddress(addr);
@@ -6374,8 +7393,31 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     return true;
 }
 
+/**
+ * Messages that are handled without cs_main, except to punish misbehaviour,
+ * and only touch state of their own peer that is not shared with SendMessages
+ * or is guarded by a lock of its own. These may be handled by the parallel
+ * message handler threads while the main one is busy, e.g. validating a block.
+ */
+static bool IsParallelMessage(const CNode* pfrom, const std::string& strCommand)
+{
+    // Everything before the version handshake goes through the main handler
+    if (pfrom->nVersion == 0)
+        return false;
+    return strCommand == NetMsgType::PING ||
+        strCommand == NetMsgType::PONG ||
+        strCommand == NetMsgType::ADDR ||
+        strCommand == NetMsgType::GETADDR ||
+        strCommand == NetMsgType::FILTERLOAD ||
+        strCommand == NetMsgType::FILTERADD ||
+        strCommand == NetMsgType::FILTERCLEAR ||
+        strCommand == NetMsgType::FEEFILTER ||
+        strCommand == NetMsgType::REJECT ||
+        strCommand == NetMsgType::NOTFOUND;
+}
+
 // requires LOCK(cs_vRecvMsg)
-bool ProcessMessages(CNode* pfrom)
+bool ProcessMessages(CNode* pfrom, bool fParallelOnly)
 {
     const CChainParams& chainparams = Params();
     //if (fDebug)
@@ -6391,7 +7433,7 @@ bool ProcessMessages(CNode* pfrom)
     //
     bool fOk = true;
 
-    if (!pfrom->vRecvGetData.empty())
+    if (!pfrom->vRecvGetData.empty() && !fParallelOnly)
         ProcessGetData(pfrom, chainparams.GetConsensus());
 
     // this maintains the order of responses
@@ -6415,6 +7457,10 @@ bool ProcessMessages(CNode* pfrom)
         if (!msg.complete())
             break;
 
+        // leave this message and everything after it to the main handler
+        if (fParallelOnly && !IsParallelMessage(pfrom, msg.hdr.GetCommand()))
+            break;
+
         // at this point, any failure means we can delete the current message
         it++;
 
@@ -6570,28 +7616,36 @@ bool SendMessages(CNode* pto)
         //
         if (pto->nNextAddrSend < nNow) {
             pto->nNextAddrSend = PoissonNextSend(nNow, AVG_ADDRESS_BROADCAST_INTERVAL);
-            vector<CAddress> vAddr;
-            vAddr.reserve(pto->vAddrToSend.size());
-            BOOST_FOREACH(const CAddress& addr, pto->vAddrToSend)
+            vector<CAddress> vAddrNew;
             {
-                if (!pto->addrKnown.contains(addr.GetKey()))
+                LOCK(pto->cs_addrRelay);
+                vAddrNew.reserve(pto->vAddrToSend.size());
+                BOOST_FOREACH(const CAddress& addr, pto->vAddrToSend)
                 {
-                    pto->addrKnown.insert(addr.GetKey());
-                    vAddr.push_back(addr);
-                    // receiver rejects addr messages larger than 1000
-                    if (vAddr.size() >= 1000)
+                    if (!pto->addrKnown.contains(addr.GetKey()))
                     {
-                        pto->PushMessage(NetMsgType::ADDR, vAddr);
-                        vAddr.clear();
+                        pto->addrKnown.insert(addr.GetKey());
+                        vAddrNew.push_back(addr);
                     }
                 }
+                pto->vAddrToSend.clear();
+                // we only send the big addr message once
+                if (pto->vAddrToSend.capacity() > 40)
+                    pto->vAddrToSend.shrink_to_fit();
+            }
+            vector<CAddress> vAddr;
+            BOOST_FOREACH(const CAddress& addr, vAddrNew)
+            {
+                vAddr.push_back(addr);
+                // receiver rejects addr messages larger than 1000
+                if (vAddr.size() >= 1000)
+                {
+                    pto->PushMessage(NetMsgType::ADDR, vAddr);
+                    vAddr.clear();
+                }
             }
-            pto->vAddrToSend.clear();
             if (!vAddr.empty())
                 pto->PushMessage(NetMsgType::ADDR, vAddr);
-            // we only send the big addr message once
-            if (pto->vAddrToSend.capacity() > 40)
-                pto->vAddrToSend.shrink_to_fit();
         }
 
         CNodeState &state = *State(pto->GetId());
@@ -10,17 +10,21 @@
 #include "config/bitcoin-config.h"
 #endif
 
+#include "addressindex.h"
 #include "amount.h"
 #include "chain.h"
 #include "coins.h"
 #include "net.h"
 #include "script/script_error.h"
+#include "spentindex.h"
 #include "sync.h"
+#include "timestampindex.h"
 #include "versionbits.h"
 
 #include <algorithm>
 #include <exception>
 #include <map>
+#include <memory>
 #include <set>
 #include <stdint.h>
 #include <string>
@@ -33,6 +37,8 @@
 
 class CBlockIndex;
 class CBlockTreeDB;
+class CCoinsViewAsyncWriter;
+class CCoinsViewDB;
 class CBloomFilter;
 class CChainParams;
 class CInv;
@@ -67,11 +73,16 @@ extern bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
 extern bool fTxIndex;
+extern bool fAddressIndex;
+extern bool fSpentIndex;
+extern bool fTimestampIndex;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
 extern size_t nCoinCacheUsage;
+/** Write dirty coins without emptying the cache when flushing the chainstate (-partialflush) */
+extern bool fPartialFlush;
 /** A fee rate smaller than this is considered zero fee (for relaying, mining and transaction creation) */
 extern CFeeRate minRelayTxFee;
 /** Absolute maximum transaction fee (in satoshis) used by wallet and mempool (rejects high fee in sendrawtransaction) */
@@ -96,8 +107,29 @@ extern uint64_t nPruneTarget;
 /** Block files containing a block-height within MIN_BLOCKS_TO_KEEP of chainActive.Tip() will not be pruned. */
 static const unsigned int MIN_BLOCKS_TO_KEEP = 288;
 
+/** Maximum number of blocks whose miner signatures are verified as one batch during initial sync and import */
+static const unsigned int BLS_BATCH_VERIFY_BLOCKS = 32;
+/** Blocks with at least this many transactions have their context-free checks spread over the block check threads */
+static const unsigned int PARALLEL_CHECK_BLOCK_MIN_TXS = 1000;
+/** Same, for blocks checked during initial block download */
+static const unsigned int PARALLEL_CHECK_BLOCK_MIN_TXS_IBD = 100;
+
 static const signed int DEFAULT_CHECKBLOCKS = 6 * 4;
 static const unsigned int DEFAULT_CHECKLEVEL = 3;
+/** Default for -prefetchblocks, the number of blocks ahead of the tip whose coins are loaded during initial sync */
+static const int DEFAULT_PREFETCH_BLOCKS = 16;
+/** Default for -partialflush */
+static const bool DEFAULT_PARTIAL_FLUSH = true;
+/** After a partial flush of a full coins cache, unused clean entries are evicted until it is below this percentage of the limit */
+static const unsigned int COINS_CACHE_TRIM_PERCENT = 80;
+/** Default for -asyncflush, commit flushed coins to the chainstate database from a background thread */
+static const bool DEFAULT_ASYNC_FLUSH = true;
+/** Default for -coinstats, keep running UTXO set totals in the chainstate database. Off because hashing every written output dominates the cost of a flush. */
+static const bool DEFAULT_COINSTATS = false;
+/** Number of block and undo files kept mapped for reading; none on 32-bit systems, where address space is scarce */
+static const unsigned int MAX_MAPPED_BLOCK_FILES = sizeof(void*) >= 8 ? 16 : 0;
+/** Default for -checkpowhashes, re-verify the stored PoW hashes of the block index in the background after startup */
+static const bool DEFAULT_CHECKPOWHASHES = false;
 
 // Require that user allocate at least 550MB for block & undo files (blk???.dat and rev???.dat)
 // At 1MB per block, 288 blocks = 288MB.
@@ -143,8 +175,11 @@ bool InitBlockIndex(const CChainParams& chainparams);
 bool LoadBlockIndex();
 /** Unload database information */
 void UnloadBlockIndex();
-/** Process protocol messages received from a given node */
-bool ProcessMessages(CNode* pfrom);
+/**
+ * Process protocol messages received from a given node. With fParallelOnly, stop at
+ * the first message that has to be handled by the main message handler thread.
+ */
+bool ProcessMessages(CNode* pfrom, bool fParallelOnly = false);
 /**
  * Send queued protocol messages to be sent to a give node.
  *
@@ -153,6 +188,18 @@ bool ProcessMessages(CNode* pfrom);
 bool SendMessages(CNode* pto);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the header proof-of-work checking thread */
+void ThreadHeaderPoWCheck();
+/** Run an instance of the block prefetch thread */
+void ThreadBlockPrefetch();
+/** Run an instance of the block transaction checking thread */
+void ThreadBlockTxCheck();
+/** Compute the missing scrypt PoW hashes of the block index on all cores and persist them; with fCheckAll also recheck the stored ones */
+void ThreadCheckBlockIndexPoW(bool fCheckAll);
+/** Load the coins spent by the blocks on disk ahead of the tip into pcoinsTip during initial block download */
+void ThreadCoinsPrefetch();
+/** Commit the coins flushed from pcoinsTip to the chainstate database in the background */
+void ThreadCoinsWriter();
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
 /** Format a string that describes several potential problems detected by the core.
@@ -165,6 +212,16 @@ bool IsInitialBlockDownload();
 std::string GetWarnings(const std::string& strFor);
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
 bool GetTransaction(const uint256 &hash, CTransaction &tx, const Consensus::Params& params, uint256 &hashBlock, bool fAllowSlow = false);
+/** Address index type and hash of the destination script pays to, ADDRESS_INDEX_NONE if it isn't indexed */
+unsigned int GetAddressIndexDestination(const CScript& script, uint160& hashBytes);
+/** Retrieve the -addressindex entries of an address, from height start to end, either bound is ignored if 0 */
+bool GetAddressIndex(unsigned int type, const uint160& addressHash, std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex, int start = 0, int end = 0);
+/** Retrieve the unspent outputs of an address from -addressindex */
+bool GetAddressUnspent(unsigned int type, const uint160& addressHash, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& unspentOutputs);
+/** Look up the input spending an output in -spentindex */
+bool GetSpentIndex(const CSpentIndexKey& key, CSpentIndexValue& value);
+/** Retrieve the hashes of the blocks with timestamps from low to high (exclusive) from -timestampindex */
+bool GetTimestampIndex(unsigned int high, unsigned int low, std::vector<uint256>& hashes);
 /** Find the best known block, and make it the tip of the block chain */
 bool ActivateBestChain(CValidationState& state, const CChainParams& chainparams, const CBlock* pblock = NULL);
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams);
@@ -199,9 +256,29 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats);
 void Misbehaving(NodeId nodeid, int howmuch);
 /** Flush all state, indexes and buffers to disk. */
 void FlushStateToDisk();
+/** Write all state, indexes and buffers to disk, but keep the coins cache loaded. */
+void SyncStateToDisk();
 /** Prune block files and flush state to disk. */
 void PruneAndFlush();
 
+/** Statistics about the writes of the coins cache to the chainstate database */
+struct CCoinsFlushStats
+{
+    uint64_t nFlushes;
+    uint64_t nPartialFlushes;
+    int64_t nLastFlushTime;
+    int64_t nLastFlushMicros;
+    bool fLastFlushPartial;
+    size_t nLastDirty;
+    size_t nLastEvicted;
+
+    CCoinsFlushStats() : nFlushes(0), nPartialFlushes(0), nLastFlushTime(0), nLastFlushMicros(0),
+                         fLastFlushPartial(false), nLastDirty(0), nLastEvicted(0) {}
+};
+
+/** Get the coins cache flush statistics */
+CCoinsFlushStats GetCoinsFlushStats();
+
 /** (try to) add transaction to memory pool **/
 bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
                         bool* pfMissingInputs, bool fOverrideMempoolLimit=false, const CAmount nAbsurdFee=0);
@@ -338,16 +415,123 @@ public:
 };
 
 
+/**
+ * Closure representing the proof-of-work check of a run of block headers:
+ * computes their scrypt hashes through the multi-buffer kernel into phashPoW
+ * and checks each one against the header's target.
+ */
+class CHeaderPoWCheck
+{
+private:
+    const CBlockHeader *pheaders;
+    uint256 *phashPoW;
+    size_t nCount;
+    const Consensus::Params *params;
+
+public:
+    CHeaderPoWCheck(): pheaders(NULL), phashPoW(NULL), nCount(0), params(NULL) {}
+    CHeaderPoWCheck(const CBlockHeader* pheadersIn, uint256* phashPoWIn, size_t nCountIn, const Consensus::Params& paramsIn) :
+        pheaders(pheadersIn), phashPoW(phashPoWIn), nCount(nCountIn), params(&paramsIn) { }
+
+    bool operator()();
+
+    void swap(CHeaderPoWCheck &check) {
+        std::swap(pheaders, check.pheaders);
+        std::swap(phashPoW, check.phashPoW);
+        std::swap(nCount, check.nCount);
+        std::swap(params, check.params);
+    }
+};
+
+/**
+ * Closure representing work done ahead of connecting a block, on either a run
+ * of txids, reading their coins from the backing view of a coins cache into
+ * pcoins (an empty CCoins if not found), or a run of the block's
+ * transactions, computing their signature hash precomputation data.
+ */
+class CBlockPrefetchCheck
+{
+private:
+    const CCoinsViewCache *view;
+    const uint256 *ptxid;
+    CCoins *pcoins;
+    const CTransaction *ptx;
+    PrecomputedTransactionData *ptxdata;
+    size_t nCount;
+
+public:
+    CBlockPrefetchCheck(): view(NULL), ptxid(NULL), pcoins(NULL), ptx(NULL), ptxdata(NULL), nCount(0) {}
+    CBlockPrefetchCheck(const CCoinsViewCache& viewIn, const uint256* ptxidIn, CCoins* pcoinsIn, size_t nCountIn) :
+        view(&viewIn), ptxid(ptxidIn), pcoins(pcoinsIn), ptx(NULL), ptxdata(NULL), nCount(nCountIn) { }
+    CBlockPrefetchCheck(const CTransaction* ptxIn, PrecomputedTransactionData* ptxdataIn, size_t nCountIn) :
+        view(NULL), ptxid(NULL), pcoins(NULL), ptx(ptxIn), ptxdata(ptxdataIn), nCount(nCountIn) { }
+
+    bool operator()();
+
+    void swap(CBlockPrefetchCheck &check) {
+        std::swap(view, check.view);
+        std::swap(ptxid, check.ptxid);
+        std::swap(pcoins, check.pcoins);
+        std::swap(ptx, check.ptx);
+        std::swap(ptxdata, check.ptxdata);
+        std::swap(nCount, check.nCount);
+    }
+};
+
+/**
+ * Closure representing either the context-free checks of a run of a block's
+ * transactions (CheckTransaction, with the failure reported in pstate, and
+ * their legacy sigops added up into pnSigOps), or the hashing of a run of one
+ * level of the block's merkle tree into the next level.
+ */
+class CBlockTxCheck
+{
+private:
+    const CTransaction *ptx;
+    CValidationState *pstate;
+    unsigned int *pnSigOps;
+    const uint256 *pnodes;
+    uint256 *pparents;
+    bool *pmutated;
+    size_t nCount;
+
+public:
+    CBlockTxCheck(): ptx(NULL), pstate(NULL), pnSigOps(NULL), pnodes(NULL), pparents(NULL), pmutated(NULL), nCount(0) {}
+    CBlockTxCheck(const CTransaction* ptxIn, CValidationState* pstateIn, unsigned int* pnSigOpsIn, size_t nCountIn) :
+        ptx(ptxIn), pstate(pstateIn), pnSigOps(pnSigOpsIn), pnodes(NULL), pparents(NULL), pmutated(NULL), nCount(nCountIn) { }
+    CBlockTxCheck(const uint256* pnodesIn, uint256* pparentsIn, bool* pmutatedIn, size_t nCountIn) :
+        ptx(NULL), pstate(NULL), pnSigOps(NULL), pnodes(pnodesIn), pparents(pparentsIn), pmutated(pmutatedIn), nCount(nCountIn) { }
+
+    bool operator()();
+
+    void swap(CBlockTxCheck &check) {
+        std::swap(ptx, check.ptx);
+        std::swap(pstate, check.pstate);
+        std::swap(pnSigOps, check.pnSigOps);
+        std::swap(pnodes, check.pnodes);
+        std::swap(pparents, check.pparents);
+        std::swap(pmutated, check.pmutated);
+        std::swap(nCount, check.nCount);
+    }
+};
+
+
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+/** Read the size of the block stored at pos, from the index header in front of it */
+bool ReadBlockSizeFromDisk(unsigned int& nSize, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
+/** Read the block stored at pos as raw bytes, without deserializing it */
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& vchBlock, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
 
 /** Functions for validating blocks and updating the block tree */
 
 /** Context-independent validity checks */
 bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true);
-bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true, bool fCheckMerkleRoot = true);
+/** Same as above, with the scrypt PoW hash of the header already computed by the caller */
+bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, const Consensus::Params& consensusParams, const uint256& hashPoW);
+bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true, bool fCheckMerkleRoot = true, bool fCheckMinerSignature = true);
 
 /** Context-dependent validity checks.
  *  By "context", we mean only the previous block headers, but not the UTXO
@@ -368,7 +552,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockIndex* pindex, CCoinsViewCache& coins, bool* pfClean = NULL);
 
 /** Check a block is completely valid from start to finish (only works on top of our current best block, with cs_main held) */
-bool TestBlockValidity(CValidationState& state, const CChainParams& chainparams, const CBlock& block, CBlockIndex* pindexPrev, bool fCheckPOW = true, bool fCheckMerkleRoot = true);
+bool TestBlockValidity(CValidationState& state, const CChainParams& chainparams, const CBlock& block, CBlockIndex* pindexPrev, bool fCheckPOW = true, bool fCheckMerkleRoot = true, bool fCheckMinerSignature = true);
 
 /** Check whether witness commitments are required for block. */
 bool IsWitnessEnabled(const CBlockIndex* pindexPrev, const Consensus::Params& params);
@@ -402,9 +586,74 @@ bool ResetBlockFailureFlags(CBlockIndex *pindex);
 /** The currently-connected chain of blocks (protected by cs_main). */
 extern CChain chainActive;
 
+/**
+ * Immutable view of the active chain as of one tip update, for read-only RPC
+ * and REST handlers that don't want to wait for cs_main. It only relies on
+ * block index fields that don't change once a block has been connected
+ * (hash, height, header, chain work, pprev/pskip), and entries are never
+ * freed while the node runs.
+ */
+class CChainSnapshot
+{
+private:
+    const CBlockIndex* pindexTip;
+
+public:
+    explicit CChainSnapshot(const CBlockIndex* pindexTipIn) : pindexTip(pindexTipIn) {}
+
+    /** Returns the tip of the snapshot, NULL if there is none. */
+    const CBlockIndex* Tip() const {
+        return pindexTip;
+    }
+
+    /** Returns the height of the tip, -1 if there is none. */
+    int Height() const {
+        return pindexTip ? pindexTip->nHeight : -1;
+    }
+
+    /** Returns the block at a given height of the snapshot, NULL if out of range. */
+    const CBlockIndex* operator[](int nHeight) const {
+        if (nHeight < 0 || nHeight > Height())
+            return NULL;
+        return pindexTip->GetAncestor(nHeight);
+    }
+
+    /** Check whether a block is part of the snapshot. */
+    bool Contains(const CBlockIndex* pindex) const {
+        return (*this)[pindex->nHeight] == pindex;
+    }
+
+    /** Find the successor of a block in the snapshot, NULL if it's the tip or not part of it. */
+    const CBlockIndex* Next(const CBlockIndex* pindex) const {
+        if (Contains(pindex))
+            return (*this)[pindex->nHeight + 1];
+        return NULL;
+    }
+};
+
+/** Return the snapshot of chainActive published by the last tip change, can be called without cs_main. */
+std::shared_ptr<const CChainSnapshot> GetChainSnapshot();
+
+/** Find a block of a snapshot by hash without cs_main, NULL if it isn't part of that snapshot. */
+const CBlockIndex* LookupBlockIndexInSnapshot(const CChainSnapshot& chain, const uint256& hash);
+
+/**
+ * Find a block by hash and read it from disk for read-only RPC and REST callers, setting chain to
+ * the snapshot it was looked up in. Blocks of the snapshot are read without cs_main unless block
+ * files may have been pruned. Returns NULL if the block is unknown, block is left null if its data
+ * can't be read.
+ */
+const CBlockIndex* ReadBlockByHash(const uint256& hash, std::shared_ptr<const CChainSnapshot>& chain, CBlock& block);
+
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern CCoinsViewCache *pcoinsTip;
 
+/** Global variable that points to the view committing pcoinsTip's flushes to the database, the base of pcoinsTip */
+extern CCoinsViewAsyncWriter *pcoinsWriter;
+
+/** Global variable that points to the chainstate database at the bottom of the pcoinsTip views */
+extern CCoinsViewDB *pcoinsdbview;
+
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern CBlockTreeDB *pblocktree;
 
@@ -0,0 +1,94 @@
+// Copyright (c) 2014-2019 The Flashcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "mappedfile.h"
+
+#include <limits>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+CMappedFile::~CMappedFile()
+{
+#ifndef WIN32
+    munmap((void*)pdata, nSize);
+#endif
+}
+
+std::shared_ptr<const CMappedFile> CMappedFile::Map(const boost::filesystem::path& path)
+{
+#ifndef WIN32
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0 || (uint64_t)st.st_size > std::numeric_limits<size_t>::max()) {
+        close(fd);
+        return NULL;
+    }
+    void* p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping stays valid without the descriptor
+    close(fd);
+    if (p == MAP_FAILED)
+        return NULL;
+    return std::shared_ptr<const CMappedFile>(new CMappedFile((const char*)p, st.st_size));
+#else
+    return NULL;
+#endif
+}
+
+std::shared_ptr<const CMappedFile> CMappedFileCache::Get(const boost::filesystem::path& path, size_t nMinSize)
+{
+    if (nMaxFiles == 0)
+        return NULL;
+
+    LOCK(cs);
+    nUses++;
+    std::vector<CEntry>::iterator it = vEntries.begin();
+    while (it != vEntries.end() && it->path != path)
+        it++;
+    if (it != vEntries.end() && it->file->size() >= nMinSize) {
+        it->nLastUse = nUses;
+        return it->file;
+    }
+
+    std::shared_ptr<const CMappedFile> file = CMappedFile::Map(path);
+    if (!file) {
+        if (it != vEntries.end())
+            vEntries.erase(it);
+        return NULL;
+    }
+    if (it == vEntries.end()) {
+        if (vEntries.size() >= nMaxFiles) {
+            std::vector<CEntry>::iterator itOldest = vEntries.begin();
+            for (std::vector<CEntry>::iterator itEntry = vEntries.begin(); itEntry != vEntries.end(); itEntry++)
+                if (itEntry->nLastUse < itOldest->nLastUse)
+                    itOldest = itEntry;
+            vEntries.erase(itOldest);
+        }
+        vEntries.push_back(CEntry());
+        it = vEntries.end() - 1;
+        it->path = path;
+    }
+    it->file = file;
+    it->nLastUse = nUses;
+    if (file->size() < nMinSize)
+        return NULL;
+    return file;
+}
+
+void CMappedFileCache::Erase(const boost::filesystem::path& path)
+{
+    LOCK(cs);
+    for (std::vector<CEntry>::iterator it = vEntries.begin(); it != vEntries.end(); it++) {
+        if (it->path == path) {
+            vEntries.erase(it);
+            return;
+        }
+    }
+}
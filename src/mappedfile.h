@@ -0,0 +1,76 @@
+// Copyright (c) 2014-2019 The Flashcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_MAPPEDFILE_H
+#define BITCOIN_MAPPEDFILE_H
+
+#include "sync.h"
+
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+
+/** Read-only memory mapping of a whole file, covering the file as large as it was when mapped */
+class CMappedFile
+{
+private:
+    const char* pdata;
+    size_t nSize;
+
+    CMappedFile(const char* pdataIn, size_t nSizeIn) : pdata(pdataIn), nSize(nSizeIn) {}
+
+    // Disallow copies
+    CMappedFile(const CMappedFile&);
+    CMappedFile& operator=(const CMappedFile&);
+
+public:
+    ~CMappedFile();
+
+    /** Map the file at path. Returns NULL if it can't be mapped, e.g. on platforms without mmap. */
+    static std::shared_ptr<const CMappedFile> Map(const boost::filesystem::path& path);
+
+    const char* data() const { return pdata; }
+    size_t size() const { return nSize; }
+};
+
+/**
+ * A small cache of mapped files, so that files read over and over, like the
+ * latest block files while serving blocks to syncing peers, are opened and
+ * mapped once instead of on every read. When full, the least recently used
+ * mapping is dropped; readers still holding it keep it alive until they are done.
+ */
+class CMappedFileCache
+{
+private:
+    struct CEntry
+    {
+        boost::filesystem::path path;
+        std::shared_ptr<const CMappedFile> file;
+        uint64_t nLastUse;
+    };
+
+    CCriticalSection cs;
+    std::vector<CEntry> vEntries;
+    size_t nMaxFiles;
+    uint64_t nUses;
+
+public:
+    /** A cache of nMaxFilesIn files; with 0 nothing is mapped */
+    CMappedFileCache(size_t nMaxFilesIn) : nMaxFiles(nMaxFilesIn), nUses(0) {}
+
+    /**
+     * Return a mapping of path covering at least its first nMinSize bytes,
+     * mapping the file again if it has grown since. Returns NULL if the file
+     * can't be mapped or is shorter.
+     */
+    std::shared_ptr<const CMappedFile> Get(const boost::filesystem::path& path, size_t nMinSize);
+
+    /** Drop the mapping of path, if any, e.g. before the file is deleted */
+    void Erase(const boost::filesystem::path& path);
+};
+
+#endif // BITCOIN_MAPPEDFILE_H
@@ -27,6 +27,7 @@
 #include "validationinterface.h"
 
 #include <algorithm>
+#include <boost/bind.hpp>
 #include <boost/thread.hpp>
 #include <boost/tuple/tuple.hpp>
 #include <queue>
@@ -74,8 +75,9 @@ int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParam
     return nNewTime - nOldTime;
 }
 
-BlockAssembler::BlockAssembler(const CChainParams& _chainparams)
-    : chainparams(_chainparams)
+BlockAssembler::BlockAssembler(const CChainParams& _chainparams, bool fTrackMempoolIn)
+    : chainparams(_chainparams), fTrackMempool(fTrackMempoolIn), pindexTemplatePrev(NULL),
+      nTemplateTransactionsUpdated(0), nTemplateNotified(0), fTemplateStale(true), nTemplateTime(0)
 {
     // Block resource limits
     // If neither -blockmaxsize or -blockmaxweight is given, limit to DEFAULT_BLOCK_MAX_*
@@ -103,6 +105,17 @@ BlockAssembler::BlockAssembler(const CChainParams& _chainparams)
 
     // Whether we need to account for byte usage (in addition to weight usage)
     fNeedSizeAccounting = (nBlockMaxSize < MAX_BLOCK_SERIALIZED_SIZE-1000);
+
+    if (fTrackMempool) {
+        connEntryAdded = mempool.NotifyEntryAdded.connect(boost::bind(&BlockAssembler::EntryAdded, this, _1));
+        connEntryRemoved = mempool.NotifyEntryRemoved.connect(boost::bind(&BlockAssembler::EntryRemoved, this, _1));
+    }
+}
+
+BlockAssembler::~BlockAssembler()
+{
+    connEntryAdded.disconnect();
+    connEntryRemoved.disconnect();
 }
 
 void BlockAssembler::resetBlock()
@@ -121,6 +134,136 @@ void BlockAssembler::resetBlock()
 
     lastFewTxs = 0;
     blockFinished = false;
+
+    minPackageFeeRate = CFeeRate(MAX_MONEY);
+    fOutbidLeftOut = false;
+}
+
+void BlockAssembler::EntryAdded(CTxMemPool::txiter it)
+{
+    ++nTemplateNotified;
+    setAddedTx.insert(it);
+}
+
+void BlockAssembler::EntryRemoved(CTxMemPool::txiter it)
+{
+    ++nTemplateNotified;
+    setAddedTx.erase(it);
+    // The template can't be extended once one of its transactions is gone
+    if (inBlock.count(it))
+        fTemplateStale = true;
+}
+
+bool BlockAssembler::ExtendTemplate(const CBlockIndex* pindexPrev)
+{
+    if (!fTrackMempool || !pblocktemplate || fTemplateStale || pindexPrev != pindexTemplatePrev)
+        return false;
+    // Changes that aren't notified entry by entry (clear, prioritisetransaction)
+    if (mempool.GetTransactionsUpdated() != nTemplateTransactionsUpdated + nTemplateNotified)
+        return false;
+    if (GetTime() - nTemplateTime > MAX_TEMPLATE_EXTEND_AGE)
+        return false;
+
+    // The new transactions only get the space the template left. When that
+    // leaves out a package paying more than one already selected, the block
+    // is built again so the better package can displace it.
+    addPriorityTxs(true);
+    addPackageTxs(true);
+    return !fOutbidLeftOut;
+}
+
+std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn)
+{
+    LOCK2(cs_main, mempool.cs);
+    CBlockIndex* pindexPrev = chainActive.Tip();
+    nHeight = pindexPrev->nHeight + 1;
+
+    int64_t nTimeStart = GetTimeMicros();
+    bool fExtended = ExtendTemplate(pindexPrev);
+    if (!fExtended) {
+        resetBlock();
+        nTemplateTime = GetTime();
+
+        pblocktemplate.reset(new CBlockTemplate());
+
+        if(!pblocktemplate.get())
+            return nullptr;
+        pblock = &pblocktemplate->block; // pointer for convenience
+
+        // Add dummy coinbase tx as first transaction
+        pblock->vtx.push_back(CTransaction());
+        pblocktemplate->vTxFees.push_back(-1); // updated at end
+        pblocktemplate->vTxSigOpsCost.push_back(-1); // updated at end
+
+        pblock->nVersion = ComputeBlockVersion(pindexPrev, chainparams.GetConsensus());
+        // -regtest only: allow overriding block.nVersion with
+        // -blockversion=N to test forking scenarios
+        if (chainparams.MineBlocksOnDemand())
+            pblock->nVersion = GetArg("-blockversion", pblock->nVersion);
+
+        pblock->nTime = GetAdjustedTime();
+        const int64_t nMedianTimePast = pindexPrev->GetMedianTimePast();
+
+        nLockTimeCutoff = (STANDARD_LOCKTIME_VERIFY_FLAGS & LOCKTIME_MEDIAN_TIME_PAST)
+                           ? nMedianTimePast
+                           : pblock->GetBlockTime();
+
+        // Decide whether to include witness transactions
+        // This is only needed in case the witness softfork activation is reverted
+        // (which would require a very deep reorganization) or when
+        // -promiscuousmempoolflags is used.
+        fIncludeWitness = IsWitnessEnabled(pindexPrev, chainparams.GetConsensus());
+
+        addPriorityTxs();
+        addPackageTxs();
+    }
+    // Not reusable until it passed TestBlockValidity below
+    pindexTemplatePrev = NULL;
+    LogPrint("bench", "    - %s template: %.2fms (%u txs)\n", fExtended ? "Extend" : "Build", (GetTimeMicros() - nTimeStart) * 0.001, nBlockTx);
+
+    nLastBlockTx = nBlockTx;
+    nLastBlockSize = nBlockSize;
+    nLastBlockWeight = nBlockWeight;
+
+    // Create coinbase transaction. The miner replaces its scriptSig with
+    // "<height> <extranonce> <signature>" before the block is submitted.
+    CMutableTransaction coinbaseTx;
+    coinbaseTx.vin.resize(1);
+    coinbaseTx.vin[0].prevout.SetNull();
+    coinbaseTx.vout.resize(1);
+    coinbaseTx.vout[0].scriptPubKey = scriptPubKeyIn;
+    coinbaseTx.vout[0].nValue = nFees + GetBlockSubsidy(nHeight, chainparams.GetConsensus());
+    coinbaseTx.vin[0].scriptSig = CScript() << nHeight << OP_0;
+    pblock->vtx[0] = coinbaseTx;
+    pblocktemplate->vchCoinbaseCommitment = GenerateCoinbaseCommitment(*pblock, pindexPrev, chainparams.GetConsensus());
+    pblocktemplate->vTxFees[0] = -nFees;
+
+    uint64_t nSerializeSize = GetSerializeSize(*pblock, SER_NETWORK, PROTOCOL_VERSION);
+    LogPrintf("CreateNewBlock(): total size: %u block weight: %u txs: %u fees: %ld sigops %d\n", nSerializeSize, GetBlockWeight(*pblock), nBlockTx, nFees, nBlockSigOpsCost);
+
+    // Fill in header
+    pblock->hashPrevBlock  = pindexPrev->GetBlockHash();
+    UpdateTime(pblock, chainparams.GetConsensus(), pindexPrev);
+    pblock->nBits          = GetNextWorkRequired(pindexPrev, pblock, chainparams.GetConsensus());
+    pblock->nNonce         = 0;
+    pblocktemplate->vTxSigOpsCost[0] = WITNESS_SCALE_FACTOR * GetLegacySigOpCount(pblock->vtx[0]);
+
+    // The coinbase is not signed yet, so the miner signature can't be checked here.
+    CValidationState state;
+    if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false, false)) {
+        throw std::runtime_error(strprintf("%s: TestBlockValidity failed: %s", __func__, FormatStateMessage(state)));
+    }
+
+    if (fTrackMempool) {
+        // Keep the template to extend it on the next call
+        pindexTemplatePrev = pindexPrev;
+        nTemplateTransactionsUpdated = mempool.GetTransactionsUpdated();
+        nTemplateNotified = 0;
+        fTemplateStale = false;
+        setAddedTx.clear();
+        return std::unique_ptr<CBlockTemplate>(new CBlockTemplate(*pblocktemplate));
+    }
+    return std::move(pblocktemplate);
 }
 
 bool BlockAssembler::isStillDependent(CTxMemPool::txiter iter)
@@ -321,7 +464,7 @@ void BlockAssembler::SortForBlock(const CTxMemPool::setEntries& package, CTxMemP
 // Each time through the loop, we compare the best transaction in
 // mapModifiedTxs with the next transaction in the mempool to decide what
 // transaction package to work on next.
-void BlockAssembler::addPackageTxs()
+void BlockAssembler::addPackageTxs(bool fOnlyAdded)
 {
     // mapModifiedTx will store sorted packages after they are modified
     // because some of their txs are already in the block
@@ -329,11 +472,35 @@ void BlockAssembler::addPackageTxs()
     // Keep track of entries that failed inclusion, to avoid duplicate work
     CTxMemPool::setEntries failedTx;
 
-    // Start by adding all descendants of previously added txs to mapModifiedTx
-    // and modifying them for their already included ancestors
-    UpdatePackagesForAdded(inBlock, mapModifiedTx);
-
     CTxMemPool::indexed_transaction_set::index<ancestor_score>::type::iterator mi = mempool.mapTx.get<ancestor_score>().begin();
+    if (fOnlyAdded) {
+        // Everything else in the mempool was already considered for this
+        // block, so only the new transactions are candidates. Their package
+        // state leaves out the ancestors already in the block.
+        BOOST_FOREACH(CTxMemPool::txiter it, setAddedTx) {
+            if (inBlock.count(it))
+                continue;
+            CTxMemPoolModifiedEntry modEntry(it);
+            CTxMemPool::setEntries ancestors;
+            uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+            std::string dummy;
+            mempool.CalculateMemPoolAncestors(*it, ancestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+            BOOST_FOREACH(CTxMemPool::txiter parent, ancestors) {
+                if (inBlock.count(parent)) {
+                    modEntry.nSizeWithAncestors -= parent->GetTxSize();
+                    modEntry.nModFeesWithAncestors -= parent->GetModifiedFee();
+                    modEntry.nSigOpCostWithAncestors -= parent->GetSigOpCost();
+                }
+            }
+            mapModifiedTx.insert(modEntry);
+        }
+        mi = mempool.mapTx.get<ancestor_score>().end();
+    } else {
+        // Start by adding all descendants of previously added txs to mapModifiedTx
+        // and modifying them for their already included ancestors
+        UpdatePackagesForAdded(inBlock, mapModifiedTx);
+    }
+
     CTxMemPool::txiter iter;
     while (mi != mempool.mapTx.get<ancestor_score>().end() || !mapModifiedTx.empty())
     {
@@ -389,6 +556,8 @@ void BlockAssembler::addPackageTxs()
         }
 
         if (!TestPackage(packageSize, packageSigOpsCost)) {
+            if (fOnlyAdded && CFeeRate(packageFees, packageSize) > minPackageFeeRate)
+                fOutbidLeftOut = true;
             if (fUsingModified) {
                 // Since we always look at the best entry in mapModifiedTx,
                 // we must erase failed entries so that we can consider the
@@ -425,13 +594,23 @@ void BlockAssembler::addPackageTxs()
             // Erase from the modified set, if present
             mapModifiedTx.erase(sortedEntries[i]);
         }
+        minPackageFeeRate = std::min(minPackageFeeRate, CFeeRate(packageFees, packageSize));
 
         // Update transactions that depend on each of these
         UpdatePackagesForAdded(ancestors, mapModifiedTx);
     }
 }
 
-void BlockAssembler::addPriorityTxs()
+/** Coin age priority of a mempool entry at nHeight, with prioritisetransaction deltas */
+static double GetModifiedPriority(CTxMemPool::txiter it, int nHeight)
+{
+    double dPriority = it->GetPriority(nHeight);
+    CAmount dummy;
+    mempool.ApplyDeltas(it->GetTx().GetHash(), dPriority, dummy);
+    return dPriority;
+}
+
+void BlockAssembler::addPriorityTxs(bool fOnlyAdded)
 {
     // How much of the block should be dedicated to high-priority transactions,
     // included regardless of the fees they pay
@@ -441,6 +620,9 @@ void BlockAssembler::addPriorityTxs()
     if (nBlockPrioritySize == 0) {
         return;
     }
+    if (fOnlyAdded && nBlockSize >= nBlockPrioritySize) {
+        return;
+    }
 
     bool fSizeAccounting = fNeedSizeAccounting;
     fNeedSizeAccounting = true;
@@ -452,14 +634,19 @@ void BlockAssembler::addPriorityTxs()
     typedef std::map<CTxMemPool::txiter, double, CTxMemPool::CompareIteratorByHash>::iterator waitPriIter;
     double actualPriority = -1;
 
-    vecPriority.reserve(mempool.mapTx.size());
-    for (CTxMemPool::indexed_transaction_set::iterator mi = mempool.mapTx.begin();
-         mi != mempool.mapTx.end(); ++mi)
-    {
-        double dPriority = mi->GetPriority(nHeight);
-        CAmount dummy;
-        mempool.ApplyDeltas(mi->GetTx().GetHash(), dPriority, dummy);
-        vecPriority.push_back(TxCoinAgePriority(dPriority, mi));
+    if (fOnlyAdded) {
+        vecPriority.reserve(setAddedTx.size());
+        BOOST_FOREACH(CTxMemPool::txiter it, setAddedTx) {
+            if (!inBlock.count(it))
+                vecPriority.push_back(TxCoinAgePriority(GetModifiedPriority(it, nHeight), it));
+        }
+    } else {
+        vecPriority.reserve(mempool.mapTx.size());
+        for (CTxMemPool::indexed_transaction_set::iterator mi = mempool.mapTx.begin();
+             mi != mempool.mapTx.end(); ++mi)
+        {
+            vecPriority.push_back(TxCoinAgePriority(GetModifiedPriority(mi, nHeight), mi));
+        }
     }
     std::make_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
 
@@ -480,6 +667,11 @@ void BlockAssembler::addPriorityTxs()
         if (!fIncludeWitness && !iter->GetTx().wit.IsNull())
             continue;
 
+        // The full build already took the last transaction below the
+        // AllowFree threshold, the rest are left to addPackageTxs
+        if (fOnlyAdded && !AllowFree(actualPriority))
+            break;
+
         // If tx is dependent on other mempool txs which haven't yet been included
         // then put it in the waitSet
         if (isStillDependent(iter)) {
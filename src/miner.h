@@ -14,6 +14,8 @@
 #include "boost/multi_index_container.hpp"
 #include "boost/multi_index/ordered_index.hpp"
 
+#include <boost/signals2/connection.hpp>
+
 class CBlockIndex;
 class CChainParams;
 class CReserveKey;
@@ -24,6 +26,8 @@ namespace Consensus { struct Params; };
 
 
 static const bool DEFAULT_PRINTPRIORITY = false;
+/** Seconds after which a tracked template is built from scratch instead of extended */
+static const int64_t MAX_TEMPLATE_EXTEND_AGE = 10;
 
 struct CBlockTemplate
 {
@@ -162,8 +166,29 @@ private:
     int lastFewTxs;
     bool blockFinished;
 
+    // State for extending the last template with the transactions that
+    // entered the mempool since it was built, guarded by mempool.cs
+    bool fTrackMempool;
+    const CBlockIndex* pindexTemplatePrev;
+    unsigned int nTemplateTransactionsUpdated;
+    unsigned int nTemplateNotified;
+    bool fTemplateStale;
+    int64_t nTemplateTime;
+    /** Lowest feerate of a package selected by addPackageTxs for this block */
+    CFeeRate minPackageFeeRate;
+    /** A new package didn't fit but pays more than minPackageFeeRate */
+    bool fOutbidLeftOut;
+    CTxMemPool::setEntries setAddedTx;
+    boost::signals2::connection connEntryAdded;
+    boost::signals2::connection connEntryRemoved;
+
 public:
-    BlockAssembler(const CChainParams& chainparams);
+    /** If fTrackMempool, follow mempool changes so later CreateNewBlock calls
+     *  on the same tip only have to select the new transactions */
+    BlockAssembler(const CChainParams& chainparams, bool fTrackMempool = false);
+    ~BlockAssembler();
+    /** Construct a new block template with coinbase to scriptPubKeyIn */
+    std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn);
 
 private:
     // utility functions
@@ -173,10 +198,19 @@ private:
     void AddToBlock(CTxMemPool::txiter iter);
 
     // Methods for how to add transactions to a block.
-    /** Add transactions based on tx "priority" */
-    void addPriorityTxs();
-    /** Add transactions based on feerate including unconfirmed ancestors */
-    void addPackageTxs();
+    /** Add transactions based on tx "priority".
+      * If fOnlyAdded, only transactions in setAddedTx are considered. */
+    void addPriorityTxs(bool fOnlyAdded = false);
+    /** Add transactions based on feerate including unconfirmed ancestors.
+      * If fOnlyAdded, only packages of transactions in setAddedTx are considered. */
+    void addPackageTxs(bool fOnlyAdded = false);
+
+    // mempool tracking
+    void EntryAdded(CTxMemPool::txiter it);
+    void EntryRemoved(CTxMemPool::txiter it);
+    /** Add the transactions that entered the mempool to the last template,
+      * returns false if it has to be rebuilt instead */
+    bool ExtendTemplate(const CBlockIndex* pindexPrev);
 
     // helper function for addPriorityTxs
     /** Test if tx will still "fit" in the block */
@@ -0,0 +1,170 @@
+// Copyright (c) 2014-2019 The Flashcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "muhash.h"
+
+#include "crypto/sha256.h"
+#include "crypto/sha512.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include <new>
+
+namespace {
+
+BIGNUM* NewBN()
+{
+    BIGNUM* bn = BN_new();
+    if (bn == NULL)
+        throw std::bad_alloc();
+    return bn;
+}
+
+/** The modulus 2^3072 - 1103717, the largest 3072-bit safe prime */
+class CMuHashModulus
+{
+public:
+    BIGNUM* p;
+    /** Only read after construction, so it is shared by all threads */
+    BN_MONT_CTX* mont;
+
+    CMuHashModulus() : p(NewBN()), mont(BN_MONT_CTX_new())
+    {
+        BN_CTX* ctx = BN_CTX_new();
+        if (mont == NULL || ctx == NULL)
+            throw std::bad_alloc();
+        BN_set_bit(p, 3072);
+        BN_sub_word(p, 1103717);
+        bool fOk = BN_MONT_CTX_set(mont, p, ctx);
+        BN_CTX_free(ctx);
+        if (!fOk)
+            throw std::bad_alloc();
+    }
+    ~CMuHashModulus()
+    {
+        BN_MONT_CTX_free(mont);
+        BN_free(p);
+    }
+};
+
+const CMuHashModulus& Modulus()
+{
+    static const CMuHashModulus modulus;
+    return modulus;
+}
+
+/** Write bn as BYTE_SIZE big-endian bytes */
+void WriteBytes(const BIGNUM* bn, unsigned char* out)
+{
+    size_t nBytes = BN_num_bytes(bn);
+    assert(nBytes <= MuHash3072::BYTE_SIZE);
+    memset(out, 0, MuHash3072::BYTE_SIZE - nBytes);
+    BN_bn2bin(bn, out + MuHash3072::BYTE_SIZE - nBytes);
+}
+
+BN_CTX* NewCTX()
+{
+    BN_CTX* ctx = BN_CTX_new();
+    if (ctx == NULL)
+        throw std::bad_alloc();
+    return ctx;
+}
+
+}
+
+MuHash3072::MuHash3072() : numerator(NewBN()), denominator(NewBN()), ctx(NewCTX()), element(NewBN())
+{
+    BN_one(numerator);
+    if (!BN_to_montgomery(numerator, numerator, Modulus().mont, ctx) || BN_copy(denominator, numerator) == NULL)
+        throw std::bad_alloc();
+}
+
+MuHash3072::MuHash3072(const MuHash3072& other) : numerator(NewBN()), denominator(NewBN()), ctx(NewCTX()), element(NewBN())
+{
+    *this = other;
+}
+
+MuHash3072& MuHash3072::operator=(const MuHash3072& other)
+{
+    if (BN_copy(numerator, other.numerator) == NULL || BN_copy(denominator, other.denominator) == NULL)
+        throw std::bad_alloc();
+    return *this;
+}
+
+MuHash3072::~MuHash3072()
+{
+    BN_free(element);
+    BN_CTX_free(ctx);
+    BN_free(numerator);
+    BN_free(denominator);
+}
+
+void MuHash3072::MultiplyElement(BIGNUM* target, const unsigned char* data, size_t len)
+{
+    unsigned char seed[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(data, len).Finalize(seed);
+    unsigned char buf[BYTE_SIZE];
+    for (unsigned char i = 0; i < BYTE_SIZE / CSHA512::OUTPUT_SIZE; i++)
+        CSHA512().Write(seed, sizeof(seed)).Write(&i, 1).Finalize(buf + i * CSHA512::OUTPUT_SIZE);
+
+    const CMuHashModulus& modulus = Modulus();
+    // Montgomery multiplication wants reduced operands
+    if (BN_bin2bn(buf, sizeof(buf), element) == NULL ||
+        (BN_cmp(element, modulus.p) >= 0 && !BN_sub(element, element, modulus.p)) ||
+        !BN_to_montgomery(element, element, modulus.mont, ctx) ||
+        !BN_mod_mul_montgomery(target, target, element, modulus.mont, ctx))
+        throw std::bad_alloc();
+}
+
+MuHash3072& MuHash3072::Insert(const unsigned char* data, size_t len)
+{
+    MultiplyElement(numerator, data, len);
+    return *this;
+}
+
+MuHash3072& MuHash3072::Remove(const unsigned char* data, size_t len)
+{
+    MultiplyElement(denominator, data, len);
+    return *this;
+}
+
+MuHash3072& MuHash3072::Combine(const MuHash3072& other)
+{
+    const CMuHashModulus& modulus = Modulus();
+    if (!BN_mod_mul_montgomery(numerator, numerator, other.numerator, modulus.mont, ctx) ||
+        !BN_mod_mul_montgomery(denominator, denominator, other.denominator, modulus.mont, ctx))
+        throw std::bad_alloc();
+    return *this;
+}
+
+uint256 MuHash3072::Finalize() const
+{
+    // With n and d in Montgomery form, (nR) * (dR)^-1 is already n / d
+    const CMuHashModulus& modulus = Modulus();
+    BIGNUM* inverse = BN_mod_inverse(NULL, denominator, modulus.p, ctx);
+    bool fOk = inverse != NULL && BN_mod_mul(element, numerator, inverse, modulus.p, ctx);
+    BN_free(inverse);
+    if (!fOk)
+        throw std::bad_alloc();
+
+    unsigned char buf[BYTE_SIZE];
+    WriteBytes(element, buf);
+    uint256 hash;
+    CSHA256().Write(buf, sizeof(buf)).Finalize(hash.begin());
+    return hash;
+}
+
+void MuHash3072::Export(const BIGNUM* bn, unsigned char* out) const
+{
+    if (!BN_from_montgomery(element, bn, Modulus().mont, ctx))
+        throw std::bad_alloc();
+    WriteBytes(element, out);
+}
+
+void MuHash3072::Import(const unsigned char* in, BIGNUM* bn)
+{
+    if (BN_bin2bn(in, BYTE_SIZE, bn) == NULL || !BN_to_montgomery(bn, bn, Modulus().mont, ctx))
+        throw std::bad_alloc();
+}
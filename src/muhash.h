@@ -0,0 +1,91 @@
+// Copyright (c) 2014-2019 The Flashcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_MUHASH_H
+#define BITCOIN_MUHASH_H
+
+#include "uint256.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include <openssl/bn.h>
+
+/**
+ * Rolling hash of a set of byte strings, as in "Incremental Multiset Hash
+ * Functions" (Clarke et al.) and Bitcoin Core's MuHash3072.
+ *
+ * Every element is mapped to a number modulo the prime 2^3072 - 1103717, and
+ * the set hash is the product of the numbers of its elements. Elements can be
+ * added and removed in any order: the result only depends on the set. Removals
+ * are multiplied into a separate denominator, so the expensive inverse is only
+ * needed in Finalize().
+ *
+ * Both are kept in Montgomery form, so each element costs one conversion and
+ * one Montgomery multiplication instead of a full division by the modulus.
+ *
+ * Elements are expanded to 3072 bits with SHA512 in counter mode over the
+ * SHA256 of their data, so the digests differ from Bitcoin Core's.
+ */
+class MuHash3072
+{
+public:
+    static const size_t BYTE_SIZE = 384;
+
+    /** The hash of the empty set */
+    MuHash3072();
+    MuHash3072(const MuHash3072& other);
+    MuHash3072& operator=(const MuHash3072& other);
+    ~MuHash3072();
+
+    MuHash3072& Insert(const unsigned char* data, size_t len);
+    MuHash3072& Remove(const unsigned char* data, size_t len);
+    MuHash3072& Insert(const std::vector<unsigned char>& data) { return Insert(data.data(), data.size()); }
+    MuHash3072& Remove(const std::vector<unsigned char>& data) { return Remove(data.data(), data.size()); }
+    /** Add all elements of other, which must not share any with this set */
+    MuHash3072& Combine(const MuHash3072& other);
+
+    /** SHA256 of the set hash, normalized to a single number */
+    uint256 Finalize() const;
+
+    size_t GetSerializeSize(int nType, int nVersion) const { return 2 * BYTE_SIZE; }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        unsigned char buf[2 * BYTE_SIZE];
+        Export(numerator, buf);
+        Export(denominator, buf + BYTE_SIZE);
+        s.write((const char*)buf, sizeof(buf));
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        unsigned char buf[2 * BYTE_SIZE];
+        s.read((char*)buf, sizeof(buf));
+        Import(buf, numerator);
+        Import(buf + BYTE_SIZE, denominator);
+    }
+
+private:
+    /** Both in Montgomery form */
+    BIGNUM* numerator;
+    BIGNUM* denominator;
+    /** Scratch space for the operations on this object */
+    BN_CTX* ctx;
+    BIGNUM* element;
+
+    /** Multiply the number of an element into target */
+    void MultiplyElement(BIGNUM* target, const unsigned char* data, size_t len);
+
+    /** Write bn out of Montgomery form as BYTE_SIZE big-endian bytes */
+    void Export(const BIGNUM* bn, unsigned char* out) const;
+    /** Read BYTE_SIZE big-endian bytes into bn in Montgomery form */
+    void Import(const unsigned char* in, BIGNUM* bn);
+};
+
+#endif // BITCOIN_MUHASH_H
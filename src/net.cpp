@@ -16,8 +16,10 @@
 #include "crypto/common.h"
 #include "crypto/sha256.h"
 #include "hash.h"
+#include "netpoll.h"
 #include "primitives/transaction.h"
 #include "scheduler.h"
+#include "support/cleanse.h"
 #include "ui_interface.h"
 #include "utilstrencodings.h"
 
@@ -45,6 +47,17 @@
 // We add a random period time (0 to 1 seconds) to feeler connections to prevent synchronization.
 #define FEELER_SLEEP_WINDOW 1
 
+// Longest wait of the socket handler for socket events, in milliseconds
+#define SOCKET_WAIT_MS 50
+
+// Receive buffers are allocated at most this far ahead of the message data actually received
+static const unsigned int RECV_ALLOC_AHEAD = 256 * 1024;
+// Small receive buffers are all this large, so that they can be reused for any small message
+static const unsigned int MIN_RECV_BUFFER = 1024;
+// Limits of the pool of receive buffers kept for reuse
+static const size_t MAX_POOLED_RECV_BUFFERS = 256;
+static const size_t MAX_POOLED_RECV_BYTES = 16 * 1024 * 1024;
+
 #if !defined(HAVE_MSG_NOSIGNAL) && !defined(MSG_NOSIGNAL)
 #define MSG_NOSIGNAL 0
 #endif
@@ -83,6 +96,7 @@ ServiceFlags nRelevantServices = NODE_NETWORK;
 //
 bool fDiscover = true;
 bool fListen = true;
+bool fSocketPoll = false;
 ServiceFlags nLocalServices = NODE_NETWORK;
 bool fRelayTxes = true;
 CCriticalSection cs_mapLocalHost;
@@ -96,6 +110,8 @@ int nMaxConnections = DEFAULT_MAX_PEER_CONNECTIONS;
 bool fAddressesInitialized = false;
 std::string strSubVersion;
 
+static CRecvBufferPool recvBufferPool(MAX_POOLED_RECV_BUFFERS, MAX_POOLED_RECV_BYTES);
+
 std::vector<CNode*> vNodes;
 CCriticalSection cs_vNodes;
 limitedmap<uint256, int64_t> mapAlreadyAskedFor(MAX_INV_SZ);
@@ -110,7 +126,9 @@ NodeId nLastNodeId = 0;
 CCriticalSection cs_nLastNodeId;
 
 static CSemaphore *semOutbound = NULL;
+static CSocketWakeup *pSocketWakeup = NULL;
 boost::condition_variable messageHandlerCondition;
+static boost::condition_variable parallelMessageHandlerCondition;
 
 // Signals for message handling
 static CNodeSignals g_signals;
@@ -408,7 +426,7 @@ CNode* ConnectNode(CAddress addrConnect, const char *pszDest, bool fCountFailure
     if (pszDest ? ConnectSocketByName(addrConnect, hSocket, pszDest, Params().GetDefaultPort(), nConnectTimeout, &proxyConnectionFailed) :
                   ConnectSocket(addrConnect, hSocket, nConnectTimeout, &proxyConnectionFailed))
     {
-        if (!IsSelectableSocket(hSocket)) {
+        if (!fSocketPoll && !IsSelectableSocket(hSocket)) {
             LogPrintf("Cannot create connection: non-selectable socket created (fd >= FD_SETSIZE ?)\n");
             CloseSocket(hSocket);
             return NULL;
@@ -448,6 +466,9 @@ CNode* ConnectNode(CAddress addrConnect, const char *pszDest, bool fCountFailure
         pnode->nServicesExpected = ServiceFlags(addrConnect.nServices & nRelevantServices);
         pnode->nTimeConnected = GetTime();
 
+        // Have the socket handler watch the new socket right away
+        WakeSocketHandler();
+
         return pnode;
     } else if (!proxyConnectionFailed) {
         // If connecting to the node failed, and failure is not caused by a problem connecting to
@@ -729,7 +750,7 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes)
         // get current incomplete message, or create a new one
         if (vRecvMsg.empty() ||
             vRecvMsg.back().complete())
-            vRecvMsg.push_back(CNetMessage(Params().MessageStart(), SER_NETWORK, nRecvVersion));
+            vRecvMsg.emplace_back(Params().MessageStart(), SER_NETWORK, nRecvVersion);
 
         CNetMessage& msg = vRecvMsg.back();
 
@@ -763,28 +784,37 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes)
 
             msg.nTime = GetTimeMicros();
             messageHandlerCondition.notify_one();
+            parallelMessageHandlerCondition.notify_one();
         }
     }
 
     return true;
 }
 
+CNetMessage::~CNetMessage()
+{
+    CSerializeData vch;
+    vRecv.SwapBuffer(vch);
+    recvBufferPool.Put(vch);
+}
+
 int CNetMessage::readHeader(const char *pch, unsigned int nBytes)
 {
     // copy data to temporary parsing buffer
-    unsigned int nRemaining = 24 - nHdrPos;
+    unsigned int nRemaining = sizeof(hdrbuf) - nHdrPos;
     unsigned int nCopy = std::min(nRemaining, nBytes);
 
     memcpy(&hdrbuf[nHdrPos], pch, nCopy);
     nHdrPos += nCopy;
 
     // if header incomplete, exit
-    if (nHdrPos < 24)
+    if (nHdrPos < sizeof(hdrbuf))
         return nCopy;
 
     // deserialize to CMessageHeader
     try {
-        hdrbuf >> hdr;
+        CMemoryReader reader(hdrbuf, sizeof(hdrbuf), vRecv.GetType(), vRecv.GetVersion());
+        reader >> hdr;
     }
     catch (const std::exception&) {
         return -1;
@@ -797,6 +827,13 @@ int CNetMessage::readHeader(const char *pch, unsigned int nBytes)
     // switch state to reading message data
     in_data = true;
 
+    // Take a buffer for the data from the pool, sized for the whole message
+    // unless that is more than we allocate ahead of the data actually received
+    CSerializeData vch;
+    recvBufferPool.Get(vch, std::max(MIN_RECV_BUFFER, std::min(hdr.nMessageSize, RECV_ALLOC_AHEAD)));
+    vRecv.SwapBuffer(vch);
+    recvBufferPool.Put(vch);
+
     return nCopy;
 }
 
@@ -806,8 +843,8 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
     unsigned int nCopy = std::min(nRemaining, nBytes);
 
     if (vRecv.size() < nDataPos + nCopy) {
-        // Allocate up to 256 KiB ahead, but never more than the total message size.
-        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
+        // Allocate up to RECV_ALLOC_AHEAD ahead, but never more than the total message size.
+        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + RECV_ALLOC_AHEAD));
     }
 
     memcpy(&vRecv[nDataPos], pch, nCopy);
@@ -816,6 +853,72 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
     return nCopy;
 }
 
+CRecvBufferPool::CRecvBufferPool(size_t nMaxBuffersIn, size_t nMaxBytesIn) :
+    nMaxBuffers(nMaxBuffersIn), nMaxBytes(nMaxBytesIn), nPooledBytes(0), nAllocations(0), nReuses(0)
+{
+    vPool.reserve(nMaxBuffers);
+}
+
+void CRecvBufferPool::Get(CSerializeData& vch, size_t nSize)
+{
+    CSerializeData().swap(vch);
+    {
+        LOCK(cs);
+        // The smallest buffer that is large enough
+        size_t nBest = vPool.size();
+        for (size_t i = 0; i < vPool.size(); i++) {
+            if (vPool[i].capacity() >= nSize && (nBest == vPool.size() || vPool[i].capacity() < vPool[nBest].capacity()))
+                nBest = i;
+        }
+        if (nBest != vPool.size()) {
+            nPooledBytes -= vPool[nBest].capacity();
+            vch.swap(vPool[nBest]);
+            vPool[nBest].swap(vPool.back());
+            vPool.pop_back();
+            nReuses++;
+            return;
+        }
+        nAllocations++;
+    }
+    vch.reserve(nSize);
+}
+
+void CRecvBufferPool::Put(CSerializeData& vch)
+{
+    if (vch.capacity() == 0)
+        return;
+    if (!vch.empty())
+        memory_cleanse(&vch[0], vch.size());
+    vch.clear();
+    {
+        LOCK(cs);
+        if (vPool.size() < nMaxBuffers && nPooledBytes + vch.capacity() <= nMaxBytes) {
+            nPooledBytes += vch.capacity();
+            vPool.push_back(CSerializeData());
+            vPool.back().swap(vch);
+            return;
+        }
+    }
+    // No room to keep it
+    CSerializeData().swap(vch);
+}
+
+CRecvBufferPool::Stats CRecvBufferPool::GetStats() const
+{
+    LOCK(cs);
+    Stats stats;
+    stats.nAllocations = nAllocations;
+    stats.nReuses = nReuses;
+    stats.nPooled = vPool.size();
+    stats.nPooledBytes = nPooledBytes;
+    return stats;
+}
+
+CRecvBufferPool::Stats GetRecvBufferStats()
+{
+    return recvBufferPool.GetStats();
+}
+
 
 
 
@@ -1043,7 +1146,7 @@ static void AcceptConnection(const ListenSocket& hListenSocket) {
         return;
     }
 
-    if (!IsSelectableSocket(hSocket))
+    if (!fSocketPoll && !IsSelectableSocket(hSocket))
     {
         LogPrintf("connection from %s dropped: non-selectable socket\n", addr.ToString());
         CloseSocket(hSocket);
@@ -1088,9 +1191,68 @@ static void AcceptConnection(const ListenSocket& hListenSocket) {
     }
 }
 
+void WakeSocketHandler()
+{
+    if (pSocketWakeup)
+        pSocketWakeup->Wake();
+}
+
+// Implement the following logic:
+// * If there is data to send, wait for sending data. As this only
+//   happens when optimistic write failed, we choose to first drain the
+//   write buffer in this case before receiving more. This avoids
+//   needlessly queueing received data, if the remote peer is not themselves
+//   receiving data. This means properly utilizing TCP flow control signalling.
+// * Otherwise, if there is no (complete) message in the receive buffer,
+//   or there is space left in the buffer, wait for receiving data.
+// * (if neither of the above applies, there is certainly one message
+//   in the receiver buffer ready to be processed).
+// Together, that means that at least one of the following is always possible,
+// so we don't deadlock:
+// * We send some data.
+// * We wait for data to be received (and disconnect after timeout).
+// * We process a message in the buffer (message handler thread).
+static void GetSocketInterest(CNode* pnode, bool& fWantRecv, bool& fWantSend)
+{
+    fWantRecv = false;
+    fWantSend = false;
+    {
+        TRY_LOCK(pnode->cs_vSend, lockSend);
+        if (lockSend && !pnode->vSendMsg.empty()) {
+            fWantSend = true;
+            return;
+        }
+    }
+    {
+        TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+        fWantRecv = lockRecv && (
+            pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
+            pnode->GetTotalRecvSize() <= ReceiveFloodSize());
+    }
+}
+
 void ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
+
+    // Sockets are registered with the poller once, instead of being put into
+    // fd_sets on every pass; without one, select() is used
+    CSocketPoller poller;
+    std::vector<CSocketPoller::Event> vPollEvents;
+    bool fPollMoreWork = false;
+    if (fSocketPoll)
+    {
+        bool fPollReady = poller.IsValid();
+        BOOST_FOREACH(ListenSocket& hListenSocket, vhListenSocket)
+            fPollReady = fPollReady && poller.AddLevel(hListenSocket.socket, &hListenSocket);
+        if (pSocketWakeup->IsValid())
+            fPollReady = fPollReady && poller.AddLevel(pSocketWakeup->GetSocket(), pSocketWakeup);
+        if (!fPollReady) {
+            LogPrintf("socket poller unavailable (%s), falling back to select()\n", NetworkErrorString(WSAGetLastError()));
+            fSocketPoll = false;
+        }
+    }
+
     while (true)
     {
         //
@@ -1159,99 +1321,147 @@ void ThreadSocketHandler()
         //
         // Find which sockets have data to receive
         //
-        struct timeval timeout;
-        timeout.tv_sec  = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
         fd_set fdsetRecv;
         fd_set fdsetSend;
         fd_set fdsetError;
         FD_ZERO(&fdsetRecv);
         FD_ZERO(&fdsetSend);
         FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
-        BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = std::max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
 
+        if (fSocketPoll)
         {
-            LOCK(cs_vNodes);
-            BOOST_FOREACH(CNode* pnode, vNodes)
+            // Register the sockets of new connections, after that the poller keeps
+            // track of them until they are closed
             {
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = std::max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
-                // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
-                //   happens when optimistic write failed, we choose to first drain the
-                //   write buffer in this case before receiving more. This avoids
-                //   needlessly queueing received data, if the remote peer is not themselves
-                //   receiving data. This means properly utilizing TCP flow control signalling.
-                // * Otherwise, if there is no (complete) message in the receive buffer,
-                //   or there is space left in the buffer, select() for receiving data.
-                // * (if neither of the above applies, there is certainly one message
-                //   in the receiver buffer ready to be processed).
-                // Together, that means that at least one of the following is always possible,
-                // so we don't deadlock:
-                // * We send some data.
-                // * We wait for data to be received (and disconnect after timeout).
-                // * We process a message in the buffer (message handler thread).
+                LOCK(cs_vNodes);
+                BOOST_FOREACH(CNode* pnode, vNodes)
                 {
-                    TRY_LOCK(pnode->cs_vSend, lockSend);
-                    if (lockSend && !pnode->vSendMsg.empty()) {
-                        FD_SET(pnode->hSocket, &fdsetSend);
+                    if (pnode->fPollRegistered || pnode->hSocket == INVALID_SOCKET)
+                        continue;
+                    pnode->fPollRegistered = true;
+                    if (!poller.AddEdge(pnode->hSocket, pnode)) {
+                        LogPrintf("socket poll registration failed: %s\n", NetworkErrorString(WSAGetLastError()));
+                        pnode->fDisconnect = true;
                         continue;
                     }
+                    // Try both ways until the socket would block, only then wait for an edge
+                    pnode->fPollRecv = true;
+                    pnode->fPollSend = true;
+                }
+            }
+
+            // Don't sleep while a socket is known to have more data buffered
+            if (!poller.Wait(fPollMoreWork ? 0 : SOCKET_WAIT_MS, vPollEvents))
+            {
+                LogPrintf("socket poll error %s\n", NetworkErrorString(WSAGetLastError()));
+                MilliSleep(SOCKET_WAIT_MS);
+            }
+            boost::this_thread::interruption_point();
+
+            BOOST_FOREACH(const CSocketPoller::Event& event, vPollEvents)
+            {
+                if (event.ctx == pSocketWakeup) {
+                    pSocketWakeup->Drain();
+                    continue;
                 }
+                bool fListenSocket = false;
+                BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
                 {
-                    TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                    if (lockRecv && (
-                        pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
-                        pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
-                        FD_SET(pnode->hSocket, &fdsetRecv);
+                    if (event.ctx == &hListenSocket) {
+                        AcceptConnection(hListenSocket);
+                        fListenSocket = true;
+                        break;
+                    }
                 }
+                if (fListenSocket)
+                    continue;
+                // Nodes are only deleted by this thread after their socket was closed,
+                // which takes it out of the poller, so the pointer is still good
+                CNode* pnode = static_cast<CNode*>(event.ctx);
+                if (event.fRecv)
+                    pnode->fPollRecv = true;
+                if (event.fSend)
+                    pnode->fPollSend = true;
             }
         }
+        else
+        {
+            struct timeval timeout;
+            timeout.tv_sec  = 0;
+            timeout.tv_usec = SOCKET_WAIT_MS * 1000; // frequency to poll pnode->vSend
 
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
-        boost::this_thread::interruption_point();
+            SOCKET hSocketMax = 0;
+            bool have_fds = false;
+
+            BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
+                FD_SET(hListenSocket.socket, &fdsetRecv);
+                hSocketMax = std::max(hSocketMax, hListenSocket.socket);
+                have_fds = true;
+            }
+
+            if (pSocketWakeup->IsValid() && IsSelectableSocket(pSocketWakeup->GetSocket())) {
+                FD_SET(pSocketWakeup->GetSocket(), &fdsetRecv);
+                hSocketMax = std::max(hSocketMax, pSocketWakeup->GetSocket());
+                have_fds = true;
+            }
 
-        if (nSelect == SOCKET_ERROR)
-        {
-            if (have_fds)
             {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
+                LOCK(cs_vNodes);
+                BOOST_FOREACH(CNode* pnode, vNodes)
+                {
+                    if (pnode->hSocket == INVALID_SOCKET)
+                        continue;
+                    FD_SET(pnode->hSocket, &fdsetError);
+                    hSocketMax = std::max(hSocketMax, pnode->hSocket);
+                    have_fds = true;
+
+                    bool fWantRecv, fWantSend;
+                    GetSocketInterest(pnode, fWantRecv, fWantSend);
+                    if (fWantSend)
+                        FD_SET(pnode->hSocket, &fdsetSend);
+                    if (fWantRecv)
+                        FD_SET(pnode->hSocket, &fdsetRecv);
+                }
             }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            MilliSleep(timeout.tv_usec/1000);
-        }
 
-        //
-        // Accept new connections
-        //
-        BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
-        {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
+            int nSelect = select(have_fds ? hSocketMax + 1 : 0,
+                                 &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+            boost::this_thread::interruption_point();
+
+            if (nSelect == SOCKET_ERROR)
             {
-                AcceptConnection(hListenSocket);
+                if (have_fds)
+                {
+                    int nErr = WSAGetLastError();
+                    LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+                    for (unsigned int i = 0; i <= hSocketMax; i++)
+                        FD_SET(i, &fdsetRecv);
+                }
+                FD_ZERO(&fdsetSend);
+                FD_ZERO(&fdsetError);
+                MilliSleep(timeout.tv_usec/1000);
+            }
+
+            if (pSocketWakeup->IsValid() && IsSelectableSocket(pSocketWakeup->GetSocket()) &&
+                FD_ISSET(pSocketWakeup->GetSocket(), &fdsetRecv))
+                pSocketWakeup->Drain();
+
+            //
+            // Accept new connections
+            //
+            BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
+            {
+                if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
+                {
+                    AcceptConnection(hListenSocket);
+                }
             }
         }
 
         //
         // Service each socket
         //
+        fPollMoreWork = false;
         std::vector<CNode*> vNodesCopy;
         {
             LOCK(cs_vNodes);
@@ -1263,12 +1473,31 @@ void ThreadSocketHandler()
         {
             boost::this_thread::interruption_point();
 
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+            bool fRecv = false;
+            bool fSend = false;
+            if (fSocketPoll)
+            {
+                // Idle peers are skipped without taking their locks
+                if (pnode->fPollRecv || (pnode->fPollSend && pnode->nSendSize > 0))
+                {
+                    bool fWantRecv, fWantSend;
+                    GetSocketInterest(pnode, fWantRecv, fWantSend);
+                    fRecv = fWantRecv && pnode->fPollRecv;
+                    fSend = fWantSend && pnode->fPollSend;
+                }
+            }
+            else
+            {
+                fRecv = FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError);
+                fSend = FD_ISSET(pnode->hSocket, &fdsetSend);
+            }
+
             //
             // Receive
             //
-            if (pnode->hSocket == INVALID_SOCKET)
-                continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError))
+            if (fRecv)
             {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
                 if (lockRecv)
@@ -1284,6 +1513,11 @@ void ThreadSocketHandler()
                             pnode->nLastRecv = GetTime();
                             pnode->nRecvBytes += nBytes;
                             pnode->RecordBytesRecv(nBytes);
+                            // A short read drained the socket, a full one probably did not
+                            if (nBytes < (int)sizeof(pchBuf))
+                                pnode->fPollRecv = false;
+                            else
+                                fPollMoreWork = true;
                         }
                         else if (nBytes == 0)
                         {
@@ -1302,6 +1536,7 @@ void ThreadSocketHandler()
                                     LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
                                 pnode->CloseSocketDisconnect();
                             }
+                            pnode->fPollRecv = false;
                         }
                     }
                 }
@@ -1312,11 +1547,16 @@ void ThreadSocketHandler()
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetSend))
+            if (fSend)
             {
                 TRY_LOCK(pnode->cs_vSend, lockSend);
                 if (lockSend)
+                {
                     SocketSendData(pnode);
+                    // Anything left over did not fit into the socket buffer, wait to be told there is room
+                    if (!pnode->vSendMsg.empty())
+                        pnode->fPollSend = false;
+                }
             }
 
             //
@@ -1872,13 +2112,22 @@ void ThreadMessageHandler()
             if (pnode->fDisconnect)
                 continue;
 
+            // A parallel handler is working on this peer and wakes us once it is done with it
+            TRY_LOCK(pnode->cs_msgHandler, lockHandler);
+            if (!lockHandler)
+                continue;
+
             // Receive messages
             {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
                 if (lockRecv)
                 {
-                    if (!GetNodeSignals().ProcessMessages(pnode))
+                    bool fRecvFull = pnode->GetTotalRecvSize() > ReceiveFloodSize();
+                    if (!GetNodeSignals().ProcessMessages(pnode, false))
                         pnode->CloseSocketDisconnect();
+                    // Receiving from this peer was paused, resume it without waiting for the socket handler's timeout
+                    if (fRecvFull && pnode->GetTotalRecvSize() <= ReceiveFloodSize())
+                        WakeSocketHandler();
 
                     if (pnode->nSendSize < SendBufferSize())
                     {
@@ -1911,6 +2160,73 @@ void ThreadMessageHandler()
     }
 }
 
+/**
+ * Helper of the main message handler: takes the messages that do not need
+ * cs_main off any peer the main handler is not working on, so that these keep
+ * flowing while it is busy with e.g. a block. A peer is only ever worked on by
+ * one handler at a time, and a parallel handler stops at the first message it
+ * cannot handle, so messages of a peer are still handled in the order received.
+ */
+void ThreadParallelMessageHandler()
+{
+    boost::mutex condition_mutex;
+    boost::unique_lock<boost::mutex> lock(condition_mutex);
+
+    while (true)
+    {
+        std::vector<CNode*> vNodesCopy;
+        {
+            LOCK(cs_vNodes);
+            vNodesCopy = vNodes;
+            BOOST_FOREACH(CNode* pnode, vNodesCopy) {
+                pnode->AddRef();
+            }
+        }
+
+        bool fSleep = true;
+
+        BOOST_FOREACH(CNode* pnode, vNodesCopy)
+        {
+            if (pnode->fDisconnect)
+                continue;
+
+            size_t nMessages;
+            {
+                TRY_LOCK(pnode->cs_msgHandler, lockHandler);
+                if (!lockHandler)
+                    continue;
+                TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+                if (!lockRecv)
+                    continue;
+
+                nMessages = pnode->vRecvMsg.size();
+                bool fRecvFull = pnode->GetTotalRecvSize() > ReceiveFloodSize();
+                if (!GetNodeSignals().ProcessMessages(pnode, true))
+                    pnode->CloseSocketDisconnect();
+                if (fRecvFull && pnode->GetTotalRecvSize() <= ReceiveFloodSize())
+                    WakeSocketHandler();
+                // Made progress, this peer may have more
+                if (pnode->vRecvMsg.size() < nMessages)
+                    fSleep = false;
+            }
+            // The main handler skips a peer while it is held here, have it come back to the
+            // remaining messages and to sending without waiting for its timeout
+            if (nMessages > 0)
+                messageHandlerCondition.notify_one();
+            boost::this_thread::interruption_point();
+        }
+
+        {
+            LOCK(cs_vNodes);
+            BOOST_FOREACH(CNode* pnode, vNodesCopy)
+                pnode->Release();
+        }
+
+        if (fSleep)
+            parallelMessageHandlerCondition.timed_wait(lock, boost::posix_time::microsec_clock::universal_time() + boost::posix_time::milliseconds(100));
+    }
+}
+
 
 
 
@@ -2109,6 +2425,9 @@ void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler)
         semOutbound = new CSemaphore(nMaxOutbound);
     }
 
+    if (pSocketWakeup == NULL)
+        pSocketWakeup = new CSocketWakeup();
+
     if (pnodeLocalHost == NULL)
         pnodeLocalHost = new CNode(INVALID_SOCKET, CAddress(CService("127.0.0.1", 0), nLocalServices));
 
@@ -2138,6 +2457,11 @@ void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler)
     // Process messages
     threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "msghand", &ThreadMessageHandler));
 
+    // Handle trivial messages while the main message handler is busy
+    int nParallelThreads = std::max(0, std::min((int)GetArg("-msghandlerthreads", DEFAULT_MESSAGE_HANDLER_THREADS), MAX_MESSAGE_HANDLER_THREADS));
+    for (int i = 0; i < nParallelThreads; i++)
+        threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "msgpar", &ThreadParallelMessageHandler));
+
     // Dump network addresses
     scheduler.scheduleEvery(&DumpData, DUMP_ADDRESSES_INTERVAL);
 }
@@ -2185,6 +2509,8 @@ public:
         vhListenSocket.clear();
         delete semOutbound;
         semOutbound = NULL;
+        delete pSocketWakeup;
+        pSocketWakeup = NULL;
         delete pnodeLocalHost;
         pnodeLocalHost = NULL;
 
@@ -2492,6 +2818,9 @@ CNode::CNode(SOCKET hSocketIn, const CAddress& addrIn, const std::string& addrNa
     nRefCount = 0;
     nSendSize = 0;
     nSendOffset = 0;
+    fPollRegistered = false;
+    fPollRecv = false;
+    fPollSend = false;
     hashContinue = uint256();
     nStartingHeight = -1;
     filterInventoryKnown.reset();
@@ -2637,8 +2966,12 @@ void CNode::EndMessage(const char* pszCommand) UNLOCK_FUNCTION(cs_vSend)
     nSendSize += (*it).size();
 
     // If write queue empty, attempt "optimistic write"
-    if (it == vSendMsg.begin())
+    if (it == vSendMsg.begin()) {
         SocketSendData(this);
+        // The socket handler was not waiting to send to this peer, let it know there is something left
+        if (!vSendMsg.empty())
+            WakeSocketHandler();
+    }
 
     LEAVE_CRITICAL_SECTION(cs_vSend);
 }
@@ -63,6 +63,8 @@ bool BindListenPort(const CService &bindAddr, std::string& strError, bool fWhite
 void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler);
 bool StopNode();
 void SocketSendData(CNode *pnode);
+/** Interrupt the socket handler's wait for socket events */
+void WakeSocketHandler();
 
 struct CombinerAll
 {
@@ -83,7 +85,8 @@ struct CombinerAll
 struct CNodeSignals
 {
     boost::signals2::signal<int ()> GetHeight;
-    boost::signals2::signal<bool (CNode*), CombinerAll> ProcessMessages;
+    /** The flag limits processing to messages that can be handled in parallel with the main message handler */
+    boost::signals2::signal<bool (CNode*, bool), CombinerAll> ProcessMessages;
     boost::signals2::signal<bool (CNode*), CombinerAll> SendMessages;
     boost::signals2::signal<void (NodeId, const CNode*)> InitializeNode;
     boost::signals2::signal<void (NodeId)> FinalizeNode;
@@ -122,6 +125,8 @@ CAddress GetLocalAddress(const CNetAddr *paddrPeer = NULL);
 
 extern bool fDiscover;
 extern bool fListen;
+/** Whether the socket handler watches peer sockets with a CSocketPoller instead of select() */
+extern bool fSocketPoll;
 extern ServiceFlags nLocalServices;
 extern ServiceFlags nRelevantServices;
 extern bool fRelayTxes;
@@ -182,26 +187,64 @@ public:
 
 
 
+/**
+ * Pool of receive buffers, so that at high message rates the buffers of
+ * processed messages are reused instead of going back to the allocator.
+ * Buffers are wiped when they are returned, as the zero_after_free allocator
+ * would do when freeing them.
+ */
+class CRecvBufferPool
+{
+public:
+    struct Stats
+    {
+        uint64_t nAllocations; // buffers allocated because none in the pool was large enough
+        uint64_t nReuses;      // buffers handed out from the pool
+        uint64_t nPooled;      // buffers in the pool now
+        uint64_t nPooledBytes; // their total capacity
+    };
+
+    CRecvBufferPool(size_t nMaxBuffersIn, size_t nMaxBytesIn);
+
+    /** Replace vch with an empty buffer that can hold at least nSize bytes */
+    void Get(CSerializeData& vch, size_t nSize);
+    /** Take back the buffer of vch, leaving it empty */
+    void Put(CSerializeData& vch);
+    Stats GetStats() const;
+
+private:
+    mutable CCriticalSection cs;
+    std::vector<CSerializeData> vPool;
+    size_t nMaxBuffers;
+    size_t nMaxBytes;
+    size_t nPooledBytes;
+    uint64_t nAllocations;
+    uint64_t nReuses;
+};
+
+/** Receive buffer statistics, for getnettotals */
+CRecvBufferPool::Stats GetRecvBufferStats();
+
 class CNetMessage {
 public:
     bool in_data;                   // parsing header (false) or data (true)
 
-    CDataStream hdrbuf;             // partially received header
+    char hdrbuf[CMessageHeader::HEADER_SIZE]; // partially received header
     CMessageHeader hdr;             // complete header
     unsigned int nHdrPos;
 
-    CDataStream vRecv;              // received message data
+    CDataStream vRecv;              // received message data, in a buffer from the receive buffer pool
     unsigned int nDataPos;
 
     int64_t nTime;                  // time (in microseconds) of message receipt.
 
-    CNetMessage(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nTypeIn, int nVersionIn) : hdrbuf(nTypeIn, nVersionIn), hdr(pchMessageStartIn), vRecv(nTypeIn, nVersionIn) {
-        hdrbuf.resize(24);
+    CNetMessage(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nTypeIn, int nVersionIn) : hdr(pchMessageStartIn), vRecv(nTypeIn, nVersionIn) {
         in_data = false;
         nHdrPos = 0;
         nDataPos = 0;
         nTime = 0;
     }
+    ~CNetMessage();
 
     bool complete() const
     {
@@ -212,7 +255,6 @@ public:
 
     void SetVersion(int nVersionIn)
     {
-        hdrbuf.SetVersion(nVersionIn);
         vRecv.SetVersion(nVersionIn);
     }
 
@@ -300,8 +342,15 @@ public:
     std::deque<CInv> vRecvGetData;
     std::deque<CNetMessage> vRecvMsg;
     CCriticalSection cs_vRecvMsg;
+    // Held by the message handler thread working on this peer, so that its
+    // messages are handled one at a time and in order
+    CCriticalSection cs_msgHandler;
     uint64_t nRecvBytes;
     int nRecvVersion;
+    // Socket readiness as last reported by the edge-triggered poller, only used by the socket handler thread
+    bool fPollRegistered;
+    bool fPollRecv;
+    bool fPollSend;
 
     int64_t nLastSend;
     int64_t nLastRecv;
@@ -361,6 +410,7 @@ public:
     int nStartingHeight;
 
     // flood relay
+    CCriticalSection cs_addrRelay; // guards vAddrToSend and addrKnown, addresses are relayed from any message handler thread
     std::vector<CAddress> vAddrToSend;
     CRollingBloomFilter addrKnown;
     bool fGetAddr;
@@ -479,11 +529,13 @@ public:
 
     void AddAddressKnown(const CAddress& addr)
     {
+        LOCK(cs_addrRelay);
         addrKnown.insert(addr.GetKey());
     }
 
     void PushAddress(const CAddress& addr)
     {
+        LOCK(cs_addrRelay);
         // Known checking here is only to save space from duplicates.
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
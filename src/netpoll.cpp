@@ -0,0 +1,146 @@
+// Copyright (c) 2014-2019 The Flashcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#if defined(HAVE_CONFIG_H)
+#include "config/bitcoin-config.h"
+#endif
+
+#include "netpoll.h"
+
+#include <errno.h>
+#include <string.h>
+
+#if defined(HAVE_SYS_EPOLL_H) && !defined(WIN32)
+#define USE_EPOLL 1
+#include <sys/epoll.h>
+#endif
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/** Most events taken from the kernel in one wait */
+static const int MAX_POLL_EVENTS = 256;
+
+CSocketPoller::CSocketPoller() : fd(-1)
+{
+#ifdef USE_EPOLL
+    fd = epoll_create1(EPOLL_CLOEXEC);
+#endif
+}
+
+CSocketPoller::~CSocketPoller()
+{
+#ifndef WIN32
+    if (fd != -1)
+        close(fd);
+#endif
+}
+
+bool CSocketPoller::IsSupported()
+{
+#ifdef USE_EPOLL
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool CSocketPoller::AddEdge(SOCKET hSocket, void* ctx)
+{
+    return Add(hSocket, ctx, true);
+}
+
+bool CSocketPoller::AddLevel(SOCKET hSocket, void* ctx)
+{
+    return Add(hSocket, ctx, false);
+}
+
+bool CSocketPoller::Add(SOCKET hSocket, void* ctx, bool fEdge)
+{
+#ifdef USE_EPOLL
+    if (fd == -1 || hSocket == INVALID_SOCKET)
+        return false;
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    if (fEdge)
+        ev.events |= EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.ptr = ctx;
+    return epoll_ctl(fd, EPOLL_CTL_ADD, hSocket, &ev) == 0;
+#else
+    return false;
+#endif
+}
+
+bool CSocketPoller::Wait(int nTimeoutMs, std::vector<Event>& vEvents)
+{
+    vEvents.clear();
+#ifdef USE_EPOLL
+    if (fd == -1)
+        return false;
+    struct epoll_event events[MAX_POLL_EVENTS];
+    int nEvents = epoll_wait(fd, events, MAX_POLL_EVENTS, nTimeoutMs);
+    if (nEvents < 0)
+        return errno == EINTR;
+    vEvents.reserve(nEvents);
+    for (int i = 0; i < nEvents; i++) {
+        Event event;
+        event.ctx = events[i].data.ptr;
+        event.fRecv = (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) != 0;
+        event.fSend = (events[i].events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) != 0;
+        vEvents.push_back(event);
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+CSocketWakeup::CSocketWakeup()
+{
+    fds[0] = fds[1] = -1;
+#ifndef WIN32
+    if (pipe(fds) != 0) {
+        fds[0] = fds[1] = -1;
+        return;
+    }
+    for (int i = 0; i < 2; i++) {
+        fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+        fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    }
+#endif
+}
+
+CSocketWakeup::~CSocketWakeup()
+{
+#ifndef WIN32
+    for (int i = 0; i < 2; i++)
+        if (fds[i] != -1)
+            close(fds[i]);
+#endif
+}
+
+void CSocketWakeup::Wake()
+{
+#ifndef WIN32
+    if (fds[1] == -1)
+        return;
+    // A full pipe means a wakeup is pending already
+    char c = 0;
+    ssize_t nWritten = write(fds[1], &c, 1);
+    (void)nWritten;
+#endif
+}
+
+void CSocketWakeup::Drain()
+{
+#ifndef WIN32
+    if (fds[0] == -1)
+        return;
+    char buf[128];
+    while (read(fds[0], buf, sizeof(buf)) > 0) {}
+#endif
+}
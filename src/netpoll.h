@@ -0,0 +1,91 @@
+// Copyright (c) 2014-2019 The Flashcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_NETPOLL_H
+#define BITCOIN_NETPOLL_H
+
+#include "compat.h"
+
+#include <vector>
+
+/**
+ * Readiness notification for many sockets, so the socket handler does not have
+ * to rebuild and scan an fd_set of all peers on every pass. Sockets are
+ * registered once and reported with the context pointer given at registration.
+ *
+ * A closed socket drops out of the set by itself. There is deliberately no way
+ * to remove one: by the time its owner gets to it, the socket number may belong
+ * to a new connection already.
+ *
+ * Backed by epoll on Linux. Where that is not available IsValid() is false and
+ * callers keep using select().
+ */
+class CSocketPoller
+{
+public:
+    struct Event
+    {
+        void* ctx;
+        /** Readable, closed by the other side, or in error */
+        bool fRecv;
+        /** Writable */
+        bool fSend;
+    };
+
+    CSocketPoller();
+    ~CSocketPoller();
+
+    /** Whether this build has a poller backend at all */
+    static bool IsSupported();
+    bool IsValid() const { return fd != -1; }
+
+    /**
+     * Watch a connected socket, edge-triggered: it is reported once each time it
+     * becomes readable or writable, and stays ready until an operation on it
+     * would block.
+     */
+    bool AddEdge(SOCKET hSocket, void* ctx);
+    /** Watch a socket for as long as it is readable, for listening sockets and wakeup pipes */
+    bool AddLevel(SOCKET hSocket, void* ctx);
+
+    /** Wait up to nTimeoutMs for events, replacing the contents of vEvents */
+    bool Wait(int nTimeoutMs, std::vector<Event>& vEvents);
+
+private:
+    int fd;
+
+    bool Add(SOCKET hSocket, void* ctx, bool fEdge);
+
+    // Disallow copies
+    CSocketPoller(const CSocketPoller&);
+    CSocketPoller& operator=(const CSocketPoller&);
+};
+
+/**
+ * Self-pipe to interrupt a thread waiting for socket events from another
+ * thread. Wake() can be called any number of times before the waiter gets
+ * around to Drain(). Not available on Windows, where select() only takes sockets.
+ */
+class CSocketWakeup
+{
+public:
+    CSocketWakeup();
+    ~CSocketWakeup();
+
+    bool IsValid() const { return fds[0] != -1; }
+    /** The end to watch for readability */
+    SOCKET GetSocket() const { return (SOCKET)fds[0]; }
+
+    void Wake();
+    void Drain();
+
+private:
+    int fds[2];
+
+    // Disallow copies
+    CSocketWakeup(const CSocketWakeup&);
+    CSocketWakeup& operator=(const CSocketWakeup&);
+};
+
+#endif // BITCOIN_NETPOLL_H
@@ -23,6 +23,16 @@ uint256 CBlockHeader::GetPoWHash() const
     return thash;
 }
 
+// GetPoWHash() hashes the header straight from memory, so an array of headers is an array of 80 byte inputs.
+static_assert(sizeof(CBlockHeader) == 80, "CBlockHeader must be laid out as its serialization");
+
+void GetBlockPoWHashes(const CBlockHeader* pheaders, size_t nCount, uint256* phashPoW)
+{
+    if (nCount == 0)
+        return;
+    scrypt_1024_1_1_256_multi(BEGIN(pheaders[0].nVersion), BEGIN(phashPoW[0]), nCount);
+}
+
 std::string CBlock::ToString() const
 {
     std::stringstream s;
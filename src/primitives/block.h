@@ -158,6 +158,10 @@ struct CBlockLocator
     }
 };
 
+/** Compute the scrypt PoW hashes of nCount consecutive headers with the multi-buffer kernel,
+ *  phashPoW[i] is set to pheaders[i].GetPoWHash(). */
+void GetBlockPoWHashes(const CBlockHeader* pheaders, size_t nCount, uint256* phashPoW);
+
 /** Compute the consensus-critical block weight (see BIP 141). */
 int64_t GetBlockWeight(const CBlock& tx);
 
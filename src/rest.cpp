@@ -9,16 +9,21 @@
 #include "primitives/transaction.h"
 #include "main.h"
 #include "httpserver.h"
+#include "rpc/jsonstream.h"
 #include "rpc/server.h"
 #include "streams.h"
 #include "sync.h"
 #include "txmempool.h"
+#include "util.h"
 #include "utilstrencodings.h"
 #include "version.h"
 
 #include <boost/algorithm/string.hpp>
+#include <boost/bind.hpp>
 #include <boost/dynamic_bitset.hpp>
 
+#include <fcntl.h>
+
 #include <univalue.h>
 
 using namespace std;
@@ -59,11 +64,11 @@ struct CCoin {
 };
 
 extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry);
-extern UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false);
 extern UniValue mempoolInfoToJSON();
-extern UniValue mempoolToJSON(bool fVerbose = false);
+extern void blockToJSONStream(const CBlock& block, const CBlockIndex* blockindex, const CChainSnapshot& chain, bool txDetails, CJSONStreamWriter& writer);
+extern void mempoolToJSONStream(CJSONStreamWriter& writer);
 extern void ScriptPubKeyToJSON(const CScript& scriptPubKey, UniValue& out, bool fIncludeHex);
-extern UniValue blockheaderToJSON(const CBlockIndex* blockindex);
+extern UniValue blockheaderToJSON(const CBlockIndex* blockindex, const CChainSnapshot& chain);
 
 static bool RESTERR(HTTPRequest* req, enum HTTPStatusCode status, string message)
 {
@@ -150,16 +155,13 @@ static bool rest_headers(HTTPRequest* req,
 
     std::vector<const CBlockIndex *> headers;
     headers.reserve(count);
-    {
-        LOCK(cs_main);
-        BlockMap::const_iterator it = mapBlockIndex.find(hash);
-        const CBlockIndex *pindex = (it != mapBlockIndex.end()) ? it->second : NULL;
-        while (pindex != NULL && chainActive.Contains(pindex)) {
-            headers.push_back(pindex);
-            if (headers.size() == (unsigned long)count)
-                break;
-            pindex = chainActive.Next(pindex);
-        }
+    std::shared_ptr<const CChainSnapshot> chain = GetChainSnapshot();
+    const CBlockIndex *pindex = LookupBlockIndexInSnapshot(*chain, hash);
+    while (pindex != NULL) {
+        headers.push_back(pindex);
+        if (headers.size() == (unsigned long)count)
+            break;
+        pindex = chain->Next(pindex);
     }
 
     CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
@@ -184,7 +186,7 @@ static bool rest_headers(HTTPRequest* req,
     case RF_JSON: {
         UniValue jsonHeaders(UniValue::VARR);
         BOOST_FOREACH(const CBlockIndex *pindex, headers) {
-            jsonHeaders.push_back(blockheaderToJSON(pindex));
+            jsonHeaders.push_back(blockheaderToJSON(pindex, *chain));
         }
         string strJSON = jsonHeaders.write() + "\n";
         req->WriteHeader("Content-Type", "application/json");
@@ -214,18 +216,14 @@ static bool rest_block(HTTPRequest* req,
         return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
 
     CBlock block;
-    CBlockIndex* pblockindex = NULL;
-    {
-        LOCK(cs_main);
-        if (mapBlockIndex.count(hash) == 0)
-            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
-
-        pblockindex = mapBlockIndex[hash];
-        if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+    std::shared_ptr<const CChainSnapshot> chain;
+    const CBlockIndex* pblockindex = ReadBlockByHash(hash, chain, block);
+    if (pblockindex == NULL)
+        return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+    if (block.IsNull()) {
+        if (fHavePruned)
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not available (pruned data)");
-
-        if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
-            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
     }
 
     CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
@@ -247,10 +245,11 @@ static bool rest_block(HTTPRequest* req,
     }
 
     case RF_JSON: {
-        UniValue objBlock = blockToJSON(block, pblockindex, showTxDetails);
-        string strJSON = objBlock.write() + "\n";
         req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strJSON);
+        CJSONStreamWriter writer(boost::bind(&HTTPRequest::WriteReplyChunk, req, _1));
+        blockToJSONStream(block, pblockindex, *chain, showTxDetails, writer);
+        writer.Raw("\n");
+        req->WriteReplyEnd(writer.TakeBuffer());
         return true;
     }
 
@@ -273,6 +272,93 @@ static bool rest_block_notxdetails(HTTPRequest* req, const std::string& strURIPa
     return rest_block(req, strURIPart, false);
 }
 
+/** Blocks smaller than this are copied into shared chunks, larger ones are sent straight from their block file */
+static const unsigned int REST_BLOCKS_CHUNK_SIZE = 64 * 1024;
+/** Most blocks sent by one /rest/blocks request */
+static const int MAX_REST_BLOCKS = 2000;
+
+static bool rest_blocks(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    if (rf != RF_BINARY)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin)");
+
+    std::string::size_type nDash = param.find('-');
+    int32_t nFrom, nTo;
+    if (nDash == std::string::npos || !ParseInt32(param.substr(0, nDash), &nFrom) ||
+        !ParseInt32(param.substr(nDash + 1), &nTo) || nFrom < 0 || nTo < nFrom)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid block range: " + param + ". Use /rest/blocks/<from>-<to>.bin.");
+    if (nTo - nFrom >= MAX_REST_BLOCKS)
+        return RESTERR(req, HTTP_BAD_REQUEST, strprintf("Block range too large: %s, at most %d blocks per request", param, MAX_REST_BLOCKS));
+
+    std::shared_ptr<const CChainSnapshot> chain = GetChainSnapshot();
+    if (nTo > chain->Height())
+        return RESTERR(req, HTTP_NOT_FOUND, "Block range beyond the tip: " + param);
+
+    // Collect the positions first, so that missing block data is reported before the reply starts
+    std::vector<CDiskBlockPos> vPos(nTo - nFrom + 1);
+    {
+        // Block positions only change when pruning, under cs_main
+        LOCK(cs_main);
+        const CBlockIndex* pindex = (*chain)[nTo];
+        for (int nHeight = nTo; nHeight >= nFrom; nHeight--, pindex = pindex->pprev) {
+            if (!(pindex->nStatus & BLOCK_HAVE_DATA))
+                return RESTERR(req, HTTP_NOT_FOUND, strprintf("Block %d not available (pruned data)", nHeight));
+            vPos[nHeight - nFrom] = pindex->GetBlockPos();
+        }
+    }
+
+    // The blocks are sent as stored on disk unless witness data is to be left out
+    const CChainParams& chainparams = Params();
+    const bool fReserialize = RPCSerializationFlags() != 0;
+    req->WriteHeader("Content-Type", "application/octet-stream");
+    std::string strChunk;
+    for (unsigned int i = 0; i < vPos.size(); i++) {
+        const CDiskBlockPos& pos = vPos[i];
+        bool fOk = true;
+        if (fReserialize) {
+            CBlock block;
+            fOk = ReadBlockFromDisk(block, pos, chainparams.GetConsensus());
+            if (fOk) {
+                CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
+                ssBlock << block;
+                strChunk.append(ssBlock.begin(), ssBlock.end());
+            }
+        } else {
+            unsigned int nSize;
+            fOk = ReadBlockSizeFromDisk(nSize, pos, chainparams.MessageStart());
+            if (fOk && nSize < REST_BLOCKS_CHUNK_SIZE) {
+                std::vector<unsigned char> vchBlock;
+                fOk = ReadRawBlockFromDisk(vchBlock, pos, chainparams.MessageStart());
+                strChunk.append(vchBlock.begin(), vchBlock.end());
+            } else if (fOk) {
+                int fd = open(GetBlockPosFilename(pos, "blk").string().c_str(), O_RDONLY);
+                fOk = fd >= 0 && (strChunk.empty() || req->WriteReplyChunk(strChunk)) &&
+                      req->WriteReplyFileChunk(fd, pos.nPos, nSize);
+                strChunk.clear();
+            }
+        }
+        if (!fOk) {
+            if (!req->IsChunked())
+                return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR, strprintf("Can't read block %d from disk", nFrom + i));
+            // Part of the reply has gone out already, cut it short
+            LogPrint("http", "%s: stopped sending blocks %d-%d at %d\n", __func__, nFrom, nTo, nFrom + i);
+            strChunk.clear();
+            break;
+        }
+        if (strChunk.size() >= REST_BLOCKS_CHUNK_SIZE) {
+            if (!req->WriteReplyChunk(strChunk))
+                break;
+            strChunk.clear();
+        }
+    }
+    req->WriteReplyEnd(strChunk);
+    return true;
+}
+
 // A bit of a hack - dependency on a function defined in rpc/blockchain.cpp
 UniValue getblockchaininfo(const UniValue& params, bool fHelp);
 
@@ -335,11 +421,11 @@ static bool rest_mempool_contents(HTTPRequest* req, const std::string& strURIPar
 
     switch (rf) {
     case RF_JSON: {
-        UniValue mempoolObject = mempoolToJSON(true);
-
-        string strJSON = mempoolObject.write() + "\n";
         req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strJSON);
+        CJSONStreamWriter writer(boost::bind(&HTTPRequest::WriteReplyChunk, req, _1));
+        mempoolToJSONStream(writer);
+        writer.Raw("\n");
+        req->WriteReplyEnd(writer.TakeBuffer());
         return true;
     }
     default: {
@@ -502,8 +588,11 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
     vector<CCoin> outs;
     std::string bitmapStringRepresentation;
     boost::dynamic_bitset<unsigned char> hits(vOutPoints.size());
+    std::shared_ptr<const CChainSnapshot> chain;
     {
         LOCK2(cs_main, mempool.cs);
+        // The chain the coins were looked up in, for reporting after releasing the locks
+        chain = GetChainSnapshot();
 
         CCoinsView viewDummy;
         CCoinsViewCache view(&viewDummy);
@@ -542,7 +631,7 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
         // serialize data
         // use exact same output as mentioned in Bip64
         CDataStream ssGetUTXOResponse(SER_NETWORK, PROTOCOL_VERSION);
-        ssGetUTXOResponse << chainActive.Height() << chainActive.Tip()->GetBlockHash() << bitmap << outs;
+        ssGetUTXOResponse << chain->Height() << chain->Tip()->GetBlockHash() << bitmap << outs;
         string ssGetUTXOResponseString = ssGetUTXOResponse.str();
 
         req->WriteHeader("Content-Type", "application/octet-stream");
@@ -552,7 +641,7 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
 
     case RF_HEX: {
         CDataStream ssGetUTXOResponse(SER_NETWORK, PROTOCOL_VERSION);
-        ssGetUTXOResponse << chainActive.Height() << chainActive.Tip()->GetBlockHash() << bitmap << outs;
+        ssGetUTXOResponse << chain->Height() << chain->Tip()->GetBlockHash() << bitmap << outs;
         string strHex = HexStr(ssGetUTXOResponse.begin(), ssGetUTXOResponse.end()) + "\n";
 
         req->WriteHeader("Content-Type", "text/plain");
@@ -565,8 +654,8 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
 
         // pack in some essentials
         // use more or less the same output as mentioned in Bip64
-        objGetUTXOResponse.push_back(Pair("chainHeight", chainActive.Height()));
-        objGetUTXOResponse.push_back(Pair("chaintipHash", chainActive.Tip()->GetBlockHash().GetHex()));
+        objGetUTXOResponse.push_back(Pair("chainHeight", chain->Height()));
+        objGetUTXOResponse.push_back(Pair("chaintipHash", chain->Tip()->GetBlockHash().GetHex()));
         objGetUTXOResponse.push_back(Pair("bitmap", bitmapStringRepresentation));
 
         UniValue utxos(UniValue::VARR);
@@ -610,6 +699,7 @@ static const struct {
       {"/rest/mempool/info", rest_mempool_info},
       {"/rest/mempool/contents", rest_mempool_contents},
       {"/rest/headers/", rest_headers},
+      {"/rest/blocks/", rest_blocks},
       {"/rest/getutxos", rest_getutxos},
 };
 
@@ -12,9 +12,11 @@
 #include "main.h"
 #include "policy/policy.h"
 #include "primitives/transaction.h"
+#include "rpc/jsonstream.h"
 #include "rpc/server.h"
 #include "streams.h"
 #include "sync.h"
+#include "txdb.h"
 #include "txmempool.h"
 #include "util.h"
 #include "utilstrencodings.h"
@@ -37,10 +39,9 @@ double GetDifficulty(const CBlockIndex* blockindex)
     // minimum difficulty = 1.0.
     if (blockindex == NULL)
     {
-        if (chainActive.Tip() == NULL)
+        blockindex = GetChainSnapshot()->Tip();
+        if (blockindex == NULL)
             return 1.0;
-        else
-            blockindex = chainActive.Tip();
     }
 
     int nShift = (blockindex->nBits >> 24) & 0xff;
@@ -62,14 +63,14 @@ double GetDifficulty(const CBlockIndex* blockindex)
     return dDiff;
 }
 
-UniValue blockheaderToJSON(const CBlockIndex* blockindex)
+UniValue blockheaderToJSON(const CBlockIndex* blockindex, const CChainSnapshot& chain)
 {
     UniValue result(UniValue::VOBJ);
     result.push_back(Pair("hash", blockindex->GetBlockHash().GetHex()));
     int confirmations = -1;
     // Only report confirmations if the block is on the main chain
-    if (chainActive.Contains(blockindex))
-        confirmations = chainActive.Height() - blockindex->nHeight + 1;
+    if (chain.Contains(blockindex))
+        confirmations = chain.Height() - blockindex->nHeight + 1;
     result.push_back(Pair("confirmations", confirmations));
     result.push_back(Pair("height", blockindex->nHeight));
     result.push_back(Pair("version", blockindex->nVersion));
@@ -84,56 +85,81 @@ UniValue blockheaderToJSON(const CBlockIndex* blockindex)
 
     if (blockindex->pprev)
         result.push_back(Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex()));
-    CBlockIndex *pnext = chainActive.Next(blockindex);
+    const CBlockIndex *pnext = chain.Next(blockindex);
     if (pnext)
         result.push_back(Pair("nextblockhash", pnext->GetBlockHash().GetHex()));
     return result;
 }
 
-UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false)
+/** The members of the JSON form of a block that come before and after its "tx" array */
+static void blockFieldsToJSON(const CBlock& block, const CBlockIndex* blockindex, const CChainSnapshot& chain, UniValue& before, UniValue& after)
 {
-    UniValue result(UniValue::VOBJ);
-    result.push_back(Pair("hash", blockindex->GetBlockHash().GetHex()));
+    before.push_back(Pair("hash", blockindex->GetBlockHash().GetHex()));
     int confirmations = -1;
     // Only report confirmations if the block is on the main chain
-    if (chainActive.Contains(blockindex))
-        confirmations = chainActive.Height() - blockindex->nHeight + 1;
-    result.push_back(Pair("confirmations", confirmations));
-    result.push_back(Pair("strippedsize", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS)));
-    result.push_back(Pair("size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION)));
-    result.push_back(Pair("weight", (int)::GetBlockWeight(block)));
-    result.push_back(Pair("height", blockindex->nHeight));
-    result.push_back(Pair("version", block.nVersion));
-    result.push_back(Pair("versionHex", strprintf("%08x", block.nVersion)));
-    result.push_back(Pair("merkleroot", block.hashMerkleRoot.GetHex()));
-    UniValue txs(UniValue::VARR);
-    BOOST_FOREACH(const CTransaction&tx, block.vtx)
-    {
-        if(txDetails)
-        {
-            UniValue objTx(UniValue::VOBJ);
-            TxToJSON(tx, uint256(), objTx);
-            txs.push_back(objTx);
-        }
-        else
-            txs.push_back(tx.GetHash().GetHex());
-    }
-    result.push_back(Pair("tx", txs));
-    result.push_back(Pair("time", block.GetBlockTime()));
-    result.push_back(Pair("mediantime", (int64_t)blockindex->GetMedianTimePast()));
-    result.push_back(Pair("nonce", (uint64_t)block.nNonce));
-    result.push_back(Pair("bits", strprintf("%08x", block.nBits)));
-    result.push_back(Pair("difficulty", GetDifficulty(blockindex)));
-    result.push_back(Pair("chainwork", blockindex->nChainWork.GetHex()));
+    if (chain.Contains(blockindex))
+        confirmations = chain.Height() - blockindex->nHeight + 1;
+    before.push_back(Pair("confirmations", confirmations));
+    before.push_back(Pair("strippedsize", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS)));
+    before.push_back(Pair("size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION)));
+    before.push_back(Pair("weight", (int)::GetBlockWeight(block)));
+    before.push_back(Pair("height", blockindex->nHeight));
+    before.push_back(Pair("version", block.nVersion));
+    before.push_back(Pair("versionHex", strprintf("%08x", block.nVersion)));
+    before.push_back(Pair("merkleroot", block.hashMerkleRoot.GetHex()));
+    after.push_back(Pair("time", block.GetBlockTime()));
+    after.push_back(Pair("mediantime", (int64_t)blockindex->GetMedianTimePast()));
+    after.push_back(Pair("nonce", (uint64_t)block.nNonce));
+    after.push_back(Pair("bits", strprintf("%08x", block.nBits)));
+    after.push_back(Pair("difficulty", GetDifficulty(blockindex)));
+    after.push_back(Pair("chainwork", blockindex->nChainWork.GetHex()));
 
     if (blockindex->pprev)
-        result.push_back(Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex()));
-    CBlockIndex *pnext = chainActive.Next(blockindex);
+        after.push_back(Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex()));
+    const CBlockIndex *pnext = chain.Next(blockindex);
     if (pnext)
-        result.push_back(Pair("nextblockhash", pnext->GetBlockHash().GetHex()));
+        after.push_back(Pair("nextblockhash", pnext->GetBlockHash().GetHex()));
+}
+
+static UniValue blockTxToJSON(const CTransaction& tx, bool txDetails)
+{
+    if (!txDetails)
+        return tx.GetHash().GetHex();
+    UniValue objTx(UniValue::VOBJ);
+    TxToJSON(tx, uint256(), objTx);
+    return objTx;
+}
+
+UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, const CChainSnapshot& chain, bool txDetails = false)
+{
+    UniValue result(UniValue::VOBJ);
+    UniValue after(UniValue::VOBJ);
+    blockFieldsToJSON(block, blockindex, chain, result, after);
+    UniValue txs(UniValue::VARR);
+    BOOST_FOREACH(const CTransaction&tx, block.vtx)
+        txs.push_back(blockTxToJSON(tx, txDetails));
+    result.push_back(Pair("tx", txs));
+    result.pushKVs(after);
     return result;
 }
 
+/** Same output as blockToJSON, written one transaction at a time */
+void blockToJSONStream(const CBlock& block, const CBlockIndex* blockindex, const CChainSnapshot& chain, bool txDetails, CJSONStreamWriter& writer)
+{
+    UniValue before(UniValue::VOBJ);
+    UniValue after(UniValue::VOBJ);
+    blockFieldsToJSON(block, blockindex, chain, before, after);
+    writer.BeginObject();
+    writer.Members(before);
+    writer.Key("tx");
+    writer.BeginArray();
+    BOOST_FOREACH(const CTransaction&tx, block.vtx)
+        writer.Value(blockTxToJSON(tx, txDetails));
+    writer.EndArray();
+    writer.Members(after);
+    writer.EndObject();
+}
+
 UniValue getblockcount(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 0)
@@ -147,8 +173,7 @@ UniValue getblockcount(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getblockcount", "")
         );
 
-    LOCK(cs_main);
-    return chainActive.Height();
+    return GetChainSnapshot()->Height();
 }
 
 UniValue getbestblockhash(const UniValue& params, bool fHelp)
@@ -164,8 +189,7 @@ UniValue getbestblockhash(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getbestblockhash", "")
         );
 
-    LOCK(cs_main);
-    return chainActive.Tip()->GetBlockHash().GetHex();
+    return GetChainSnapshot()->Tip()->GetBlockHash().GetHex();
 }
 
 UniValue getdifficulty(const UniValue& params, bool fHelp)
@@ -181,7 +205,6 @@ UniValue getdifficulty(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getdifficulty", "")
         );
 
-    LOCK(cs_main);
     return GetDifficulty();
 }
 
@@ -267,6 +290,48 @@ UniValue mempoolToJSON(bool fVerbose = false)
     }
 }
 
+/** Entries rendered by mempoolToJSONStream per hold of mempool.cs */
+static const size_t MEMPOOL_STREAM_BATCH_SIZE = 1000;
+
+/**
+ * Same output as mempoolToJSON(true), written one entry at a time. The writer
+ * blocks while the client is behind, so mempool.cs is never held across it:
+ * entries are rendered in batches under the lock and written after releasing
+ * it. Transactions that leave the mempool during the reply are left out.
+ */
+void mempoolToJSONStream(CJSONStreamWriter& writer)
+{
+    std::vector<uint256> vtxid;
+    {
+        LOCK(mempool.cs);
+        vtxid.reserve(mempool.mapTx.size());
+        BOOST_FOREACH(const CTxMemPoolEntry& e, mempool.mapTx)
+            vtxid.push_back(e.GetTx().GetHash());
+    }
+
+    writer.BeginObject();
+    std::vector<std::pair<uint256, UniValue> > vBatch;
+    for (size_t nStart = 0; nStart < vtxid.size(); nStart += MEMPOOL_STREAM_BATCH_SIZE) {
+        vBatch.clear();
+        {
+            LOCK(mempool.cs);
+            size_t nEnd = std::min(vtxid.size(), nStart + MEMPOOL_STREAM_BATCH_SIZE);
+            for (size_t i = nStart; i < nEnd; i++) {
+                CTxMemPool::txiter it = mempool.mapTx.find(vtxid[i]);
+                if (it == mempool.mapTx.end())
+                    continue;
+                vBatch.push_back(std::make_pair(vtxid[i], UniValue(UniValue::VOBJ)));
+                entryToJSON(vBatch.back().second, *it);
+            }
+        }
+        for (size_t i = 0; i < vBatch.size(); i++) {
+            writer.Key(vBatch[i].first.ToString());
+            writer.Value(vBatch[i].second);
+        }
+    }
+    writer.EndObject();
+}
+
 UniValue getrawmempool(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() > 1)
@@ -298,6 +363,16 @@ UniValue getrawmempool(const UniValue& params, bool fHelp)
     return mempoolToJSON(fVerbose);
 }
 
+static bool getrawmempoolStream(const UniValue& params, CJSONStreamWriter& writer)
+{
+    // Only the verbose form is large enough to be worth streaming
+    if (params.size() != 1 || !params[0].get_bool())
+        return false;
+
+    mempoolToJSONStream(writer);
+    return true;
+}
+
 UniValue getmempoolancestors(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 2) {
@@ -474,16 +549,53 @@ UniValue getblockhash(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getblockhash", "1000")
         );
 
-    LOCK(cs_main);
+    std::shared_ptr<const CChainSnapshot> chain = GetChainSnapshot();
 
     int nHeight = params[0].get_int();
-    if (nHeight < 0 || nHeight > chainActive.Height())
+    if (nHeight < 0 || nHeight > chain->Height())
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
 
-    CBlockIndex* pblockindex = chainActive[nHeight];
+    const CBlockIndex* pblockindex = (*chain)[nHeight];
     return pblockindex->GetBlockHash().GetHex();
 }
 
+UniValue getblockhashes(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 2)
+        throw runtime_error(
+            "getblockhashes high low\n"
+            "\nReturns the hashes of the blocks in the best block chain with timestamps in a range (requires -timestampindex).\n"
+            "\nArguments:\n"
+            "1. high         (numeric, required) The newer block timestamp, exclusive\n"
+            "2. low          (numeric, required) The older block timestamp, inclusive\n"
+            "\nResult:\n"
+            "[\n"
+            "  \"hash\"         (string) The block hash\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getblockhashes", "1231614698 1231024505")
+            + HelpExampleRpc("getblockhashes", "1231614698, 1231024505")
+        );
+
+    int nHigh = params[0].get_int();
+    int nLow = params[1].get_int();
+    if (nHigh < 0 || nLow < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative timestamp");
+    if (nLow > nHigh)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "low is greater than high");
+    unsigned int high = nHigh;
+    unsigned int low = nLow;
+
+    std::vector<uint256> blockHashes;
+    if (!GetTimestampIndex(high, low, blockHashes))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for block hashes");
+
+    UniValue result(UniValue::VARR);
+    BOOST_FOREACH(const uint256& hash, blockHashes)
+        result.push_back(hash.GetHex());
+    return result;
+}
+
 UniValue getblockheader(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
@@ -518,8 +630,6 @@ UniValue getblockheader(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getblockheader", "\"e2acdf2dd19a702e5d12a925f1e984b01e47a933562ca893656d4afb38b44ee3\"")
         );
 
-    LOCK(cs_main);
-
     std::string strHash = params[0].get_str();
     uint256 hash(uint256S(strHash));
 
@@ -527,10 +637,18 @@ UniValue getblockheader(const UniValue& params, bool fHelp)
     if (params.size() > 1)
         fVerbose = params[1].get_bool();
 
-    if (mapBlockIndex.count(hash) == 0)
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
-
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
+    std::shared_ptr<const CChainSnapshot> chain = GetChainSnapshot();
+    const CBlockIndex* pblockindex = LookupBlockIndexInSnapshot(*chain, hash);
+    if (pblockindex == NULL)
+    {
+        // Not in the active chain (or it just changed), the header fields used below are immutable once found under cs_main
+        LOCK(cs_main);
+        BlockMap::const_iterator it = mapBlockIndex.find(hash);
+        if (it == mapBlockIndex.end())
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        pblockindex = it->second;
+        chain = GetChainSnapshot();
+    }
 
     if (!fVerbose)
     {
@@ -540,7 +658,24 @@ UniValue getblockheader(const UniValue& params, bool fHelp)
         return strHex;
     }
 
-    return blockheaderToJSON(pblockindex);
+    return blockheaderToJSON(pblockindex, *chain);
+}
+
+/** Look up and read the block whose hash is given by param, throwing the getblock errors */
+static const CBlockIndex* ReadBlockParam(const UniValue& param, std::shared_ptr<const CChainSnapshot>& chain, CBlock& block)
+{
+    uint256 hash(uint256S(param.get_str()));
+
+    const CBlockIndex* pblockindex = ReadBlockByHash(hash, chain, block);
+    if (pblockindex == NULL)
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+    if (block.IsNull())
+    {
+        if (fHavePruned)
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+    }
+    return pblockindex;
 }
 
 UniValue getblock(const UniValue& params, bool fHelp)
@@ -584,26 +719,13 @@ UniValue getblock(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getblock", "\"e2acdf2dd19a702e5d12a925f1e984b01e47a933562ca893656d4afb38b44ee3\"")
         );
 
-    LOCK(cs_main);
-
-    std::string strHash = params[0].get_str();
-    uint256 hash(uint256S(strHash));
-
     bool fVerbose = true;
     if (params.size() > 1)
         fVerbose = params[1].get_bool();
 
-    if (mapBlockIndex.count(hash) == 0)
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
-
     CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
-
-    if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
-
-    if(!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+    std::shared_ptr<const CChainSnapshot> chain;
+    const CBlockIndex* pblockindex = ReadBlockParam(params[0], chain, block);
 
     if (!fVerbose)
     {
@@ -613,7 +735,20 @@ UniValue getblock(const UniValue& params, bool fHelp)
         return strHex;
     }
 
-    return blockToJSON(block, pblockindex);
+    return blockToJSON(block, pblockindex, *chain);
+}
+
+static bool getblockStream(const UniValue& params, CJSONStreamWriter& writer)
+{
+    // Usage errors and the hex form are left to getblock
+    if (params.size() < 1 || params.size() > 2 || (params.size() > 1 && !params[1].get_bool()))
+        return false;
+
+    CBlock block;
+    std::shared_ptr<const CChainSnapshot> chain;
+    const CBlockIndex* pblockindex = ReadBlockParam(params[0], chain, block);
+    blockToJSONStream(block, pblockindex, *chain, false, writer);
+    return true;
 }
 
 struct CCoinsStats
@@ -623,7 +758,10 @@ struct CCoinsStats
     uint64_t nTransactions;
     uint64_t nTransactionOutputs;
     uint64_t nSerializedSize;
+    //! SHA256 over the scanned set, only computed by a scan
     uint256 hashSerialized;
+    //! MuHash3072 digest of the output records, only known from the running totals
+    uint256 hashMuHash;
     CAmount nTotalAmount;
 
     CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), nTotalAmount(0) {}
@@ -670,21 +808,42 @@ static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
     return true;
 }
 
+//! Get statistics about the unspent transaction output set from the totals kept by the coin database
+static bool GetUTXOStatsKept(CCoinsViewDB *view, CCoinsStats &stats)
+{
+    CCoinsDBStats dbstats;
+    if (!view->GetStats(dbstats))
+        return false;
+    stats.hashBlock = dbstats.hashBlock;
+    {
+        LOCK(cs_main);
+        stats.nHeight = mapBlockIndex.find(stats.hashBlock)->second->nHeight;
+    }
+    stats.nTransactions = dbstats.nTransactions;
+    stats.nTransactionOutputs = dbstats.nTransactionOutputs;
+    stats.nSerializedSize = dbstats.nSerializedSize;
+    stats.hashMuHash = dbstats.muhash.Finalize();
+    stats.nTotalAmount = dbstats.nTotalAmount;
+    return true;
+}
+
 UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 0)
         throw runtime_error(
             "gettxoutsetinfo\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "With -coinstats they are taken from running totals, otherwise they are computed with a scan\n"
+            "over the whole set, which can take minutes.\n"
             "\nResult:\n"
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
             "  \"bestblock\": \"hex\",   (string) the best block hash hex\n"
             "  \"transactions\": n,      (numeric) The number of transactions\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
-            "  \"bytes_serialized\": n,  (numeric) The serialized size\n"
-            "  \"hash_serialized\": \"hash\",   (string) The serialized hash\n"
+            "  \"bytes_serialized\": n,  (numeric) The serialized size of the output records\n"
+            "  \"hash_serialized\": \"hash\",   (string) The serialized hash, only without -coinstats\n"
+            "  \"muhash\": \"hash\",     (string) The MuHash3072 set hash of the output records, only with -coinstats\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
             "}\n"
             "\nExamples:\n"
@@ -695,14 +854,18 @@ UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
     UniValue ret(UniValue::VOBJ);
 
     CCoinsStats stats;
-    FlushStateToDisk();
-    if (GetUTXOStats(pcoinsTip, stats)) {
+    SyncStateToDisk();
+    bool fKept = pcoinsdbview->KeepsStats();
+    if (fKept ? GetUTXOStatsKept(pcoinsdbview, stats) : GetUTXOStats(pcoinsdbview, stats)) {
         ret.push_back(Pair("height", (int64_t)stats.nHeight));
         ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
         ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
         ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
         ret.push_back(Pair("bytes_serialized", (int64_t)stats.nSerializedSize));
-        ret.push_back(Pair("hash_serialized", stats.hashSerialized.GetHex()));
+        if (fKept)
+            ret.push_back(Pair("muhash", stats.hashMuHash.GetHex()));
+        else
+            ret.push_back(Pair("hash_serialized", stats.hashSerialized.GetHex()));
         ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
     } else {
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
@@ -710,6 +873,63 @@ UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
     return ret;
 }
 
+UniValue getcoinscacheinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getcoinscacheinfo\n"
+            "\nReturns details about the in-memory UTXO cache and its writes to the chainstate database.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"entries\": n,          (numeric) Number of transactions in the cache\n"
+            "  \"dirty\": n,            (numeric) Number of them not written to the database yet\n"
+            "  \"usage\": n,            (numeric) Memory used by the cache, in bytes\n"
+            "  \"limit\": n,            (numeric) Memory the cache may use before it is flushed (-dbcache), in bytes\n"
+            "  \"partialflush\": true|false, (boolean) Whether flushes keep the clean entries in memory (-partialflush)\n"
+            "  \"asyncflush\": true|false, (boolean) Whether flushes are committed to the database in the background (-asyncflush)\n"
+            "  \"pending\": n,          (numeric) Number of transactions flushed but not committed yet\n"
+            "  \"flushes\": n,          (numeric) Number of flushes since startup\n"
+            "  \"partialflushes\": n,   (numeric) Number of them that were partial\n"
+            "  \"lastflush\": {         (json object) The most recent flush, if any\n"
+            "    \"time\": n,           (numeric) Time of the flush in seconds since epoch (Jan 1 1970 GMT)\n"
+            "    \"partial\": true|false, (boolean) Whether the cache was kept in memory\n"
+            "    \"duration\": n,       (numeric) Time validation was held up by it, in milliseconds\n"
+            "    \"write_duration\": n, (numeric) Time the last background commit took, in milliseconds\n"
+            "    \"written\": n,        (numeric) Number of dirty transactions written\n"
+            "    \"evicted\": n         (numeric) Number of transactions removed from the cache\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getcoinscacheinfo", "")
+            + HelpExampleRpc("getcoinscacheinfo", "")
+        );
+
+    CCoinsFlushStats stats = GetCoinsFlushStats();
+
+    LOCK(cs_main);
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("entries", (int64_t)pcoinsTip->GetCacheSize()));
+    ret.push_back(Pair("dirty", (int64_t)pcoinsTip->GetDirtyCount()));
+    ret.push_back(Pair("usage", (int64_t)pcoinsTip->ActiveMemoryUsage()));
+    ret.push_back(Pair("limit", (int64_t)nCoinCacheUsage));
+    ret.push_back(Pair("partialflush", fPartialFlush));
+    ret.push_back(Pair("asyncflush", pcoinsWriter->IsRunning()));
+    ret.push_back(Pair("pending", (int64_t)pcoinsWriter->GetPendingCount()));
+    ret.push_back(Pair("flushes", (int64_t)stats.nFlushes));
+    ret.push_back(Pair("partialflushes", (int64_t)stats.nPartialFlushes));
+    if (stats.nFlushes > 0) {
+        UniValue last(UniValue::VOBJ);
+        last.push_back(Pair("time", stats.nLastFlushTime));
+        last.push_back(Pair("partial", stats.fLastFlushPartial));
+        last.push_back(Pair("duration", stats.nLastFlushMicros * 0.001));
+        last.push_back(Pair("write_duration", pcoinsWriter->GetLastWriteMicros() * 0.001));
+        last.push_back(Pair("written", (int64_t)stats.nLastDirty));
+        last.push_back(Pair("evicted", (int64_t)stats.nLastEvicted));
+        ret.push_back(Pair("lastflush", last));
+    }
+    return ret;
+}
+
 UniValue gettxout(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 2 || params.size() > 3)
@@ -790,6 +1010,45 @@ UniValue gettxout(const UniValue& params, bool fHelp)
     return ret;
 }
 
+UniValue getspentinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1 || !params[0].isObject())
+        throw runtime_error(
+            "getspentinfo {\"txid\": \"txid\", \"index\": n}\n"
+            "\nReturns the txid and index where an output is spent (requires -spentindex).\n"
+            "\nArguments:\n"
+            "{\n"
+            "  \"txid\"    (string) The hex string of the txid\n"
+            "  \"index\"   (numeric) The output index\n"
+            "}\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"txid\"    (string) The transaction id of the spending transaction\n"
+            "  \"index\"   (numeric) The spending input index\n"
+            "  \"height\"  (numeric) The height of the block containing the spending transaction\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getspentinfo", "'{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}'")
+            + HelpExampleRpc("getspentinfo", "{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}")
+        );
+
+    uint256 txid = ParseHashV(find_value(params[0].get_obj(), "txid"), "txid");
+    const UniValue& indexValue = find_value(params[0].get_obj(), "index");
+    if (!indexValue.isNum() || indexValue.get_int() < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid index");
+
+    CSpentIndexKey key(txid, indexValue.get_int());
+    CSpentIndexValue value;
+    if (!GetSpentIndex(key, value))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unable to get spent info");
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("txid", value.txid.GetHex()));
+    result.push_back(Pair("index", (int)value.inputIndex));
+    result.push_back(Pair("height", value.blockHeight));
+    return result;
+}
+
 UniValue verifychain(const UniValue& params, bool fHelp)
 {
     int nCheckLevel = GetArg("-checklevel", DEFAULT_CHECKLEVEL);
@@ -1192,8 +1451,9 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      true  },
     { "blockchain",         "getbestblockhash",       &getbestblockhash,       true  },
     { "blockchain",         "getblockcount",          &getblockcount,          true  },
-    { "blockchain",         "getblock",               &getblock,               true  },
+    { "blockchain",         "getblock",               &getblock,               true,  &getblockStream },
     { "blockchain",         "getblockhash",           &getblockhash,           true  },
+    { "blockchain",         "getblockhashes",         &getblockhashes,         true  },
     { "blockchain",         "getblockheader",         &getblockheader,         true  },
     { "blockchain",         "getchaintips",           &getchaintips,           true  },
     { "blockchain",         "getdifficulty",          &getdifficulty,          true  },
@@ -1201,9 +1461,11 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  true  },
     { "blockchain",         "getmempoolentry",        &getmempoolentry,        true  },
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true  },
-    { "blockchain",         "getrawmempool",          &getrawmempool,          true  },
+    { "blockchain",         "getrawmempool",          &getrawmempool,          true,  &getrawmempoolStream },
     { "blockchain",         "gettxout",               &gettxout,               true  },
+    { "blockchain",         "getspentinfo",           &getspentinfo,           true  },
     { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true  },
+    { "blockchain",         "getcoinscacheinfo",      &getcoinscacheinfo,      true  },
     { "blockchain",         "verifychain",            &verifychain,            true  },
 
     /* Not shown in help */
@@ -29,6 +29,8 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "getaddednodeinfo", 0 },
     { "getnetworkhashps", 0 },
     { "getnetworkhashps", 1 },
+    { "getblocktemplate", 0 },
+    { "submitblock", 1 },
     { "sendtoaddress", 1 },
     { "sendtoaddress", 4 },
     { "settxfee", 0 },
@@ -43,6 +45,12 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "getbalance", 1 },
     { "getbalance", 2 },
     { "getblockhash", 0 },
+    { "getblockhashes", 0 },
+    { "getblockhashes", 1 },
+    { "getaddressbalance", 0 },
+    { "getaddressdeltas", 0 },
+    { "getaddressutxos", 0 },
+    { "getspentinfo", 0 },
     { "move", 2 },
     { "move", 3 },
     { "sendfrom", 2 },
@@ -0,0 +1,106 @@
+// Copyright (c) 2014-2019 The Flashcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "rpc/jsonstream.h"
+
+#include <assert.h>
+
+CJSONStreamWriter::CJSONStreamWriter(const Sink& sinkIn, size_t nChunkSizeIn) :
+    sink(sinkIn), nChunkSize(nChunkSizeIn), fAfterKey(false), fFlushed(false)
+{
+    strBuffer.reserve(nChunkSize);
+}
+
+void CJSONStreamWriter::Separate()
+{
+    if (fAfterKey) {
+        fAfterKey = false;
+        return;
+    }
+    if (vEmpty.empty())
+        return;
+    if (vEmpty.back())
+        vEmpty.back() = false;
+    else
+        strBuffer += ',';
+}
+
+void CJSONStreamWriter::MaybeFlush()
+{
+    if (strBuffer.size() < nChunkSize)
+        return;
+    sink(strBuffer);
+    strBuffer.clear();
+    fFlushed = true;
+}
+
+void CJSONStreamWriter::BeginObject()
+{
+    Separate();
+    strBuffer += '{';
+    vEmpty.push_back(true);
+}
+
+void CJSONStreamWriter::EndObject()
+{
+    assert(!vEmpty.empty() && !fAfterKey);
+    vEmpty.pop_back();
+    strBuffer += '}';
+    MaybeFlush();
+}
+
+void CJSONStreamWriter::BeginArray()
+{
+    Separate();
+    strBuffer += '[';
+    vEmpty.push_back(true);
+}
+
+void CJSONStreamWriter::EndArray()
+{
+    assert(!vEmpty.empty() && !fAfterKey);
+    vEmpty.pop_back();
+    strBuffer += ']';
+    MaybeFlush();
+}
+
+void CJSONStreamWriter::Key(const std::string& strKey)
+{
+    assert(!fAfterKey);
+    Separate();
+    // A string UniValue writes itself quoted and escaped
+    strBuffer += UniValue(strKey).write();
+    strBuffer += ':';
+    fAfterKey = true;
+}
+
+void CJSONStreamWriter::Value(const UniValue& val)
+{
+    Separate();
+    strBuffer += val.write();
+    MaybeFlush();
+}
+
+void CJSONStreamWriter::Members(const UniValue& obj)
+{
+    const std::vector<std::string>& keys = obj.getKeys();
+    const std::vector<UniValue>& values = obj.getValues();
+    for (size_t i = 0; i < keys.size(); i++) {
+        Key(keys[i]);
+        Value(values[i]);
+    }
+}
+
+void CJSONStreamWriter::Raw(const std::string& str)
+{
+    strBuffer += str;
+    MaybeFlush();
+}
+
+std::string CJSONStreamWriter::TakeBuffer()
+{
+    std::string strRet;
+    strRet.swap(strBuffer);
+    return strRet;
+}
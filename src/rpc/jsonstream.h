@@ -0,0 +1,64 @@
+// Copyright (c) 2014-2019 The Flashcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_RPC_JSONSTREAM_H
+#define BITCOIN_RPC_JSONSTREAM_H
+
+#include <string>
+#include <vector>
+
+#include <boost/function.hpp>
+
+#include <univalue.h>
+
+/** Output is handed to the sink of a CJSONStreamWriter in pieces of about this size */
+static const size_t DEFAULT_JSON_STREAM_CHUNK_SIZE = 64 * 1024;
+
+/**
+ * Incremental JSON writer for large documents. The structure is written
+ * piece by piece and the leaves as small UniValues, so the document is never
+ * held as a whole, neither as a UniValue tree nor as a string: whenever the
+ * buffered text grows past the chunk size it is passed to the sink.
+ */
+class CJSONStreamWriter
+{
+public:
+    typedef boost::function<void(const std::string&)> Sink;
+
+    CJSONStreamWriter(const Sink& sinkIn, size_t nChunkSizeIn = DEFAULT_JSON_STREAM_CHUNK_SIZE);
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+
+    /** Start a member of the current object; the next value written is its value */
+    void Key(const std::string& strKey);
+    /** Write a complete value */
+    void Value(const UniValue& val);
+    /** Write all members of an object value into the current object */
+    void Members(const UniValue& obj);
+    /** Write text outside of the document, such as a trailing newline */
+    void Raw(const std::string& str);
+
+    /** Whether part of the output has been passed to the sink already */
+    bool Flushed() const { return fFlushed; }
+    /** Take the output that has not been passed to the sink */
+    std::string TakeBuffer();
+
+private:
+    Sink sink;
+    size_t nChunkSize;
+    std::string strBuffer;
+    /** One entry per open object or array: whether it is still empty */
+    std::vector<bool> vEmpty;
+    bool fAfterKey;
+    bool fFlushed;
+
+    /** Write the separator needed before a new value or key */
+    void Separate();
+    void MaybeFlush();
+};
+
+#endif // BITCOIN_RPC_JSONSTREAM_H
@@ -416,6 +416,243 @@ UniValue signmessagewithprivkey(const UniValue& params, bool fHelp)
     return EncodeBase64(&vchSig[0], vchSig.size());
 }
 
+/** Convert an address to its -addressindex type and hash */
+static bool GetAddressIndexKey(const CBitcoinAddress& address, unsigned int& type, uint160& hashBytes)
+{
+    CTxDestination dest = address.Get();
+    if (const CKeyID* keyID = boost::get<CKeyID>(&dest)) {
+        type = ADDRESS_INDEX_PUBKEYHASH;
+        hashBytes = *keyID;
+        return true;
+    }
+    if (const CScriptID* scriptID = boost::get<CScriptID>(&dest)) {
+        type = ADDRESS_INDEX_SCRIPTHASH;
+        hashBytes = *scriptID;
+        return true;
+    }
+    return false;
+}
+
+static std::string AddressFromIndexKey(unsigned int type, const uint160& hashBytes)
+{
+    if (type == ADDRESS_INDEX_SCRIPTHASH)
+        return CBitcoinAddress(CScriptID(hashBytes)).ToString();
+    return CBitcoinAddress(CKeyID(hashBytes)).ToString();
+}
+
+/** Parse the first argument of the getaddress* calls: a single address or an object with an "addresses" array */
+static void ParseAddresses(const UniValue& param, std::vector<std::pair<unsigned int, uint160> >& addresses)
+{
+    std::vector<std::string> vstrAddresses;
+    if (param.isStr()) {
+        vstrAddresses.push_back(param.get_str());
+    } else if (param.isObject()) {
+        const UniValue& addressValues = find_value(param.get_obj(), "addresses");
+        if (!addressValues.isArray())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Addresses is expected to be an array");
+        for (size_t i = 0; i < addressValues.size(); i++)
+            vstrAddresses.push_back(addressValues[i].get_str());
+    } else {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Expected an address or an object with an addresses array");
+    }
+
+    BOOST_FOREACH(const std::string& strAddress, vstrAddresses) {
+        CBitcoinAddress address(strAddress);
+        unsigned int type;
+        uint160 hashBytes;
+        if (!address.IsValid() || !GetAddressIndexKey(address, type, hashBytes))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address: " + strAddress);
+        addresses.push_back(std::make_pair(type, hashBytes));
+    }
+}
+
+static bool AddressIndexHeightCompare(const std::pair<CAddressIndexKey, CAmount>& a, const std::pair<CAddressIndexKey, CAmount>& b)
+{
+    if (a.first.blockHeight != b.first.blockHeight)
+        return a.first.blockHeight < b.first.blockHeight;
+    return a.first.txindex < b.first.txindex;
+}
+
+static bool AddressUnspentHeightCompare(const std::pair<CAddressUnspentKey, CAddressUnspentValue>& a, const std::pair<CAddressUnspentKey, CAddressUnspentValue>& b)
+{
+    return a.second.blockHeight < b.second.blockHeight;
+}
+
+UniValue getaddressbalance(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressbalance \"address\" | {\"addresses\": [\"address\",...]}\n"
+            "\nReturns the balance of one or more addresses (requires -addressindex).\n"
+            "\nArguments:\n"
+            "1. \"address\"           (string) A flashcoin address, or an object:\n"
+            "{\n"
+            "  \"addresses\"          (array) The flashcoin addresses\n"
+            "    [\n"
+            "      \"address\"        (string) A flashcoin address\n"
+            "      ,...\n"
+            "    ]\n"
+            "}\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"balance\"  (numeric) The current balance in satoshis\n"
+            "  \"received\" (numeric) The total number of satoshis received (including change)\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressbalance", "'{\"addresses\": [\"UgKVPNUCwt1JzaJjxVAyR5AuTH1LDNXgWp\"]}'")
+            + HelpExampleRpc("getaddressbalance", "{\"addresses\": [\"UgKVPNUCwt1JzaJjxVAyR5AuTH1LDNXgWp\"]}")
+        );
+
+    std::vector<std::pair<unsigned int, uint160> > addresses;
+    ParseAddresses(params[0], addresses);
+
+    CAmount balance = 0;
+    CAmount received = 0;
+    for (size_t i = 0; i < addresses.size(); i++) {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+        if (!GetAddressIndex(addresses[i].first, addresses[i].second, addressIndex))
+            throw JSONRPCError(RPC_MISC_ERROR, "No information available for address");
+        for (size_t j = 0; j < addressIndex.size(); j++) {
+            if (addressIndex[j].second > 0)
+                received += addressIndex[j].second;
+            balance += addressIndex[j].second;
+        }
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("balance", balance));
+    result.push_back(Pair("received", received));
+    return result;
+}
+
+UniValue getaddressdeltas(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressdeltas \"address\" | {\"addresses\": [\"address\",...], \"start\": n, \"end\": n}\n"
+            "\nReturns all changes of one or more addresses (requires -addressindex).\n"
+            "\nArguments:\n"
+            "1. \"address\"           (string) A flashcoin address, or an object:\n"
+            "{\n"
+            "  \"addresses\"          (array) The flashcoin addresses\n"
+            "    [\n"
+            "      \"address\"        (string) A flashcoin address\n"
+            "      ,...\n"
+            "    ]\n"
+            "  \"start\" (numeric, optional) The start block height\n"
+            "  \"end\"   (numeric, optional) The end block height\n"
+            "}\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"satoshis\"   (numeric) The difference of satoshis\n"
+            "    \"txid\"       (string) The related txid\n"
+            "    \"index\"      (numeric) The related input or output index\n"
+            "    \"blockindex\" (numeric) The position of the transaction in the block\n"
+            "    \"height\"     (numeric) The block height\n"
+            "    \"address\"    (string) The flashcoin address\n"
+            "  }\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressdeltas", "'{\"addresses\": [\"UgKVPNUCwt1JzaJjxVAyR5AuTH1LDNXgWp\"]}'")
+            + HelpExampleRpc("getaddressdeltas", "{\"addresses\": [\"UgKVPNUCwt1JzaJjxVAyR5AuTH1LDNXgWp\"]}")
+        );
+
+    int start = 0;
+    int end = 0;
+    if (params[0].isObject()) {
+        const UniValue& startValue = find_value(params[0].get_obj(), "start");
+        const UniValue& endValue = find_value(params[0].get_obj(), "end");
+        if (startValue.isNum() && endValue.isNum()) {
+            start = startValue.get_int();
+            end = endValue.get_int();
+            if (start <= 0 || end <= 0 || end < start)
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Start and end are expected to be a valid range of heights");
+        }
+    }
+
+    std::vector<std::pair<unsigned int, uint160> > addresses;
+    ParseAddresses(params[0], addresses);
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    for (size_t i = 0; i < addresses.size(); i++) {
+        if (!GetAddressIndex(addresses[i].first, addresses[i].second, addressIndex, start, end))
+            throw JSONRPCError(RPC_MISC_ERROR, "No information available for address");
+    }
+    std::stable_sort(addressIndex.begin(), addressIndex.end(), AddressIndexHeightCompare);
+
+    UniValue result(UniValue::VARR);
+    for (size_t i = 0; i < addressIndex.size(); i++) {
+        const CAddressIndexKey& key = addressIndex[i].first;
+        UniValue delta(UniValue::VOBJ);
+        delta.push_back(Pair("satoshis", addressIndex[i].second));
+        delta.push_back(Pair("txid", key.txhash.GetHex()));
+        delta.push_back(Pair("index", (int)key.index));
+        delta.push_back(Pair("blockindex", (int)key.txindex));
+        delta.push_back(Pair("height", key.blockHeight));
+        delta.push_back(Pair("address", AddressFromIndexKey(key.type, key.hashBytes)));
+        result.push_back(delta);
+    }
+    return result;
+}
+
+UniValue getaddressutxos(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressutxos \"address\" | {\"addresses\": [\"address\",...]}\n"
+            "\nReturns all unspent outputs of one or more addresses (requires -addressindex).\n"
+            "\nArguments:\n"
+            "1. \"address\"           (string) A flashcoin address, or an object:\n"
+            "{\n"
+            "  \"addresses\"          (array) The flashcoin addresses\n"
+            "    [\n"
+            "      \"address\"        (string) A flashcoin address\n"
+            "      ,...\n"
+            "    ]\n"
+            "}\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"address\"     (string) The flashcoin address\n"
+            "    \"txid\"        (string) The output txid\n"
+            "    \"outputIndex\" (numeric) The output index\n"
+            "    \"script\"      (string) The script hex encoded\n"
+            "    \"satoshis\"    (numeric) The number of satoshis of the output\n"
+            "    \"height\"      (numeric) The block height\n"
+            "  }\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressutxos", "'{\"addresses\": [\"UgKVPNUCwt1JzaJjxVAyR5AuTH1LDNXgWp\"]}'")
+            + HelpExampleRpc("getaddressutxos", "{\"addresses\": [\"UgKVPNUCwt1JzaJjxVAyR5AuTH1LDNXgWp\"]}")
+        );
+
+    std::vector<std::pair<unsigned int, uint160> > addresses;
+    ParseAddresses(params[0], addresses);
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    for (size_t i = 0; i < addresses.size(); i++) {
+        if (!GetAddressUnspent(addresses[i].first, addresses[i].second, unspentOutputs))
+            throw JSONRPCError(RPC_MISC_ERROR, "No information available for address");
+    }
+    std::stable_sort(unspentOutputs.begin(), unspentOutputs.end(), AddressUnspentHeightCompare);
+
+    UniValue result(UniValue::VARR);
+    for (size_t i = 0; i < unspentOutputs.size(); i++) {
+        const CAddressUnspentKey& key = unspentOutputs[i].first;
+        const CAddressUnspentValue& value = unspentOutputs[i].second;
+        UniValue output(UniValue::VOBJ);
+        output.push_back(Pair("address", AddressFromIndexKey(key.type, key.hashBytes)));
+        output.push_back(Pair("txid", key.txhash.GetHex()));
+        output.push_back(Pair("outputIndex", (int)key.index));
+        output.push_back(Pair("script", HexStr(value.script.begin(), value.script.end())));
+        output.push_back(Pair("satoshis", value.satoshis));
+        output.push_back(Pair("height", value.blockHeight));
+        result.push_back(output);
+    }
+    return result;
+}
+
 UniValue setmocktime(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 1)
@@ -456,6 +693,10 @@ static const CRPCCommand commands[] =
     { "util",               "verifymessage",          &verifymessage,          true  },
     { "util",               "signmessagewithprivkey", &signmessagewithprivkey, true  },
 
+    { "addressindex",       "getaddressbalance",      &getaddressbalance,      true  },
+    { "addressindex",       "getaddressdeltas",       &getaddressdeltas,       true  },
+    { "addressindex",       "getaddressutxos",        &getaddressutxos,        true  },
+
     /* Not shown in help */
     { "hidden",             "setmocktime",            &setmocktime,            true  },
 };
@@ -353,6 +353,13 @@ UniValue getnettotals(const UniValue& params, bool fHelp)
             "    \"serve_historical_blocks\": true|false,  (boolean) True if serving historical blocks\n"
             "    \"bytes_left_in_cycle\": t,               (numeric) Bytes left in current time cycle\n"
             "    \"time_left_in_cycle\": t                 (numeric) Seconds left in current time cycle\n"
+            "  },\n"
+            "  \"recvbuffers\":\n"
+            "  {\n"
+            "    \"allocations\": n,   (numeric) Receive buffers allocated because the pool had none large enough\n"
+            "    \"reuses\": n,        (numeric) Receive buffers taken from the pool instead\n"
+            "    \"pooled\": n,        (numeric) Buffers in the pool now\n"
+            "    \"pooledbytes\": n    (numeric) Total size of the buffers in the pool\n"
             "  }\n"
             "}\n"
             "\nExamples:\n"
@@ -373,6 +380,14 @@ UniValue getnettotals(const UniValue& params, bool fHelp)
     outboundLimit.push_back(Pair("bytes_left_in_cycle", CNode::GetOutboundTargetBytesLeft()));
     outboundLimit.push_back(Pair("time_left_in_cycle", CNode::GetMaxOutboundTimeLeftInCycle()));
     obj.push_back(Pair("uploadtarget", outboundLimit));
+
+    CRecvBufferPool::Stats recvBufferStats = GetRecvBufferStats();
+    UniValue recvBuffers(UniValue::VOBJ);
+    recvBuffers.push_back(Pair("allocations", recvBufferStats.nAllocations));
+    recvBuffers.push_back(Pair("reuses", recvBufferStats.nReuses));
+    recvBuffers.push_back(Pair("pooled", recvBufferStats.nPooled));
+    recvBuffers.push_back(Pair("pooledbytes", recvBufferStats.nPooledBytes));
+    obj.push_back(Pair("recvbuffers", recvBuffers));
     return obj;
 }
 
@@ -15,6 +15,8 @@
 
 #include <univalue.h>
 
+#include <atomic>
+
 #include <boost/bind.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/foreach.hpp>
@@ -518,11 +520,101 @@ static UniValue JSONRPCExecOne(const UniValue& req)
     return rpc_result;
 }
 
-std::string JSONRPCExecBatch(const UniValue& vReq)
+/** Whether a batch entry only reads node state, so that it may run concurrently with its neighbours */
+static bool IsParallelBatchRequest(const UniValue& req)
 {
+    if (!req.isObject())
+        return false;
+    const UniValue& method = find_value(req.get_obj(), "method");
+    if (!method.isStr())
+        return false;
+    const CRPCCommand *pcmd = tableRPC[method.get_str()];
+    if (!pcmd || !pcmd->okSafeMode)
+        return false;
+    // Safe mode commands elsewhere (wallet, mining, hidden) may change state
+    return pcmd->category == "blockchain" || pcmd->category == "rawtransactions" ||
+           pcmd->category == "addressindex" || pcmd->category == "util";
+}
+
+/**
+ * A run of consecutive read-only batch entries. Threads working on it claim
+ * entries in turn; the state is shared with the dispatched tasks so that a
+ * task which only starts after the run completed finds nothing left to do.
+ */
+class CRPCBatchRun
+{
+private:
+    std::vector<UniValue> vReq;
+    std::vector<UniValue> vReply;
+    std::atomic<size_t> nNext;
+    CWaitableCriticalSection cs;
+    CConditionVariable cond;
+    size_t nDone;
+
+public:
+    CRPCBatchRun(const UniValue& vBatch, size_t nBegin, size_t nEnd) :
+        vReply(nEnd - nBegin), nNext(0), nDone(0)
+    {
+        vReq.reserve(nEnd - nBegin);
+        for (size_t i = nBegin; i < nEnd; i++)
+            vReq.push_back(vBatch[i]);
+    }
+
+    void Work()
+    {
+        size_t n;
+        while ((n = nNext++) < vReq.size()) {
+            try {
+                vReply[n] = JSONRPCExecOne(vReq[n]);
+            } catch (...) {
+                vReply[n] = JSONRPCReplyObj(NullUniValue, JSONRPCError(RPC_MISC_ERROR, "Unknown exception"), find_value(vReq[n], "id"));
+            }
+            boost::unique_lock<boost::mutex> lock(cs);
+            if (++nDone == vReq.size())
+                cond.notify_all();
+        }
+    }
+
+    /** Wait until every entry has been executed, then append the replies in order */
+    void Finish(UniValue& ret)
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            while (nDone < vReq.size())
+                cond.wait(lock);
+        }
+        for (size_t i = 0; i < vReply.size(); i++)
+            ret.push_back(vReply[i]);
+    }
+};
+
+std::string JSONRPCExecBatch(const UniValue& vReq, const RPCBatchDispatcher& dispatch)
+{
+    int nThreads = dispatch.empty() ? 1 : std::max((int)GetArg("-rpcbatchthreads", DEFAULT_RPC_BATCH_THREADS), 1);
+
     UniValue ret(UniValue::VARR);
-    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+    unsigned int reqIdx = 0;
+    while (reqIdx < vReq.size()) {
+        unsigned int runEnd = reqIdx;
+        if (nThreads > 1)
+            while (runEnd < vReq.size() && IsParallelBatchRequest(vReq[runEnd]))
+                runEnd++;
+        if (runEnd - reqIdx < 2) {
+            ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+            reqIdx++;
+            continue;
+        }
+
+        boost::shared_ptr<CRPCBatchRun> run(new CRPCBatchRun(vReq, reqIdx, runEnd));
+        int nHelpers = std::min(nThreads - 1, (int)(runEnd - reqIdx) - 1);
+        for (int i = 0; i < nHelpers; i++)
+            if (!dispatch(boost::bind(&CRPCBatchRun::Work, run)))
+                break;
+        // Work on the run here as well, so it completes even if no helper gets a thread
+        run->Work();
+        run->Finish(ret);
+        reqIdx = runEnd;
+    }
 
     return ret.write() + "\n";
 }
@@ -556,6 +648,41 @@ UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params
     g_rpcSignals.PostCommand(*pcmd);
 }
 
+bool CRPCTable::executeStream(const std::string &strMethod, const UniValue &params, CJSONStreamWriter& writer) const
+{
+    const CRPCCommand *pcmd = tableRPC[strMethod];
+    if (!pcmd || !pcmd->streamActor)
+        return false;
+
+    {
+        LOCK(cs_rpcWarmup);
+        if (fRPCInWarmup)
+            throw JSONRPCError(RPC_IN_WARMUP, rpcWarmupStatus);
+    }
+
+    g_rpcSignals.PreCommand(*pcmd);
+
+    // Listeners pair every PreCommand with a PostCommand, so fire it on every way out
+    bool fResult;
+    try
+    {
+        fResult = pcmd->streamActor(params, writer);
+    }
+    catch (const std::exception& e)
+    {
+        g_rpcSignals.PostCommand(*pcmd);
+        throw JSONRPCError(RPC_MISC_ERROR, e.what());
+    }
+    catch (...)
+    {
+        g_rpcSignals.PostCommand(*pcmd);
+        throw;
+    }
+
+    g_rpcSignals.PostCommand(*pcmd);
+    return fResult;
+}
+
 std::vector<std::string> CRPCTable::listCommands() const
 {
     std::vector<std::string> commandList;
@@ -20,7 +20,10 @@
 #include <univalue.h>
 
 static const unsigned int DEFAULT_RPC_SERIALIZE_VERSION = 1;
+/** Default for -rpcbatchthreads, the number of threads a single JSON-RPC batch may use */
+static const int DEFAULT_RPC_BATCH_THREADS = 4;
 
+class CJSONStreamWriter;
 class CRPCCommand;
 
 namespace RPCServer
@@ -125,6 +128,12 @@ void RPCUnsetTimerInterface(RPCTimerInterface *iface);
 void RPCRunLater(const std::string& name, boost::function<void(void)> func, int64_t nSeconds);
 
 typedef UniValue(*rpcfn_type)(const UniValue& params, bool fHelp);
+/**
+ * Writes the result of a call straight to a JSON stream instead of returning it.
+ * Returns false, having written nothing, for calls it does not handle; the
+ * regular actor is used for those.
+ */
+typedef bool(*rpcstreamfn_type)(const UniValue& params, CJSONStreamWriter& writer);
 
 class CRPCCommand
 {
@@ -133,6 +142,8 @@ public:
     std::string name;
     rpcfn_type actor;
     bool okSafeMode;
+    /** Optional streaming form of actor, for commands with very large results */
+    rpcstreamfn_type streamActor;
 };
 
 /**
@@ -156,6 +167,15 @@ public:
      */
     UniValue execute(const std::string &method, const UniValue &params) const;
 
+    /**
+     * Execute a method through its streaming actor, writing the result to writer.
+     * @returns false if the method has no streaming actor or it does not handle these
+     * params; use execute() then.
+     * @throws an exception (UniValue) when an error happens. Part of the result
+     * may have been written already by then.
+     */
+    bool executeStream(const std::string &method, const UniValue &params, CJSONStreamWriter& writer) const;
+
     /**
     * Returns a list of registered commands
     * @returns List of registered commands.
@@ -290,7 +310,15 @@ extern UniValue reconsiderblock(const UniValue& params, bool fHelp);
 bool StartRPC();
 void InterruptRPC();
 void StopRPC();
-std::string JSONRPCExecBatch(const UniValue& vReq);
+
+/** Runs a task on another thread, returning false if it could not be queued */
+typedef boost::function<bool(const boost::function<void(void)>&)> RPCBatchDispatcher;
+/**
+ * Execute a JSON-RPC batch and return the serialized array of replies, in request order.
+ * Consecutive read-only commands are spread over up to -rpcbatchthreads threads using
+ * dispatch; any other command waits for the preceding entries and runs on its own.
+ */
+std::string JSONRPCExecBatch(const UniValue& vReq, const RPCBatchDispatcher& dispatch = RPCBatchDispatcher());
 
 // Retrieves any serialization flags requested in command line argument
 int RPCSerializationFlags();
@@ -0,0 +1,84 @@
+// Copyright (c) 2014-2019 The Flashcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SPENTINDEX_H
+#define BITCOIN_SPENTINDEX_H
+
+#include "amount.h"
+#include "serialize.h"
+#include "uint256.h"
+
+/** Key of a spent index entry: the output that was spent */
+struct CSpentIndexKey
+{
+    uint256 txid;
+    unsigned int outputIndex;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(txid);
+        READWRITE(outputIndex);
+    }
+
+    CSpentIndexKey() {
+        SetNull();
+    }
+
+    CSpentIndexKey(const uint256& txidIn, unsigned int outputIndexIn) :
+        txid(txidIn), outputIndex(outputIndexIn) {}
+
+    void SetNull() {
+        txid.SetNull();
+        outputIndex = 0;
+    }
+};
+
+/** Value of a spent index entry: the input spending the output, and what the output paid to; a null value erases the entry */
+struct CSpentIndexValue
+{
+    uint256 txid;
+    unsigned int inputIndex;
+    int blockHeight;
+    CAmount satoshis;
+    unsigned int addressType;
+    uint160 addressHash;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(txid);
+        READWRITE(inputIndex);
+        READWRITE(blockHeight);
+        READWRITE(satoshis);
+        READWRITE(addressType);
+        READWRITE(addressHash);
+    }
+
+    CSpentIndexValue() {
+        SetNull();
+    }
+
+    CSpentIndexValue(const uint256& txidIn, unsigned int inputIndexIn, int blockHeightIn, CAmount satoshisIn,
+                     unsigned int addressTypeIn, const uint160& addressHashIn) :
+        txid(txidIn), inputIndex(inputIndexIn), blockHeight(blockHeightIn), satoshis(satoshisIn),
+        addressType(addressTypeIn), addressHash(addressHashIn) {}
+
+    void SetNull() {
+        txid.SetNull();
+        inputIndex = 0;
+        blockHeight = 0;
+        satoshis = 0;
+        addressType = 0;
+        addressHash.SetNull();
+    }
+
+    bool IsNull() const {
+        return txid.IsNull();
+    }
+};
+
+#endif // BITCOIN_SPENTINDEX_H
@@ -332,6 +332,12 @@ public:
         clear();
     }
 
+    /** Exchange the underlying buffer with data without copying, reading starts over */
+    void SwapBuffer(CSerializeData &data) {
+        vch.swap(data);
+        nReadPos = 0;
+    }
+
     /**
      * XOR the contents of this stream with a certain key.
      *
@@ -365,6 +371,54 @@ public:
 
 
 
+/** Read-only stream over a range of memory it does not own, such as part of a mapped file.
+ *
+ * Reading past the end of the range throws, like reading past the end of a file.
+ */
+class CMemoryReader
+{
+private:
+    const int nType;
+    const int nVersion;
+
+    const char* pcur;
+    const char* pend;
+
+public:
+    CMemoryReader(const char* pbegin, size_t nSize, int nTypeIn, int nVersionIn) :
+        nType(nTypeIn), nVersion(nVersionIn), pcur(pbegin), pend(pbegin + nSize) {}
+
+    int GetType() const     { return nType; }
+    int GetVersion() const  { return nVersion; }
+    size_t size() const     { return pend - pcur; }
+    bool empty() const      { return pcur == pend; }
+
+    CMemoryReader& read(char* pch, size_t nSize)
+    {
+        if (nSize > size())
+            throw std::ios_base::failure("CMemoryReader::read(): end of data");
+        memcpy(pch, pcur, nSize);
+        pcur += nSize;
+        return (*this);
+    }
+
+    CMemoryReader& ignore(size_t nSize)
+    {
+        if (nSize > size())
+            throw std::ios_base::failure("CMemoryReader::ignore(): end of data");
+        pcur += nSize;
+        return (*this);
+    }
+
+    template<typename T>
+    CMemoryReader& operator>>(T& obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+};
+
 /** Non-refcounted RAII wrapper for FILE*
  *
  * Will automatically close the file when it goes out of scope if not null.
@@ -0,0 +1,189 @@
+// Copyright (c) 2014-2019 The Flashcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+#define BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+
+#include <assert.h>
+#include <stddef.h>
+
+#include <list>
+#include <new>
+#include <vector>
+
+/**
+ * Memory resource for node-based containers that allocate many objects of the
+ * same few sizes, like the entries of a hash map.
+ *
+ * Memory is carved out of large chunks, so the blocks carry no per-allocation
+ * malloc header and lie next to each other. Freed blocks go to a free list for
+ * their size and are handed out again before new chunk memory is used. Chunks
+ * are only returned to the system when the resource is destroyed.
+ *
+ * Requests larger than MAX_BLOCK_SIZE_BYTES, or with a stricter alignment than
+ * ALIGN_BYTES, are passed on to operator new; the bucket array of a hash map
+ * normally ends up there.
+ *
+ * Not thread-safe: a resource is owned by one container.
+ */
+template <size_t MAX_BLOCK_SIZE_BYTES, size_t ALIGN_BYTES>
+class PoolResource
+{
+    static_assert(ALIGN_BYTES > 0 && (ALIGN_BYTES & (ALIGN_BYTES - 1)) == 0, "ALIGN_BYTES must be a power of two");
+
+    /** Free block, linked in place of the data it held */
+    struct ListNode
+    {
+        ListNode* next;
+        explicit ListNode(ListNode* nextIn) : next(nextIn) {}
+    };
+
+    /** Granularity of all blocks; large enough to hold a ListNode */
+    static const size_t ELEM_ALIGN_BYTES = ALIGN_BYTES > sizeof(ListNode) ? ALIGN_BYTES : sizeof(ListNode);
+    static_assert(ELEM_ALIGN_BYTES % alignof(ListNode) == 0, "block alignment must suit ListNode");
+    static_assert(ELEM_ALIGN_BYTES <= alignof(max_align_t), "operator new must provide the block alignment");
+
+    const size_t nChunkSizeBytes;
+    std::list<char*> allocatedChunks;
+    /** Free list for every block size, indexed by size in multiples of ELEM_ALIGN_BYTES */
+    std::vector<ListNode*> vFreeLists;
+    size_t nFreeListBytes;
+    /** Unused part of the newest chunk */
+    char* pAvailableBegin;
+    char* pAvailableEnd;
+
+    static size_t NumElemAlignBytes(size_t nBytes)
+    {
+        return (nBytes + ELEM_ALIGN_BYTES - 1) / ELEM_ALIGN_BYTES + (nBytes == 0);
+    }
+
+    static bool IsFreeListUsable(size_t nBytes, size_t nAlignment)
+    {
+        return nAlignment <= ELEM_ALIGN_BYTES && nBytes <= MAX_BLOCK_SIZE_BYTES;
+    }
+
+    void PushFree(void* p, size_t nIndex)
+    {
+        vFreeLists[nIndex] = new (p) ListNode(vFreeLists[nIndex]);
+        nFreeListBytes += nIndex * ELEM_ALIGN_BYTES;
+    }
+
+    void AllocateChunk()
+    {
+        // The rest of the current chunk is always a whole number of blocks;
+        // keep it around as a free block instead of wasting it.
+        if (pAvailableBegin != pAvailableEnd)
+            PushFree(pAvailableBegin, (pAvailableEnd - pAvailableBegin) / ELEM_ALIGN_BYTES);
+        char* pChunk = static_cast<char*>(::operator new(nChunkSizeBytes));
+        allocatedChunks.push_back(pChunk);
+        pAvailableBegin = pChunk;
+        pAvailableEnd = pChunk + nChunkSizeBytes;
+    }
+
+    // Disallow copies
+    PoolResource(const PoolResource&);
+    PoolResource& operator=(const PoolResource&);
+
+public:
+    /** The first chunk is only allocated on first use, so empty containers stay cheap */
+    explicit PoolResource(size_t nChunkSizeBytesIn = 256 * 1024) :
+        nChunkSizeBytes(NumElemAlignBytes(nChunkSizeBytesIn) * ELEM_ALIGN_BYTES),
+        vFreeLists(MAX_BLOCK_SIZE_BYTES / ELEM_ALIGN_BYTES + 1, NULL), nFreeListBytes(0),
+        pAvailableBegin(NULL), pAvailableEnd(NULL)
+    {
+        assert(nChunkSizeBytes >= MAX_BLOCK_SIZE_BYTES);
+    }
+
+    ~PoolResource()
+    {
+        for (std::list<char*>::iterator it = allocatedChunks.begin(); it != allocatedChunks.end(); ++it)
+            ::operator delete(*it);
+    }
+
+    void* Allocate(size_t nBytes, size_t nAlignment)
+    {
+        if (!IsFreeListUsable(nBytes, nAlignment))
+            return ::operator new(nBytes);
+        const size_t nIndex = NumElemAlignBytes(nBytes);
+        if (vFreeLists[nIndex] != NULL) {
+            ListNode* pNode = vFreeLists[nIndex];
+            vFreeLists[nIndex] = pNode->next;
+            nFreeListBytes -= nIndex * ELEM_ALIGN_BYTES;
+            pNode->~ListNode();
+            return pNode;
+        }
+        const size_t nRoundBytes = nIndex * ELEM_ALIGN_BYTES;
+        if (nRoundBytes > (size_t)(pAvailableEnd - pAvailableBegin))
+            AllocateChunk();
+        void* p = pAvailableBegin;
+        pAvailableBegin += nRoundBytes;
+        return p;
+    }
+
+    void Deallocate(void* p, size_t nBytes, size_t nAlignment)
+    {
+        if (IsFreeListUsable(nBytes, nAlignment))
+            PushFree(p, NumElemAlignBytes(nBytes));
+        else
+            ::operator delete(p);
+    }
+
+    size_t NumAllocatedChunks() const { return allocatedChunks.size(); }
+    size_t ChunkSizeBytes() const { return nChunkSizeBytes; }
+    /** Chunk memory not handed out at the moment, on free lists or not used yet */
+    size_t FreeBytes() const { return nFreeListBytes + (pAvailableEnd - pAvailableBegin); }
+};
+
+/**
+ * Allocator drawing from a PoolResource, for use with node-based containers:
+ * all copies and rebinds share the resource, which must outlive the container.
+ */
+template <typename T, size_t MAX_BLOCK_SIZE_BYTES, size_t ALIGN_BYTES = alignof(max_align_t)>
+class PoolAllocator
+{
+public:
+    typedef T value_type;
+    typedef PoolResource<MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> ResourceType;
+
+    template <typename U>
+    struct rebind {
+        typedef PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> other;
+    };
+
+    PoolAllocator(ResourceType* resourceIn) throw() : resource(resourceIn) {}
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& other) throw() : resource(other.GetResource()) {}
+
+    T* allocate(size_t n)
+    {
+        return static_cast<T*>(resource->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* p, size_t n) throw()
+    {
+        resource->Deallocate(p, n * sizeof(T), alignof(T));
+    }
+
+    ResourceType* GetResource() const throw() { return resource; }
+
+private:
+    ResourceType* resource;
+};
+
+template <typename T1, typename T2, size_t MAX_BLOCK_SIZE_BYTES, size_t ALIGN_BYTES>
+bool operator==(const PoolAllocator<T1, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& a,
+                const PoolAllocator<T2, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& b) throw()
+{
+    return a.GetResource() == b.GetResource();
+}
+
+template <typename T1, typename T2, size_t MAX_BLOCK_SIZE_BYTES, size_t ALIGN_BYTES>
+bool operator!=(const PoolAllocator<T1, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& a,
+                const PoolAllocator<T2, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& b) throw()
+{
+    return !(a == b);
+}
+
+#endif // BITCOIN_SUPPORT_ALLOCATORS_POOL_H
@@ -5,10 +5,13 @@
 // Unit tests for denial-of-service detection/prevention code
 
 #include "chainparams.h"
+#include "crypto/common.h"
+#include "hash.h"
 #include "keystore.h"
 #include "main.h"
 #include "net.h"
 #include "pow.h"
+#include "protocol.h"
 #include "script/sign.h"
 #include "serialize.h"
 #include "util.h"
@@ -114,6 +117,40 @@ CTransaction RandomOrphan()
     return it->second.tx;
 }
 
+static void ReceiveEmptyMessage(CNode& node, const char* pszCommand)
+{
+    CMessageHeader hdr(Params().MessageStart(), pszCommand, 0);
+    std::vector<unsigned char> vPayload;
+    uint256 hash = Hash(vPayload.begin(), vPayload.end());
+    hdr.nChecksum = ReadLE32(hash.begin());
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << hdr;
+    LOCK(node.cs_vRecvMsg);
+    BOOST_REQUIRE(node.ReceiveMsgBytes(&ss[0], ss.size()));
+}
+
+BOOST_AUTO_TEST_CASE(DoS_parallel_message_order)
+{
+    CAddress addr(ip(0xa0b0c004), NODE_NONE);
+    CNode dummyNode(INVALID_SOCKET, addr, "", true);
+    dummyNode.nVersion = PROTOCOL_VERSION;
+    ReceiveEmptyMessage(dummyNode, NetMsgType::REJECT);
+    ReceiveEmptyMessage(dummyNode, NetMsgType::SENDHEADERS);
+    ReceiveEmptyMessage(dummyNode, NetMsgType::REJECT);
+
+    LOCK(dummyNode.cs_vRecvMsg);
+    BOOST_CHECK(ProcessMessages(&dummyNode, true));
+    BOOST_CHECK_EQUAL(dummyNode.vRecvMsg.size(), 2U);
+    // A parallel handler must not skip past a message for the main handler
+    BOOST_CHECK(ProcessMessages(&dummyNode, true));
+    BOOST_CHECK_EQUAL(dummyNode.vRecvMsg.size(), 2U);
+    BOOST_CHECK(ProcessMessages(&dummyNode, false));
+    BOOST_CHECK_EQUAL(dummyNode.vRecvMsg.size(), 1U);
+    BOOST_CHECK(ProcessMessages(&dummyNode, true));
+    BOOST_CHECK(dummyNode.vRecvMsg.empty());
+    BOOST_CHECK(!dummyNode.fDisconnect);
+}
+
 BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
 {
     CKey key;
@@ -0,0 +1,104 @@
+// Copyright (c) 2014-2019 The Flashcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "addressindex.h"
+#include "arith_uint256.h"
+#include "random.h"
+#include "spentindex.h"
+#include "test/test_bitcoin.h"
+#include "timestampindex.h"
+#include "txdb.h"
+#include "utilstrencodings.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(addressindex_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(addressindex_read_range)
+{
+    CBlockTreeDB db(1 << 20, true);
+    uint160 hashA = uint160(ParseHex("0000000000000000000000000000000000000001"));
+    uint160 hashB = uint160(ParseHex("0000000000000000000000000000000000000002"));
+
+    // Heights around byte boundaries, which would be misordered if stored little endian
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vect;
+    int heights[] = {255, 1, 256, 70000};
+    for (unsigned int i = 0; i < 4; i++)
+        vect.push_back(std::make_pair(CAddressIndexKey(ADDRESS_INDEX_PUBKEYHASH, hashA, heights[i], 1, GetRandHash(), 0, false), (CAmount)heights[i]));
+    vect.push_back(std::make_pair(CAddressIndexKey(ADDRESS_INDEX_SCRIPTHASH, hashA, 10, 0, GetRandHash(), 0, false), 5));
+    vect.push_back(std::make_pair(CAddressIndexKey(ADDRESS_INDEX_PUBKEYHASH, hashB, 10, 0, GetRandHash(), 0, true), -5));
+    BOOST_CHECK(db.WriteAddressIndex(vect));
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > result;
+    BOOST_CHECK(db.ReadAddressIndex(ADDRESS_INDEX_PUBKEYHASH, hashA, result));
+    BOOST_CHECK_EQUAL(result.size(), 4U);
+    for (unsigned int i = 1; i < result.size(); i++)
+        BOOST_CHECK(result[i - 1].first.blockHeight < result[i].first.blockHeight);
+
+    result.clear();
+    BOOST_CHECK(db.ReadAddressIndex(ADDRESS_INDEX_PUBKEYHASH, hashA, result, 200, 300));
+    BOOST_CHECK_EQUAL(result.size(), 2U);
+    BOOST_CHECK_EQUAL(result[0].second, 255);
+    BOOST_CHECK_EQUAL(result[1].second, 256);
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vErase(vect.begin(), vect.begin() + 2);
+    BOOST_CHECK(db.EraseAddressIndex(vErase));
+    result.clear();
+    BOOST_CHECK(db.ReadAddressIndex(ADDRESS_INDEX_PUBKEYHASH, hashA, result));
+    BOOST_CHECK_EQUAL(result.size(), 2U);
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_unspent_and_spent)
+{
+    CBlockTreeDB db(1 << 20, true);
+    uint160 hash = uint160(ParseHex("00000000000000000000000000000000000000ff"));
+    uint256 txid = GetRandHash();
+
+    // Created and spent within the same batch: the later erase wins
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspent;
+    vUnspent.push_back(std::make_pair(CAddressUnspentKey(ADDRESS_INDEX_PUBKEYHASH, hash, txid, 0), CAddressUnspentValue(100, CScript(), 5)));
+    vUnspent.push_back(std::make_pair(CAddressUnspentKey(ADDRESS_INDEX_PUBKEYHASH, hash, txid, 1), CAddressUnspentValue(200, CScript(), 5)));
+    vUnspent.push_back(std::make_pair(CAddressUnspentKey(ADDRESS_INDEX_PUBKEYHASH, hash, txid, 0), CAddressUnspentValue()));
+    BOOST_CHECK(db.UpdateAddressUnspentIndex(vUnspent));
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > result;
+    BOOST_CHECK(db.ReadAddressUnspentIndex(ADDRESS_INDEX_PUBKEYHASH, hash, result));
+    BOOST_CHECK_EQUAL(result.size(), 1U);
+    BOOST_CHECK_EQUAL(result[0].first.index, 1U);
+    BOOST_CHECK_EQUAL(result[0].second.satoshis, 200);
+
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > vSpent;
+    vSpent.push_back(std::make_pair(CSpentIndexKey(txid, 1), CSpentIndexValue(GetRandHash(), 3, 6, 200, ADDRESS_INDEX_PUBKEYHASH, hash)));
+    BOOST_CHECK(db.UpdateSpentIndex(vSpent));
+    CSpentIndexValue value;
+    BOOST_CHECK(db.ReadSpentIndex(CSpentIndexKey(txid, 1), value));
+    BOOST_CHECK_EQUAL(value.inputIndex, 3U);
+    BOOST_CHECK_EQUAL(value.blockHeight, 6);
+    BOOST_CHECK(!db.ReadSpentIndex(CSpentIndexKey(txid, 0), value));
+
+    vSpent[0].second.SetNull();
+    BOOST_CHECK(db.UpdateSpentIndex(vSpent));
+    BOOST_CHECK(!db.ReadSpentIndex(CSpentIndexKey(txid, 1), value));
+}
+
+BOOST_AUTO_TEST_CASE(timestampindex_read_range)
+{
+    CBlockTreeDB db(1 << 20, true);
+    unsigned int timestamps[] = {1000, 256, 1500, 2000};
+    for (unsigned int i = 0; i < 4; i++)
+        BOOST_CHECK(db.WriteTimestampIndex(CTimestampIndexKey(timestamps[i], ArithToUint256(arith_uint256(timestamps[i])))));
+
+    std::vector<uint256> hashes;
+    BOOST_CHECK(db.ReadTimestampIndex(2000, 256, hashes));
+    BOOST_CHECK_EQUAL(hashes.size(), 3U);
+    BOOST_CHECK(hashes[0] == ArithToUint256(arith_uint256(256)));
+    BOOST_CHECK(hashes[2] == ArithToUint256(arith_uint256(1500)));
+
+    BOOST_CHECK(db.EraseTimestampIndex(CTimestampIndexKey(1000, ArithToUint256(arith_uint256(1000)))));
+    hashes.clear();
+    BOOST_CHECK(db.ReadTimestampIndex(2000, 256, hashes));
+    BOOST_CHECK_EQUAL(hashes.size(), 2U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -7,14 +7,18 @@
 #include "script/standard.h"
 #include "uint256.h"
 #include "utilstrencodings.h"
+#include "utiltime.h"
 #include "test/test_bitcoin.h"
 #include "main.h"
+#include "txdb.h"
 #include "consensus/validation.h"
 
 #include <vector>
 #include <map>
 
+#include <boost/bind.hpp>
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
 
 namespace
 {
@@ -46,7 +50,7 @@ public:
 
     uint256 GetBestBlock() const { return hashBestBlock_; }
 
-    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, bool fErase = true)
     {
         for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); ) {
             if (it->second.flags & CCoinsCacheEntry::DIRTY) {
@@ -57,7 +61,10 @@ public:
                     map_.erase(it->first);
                 }
             }
-            mapCoins.erase(it++);
+            if (fErase)
+                mapCoins.erase(it++);
+            else
+                ++it;
         }
         if (!hashBlock.IsNull())
             hashBestBlock_ = hashBlock;
@@ -65,6 +72,50 @@ public:
     }
 };
 
+/** CCoinsViewTest whose writes block until released, to look at a batch in flight */
+class CCoinsViewBlockingTest : public CCoinsViewTest
+{
+    boost::mutex cs;
+    boost::condition_variable cond;
+    bool fBlocked;
+
+public:
+    CCoinsViewBlockingTest() : fBlocked(true) {}
+
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, bool fErase = true)
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            while (fBlocked)
+                cond.wait(lock);
+        }
+        return CCoinsViewTest::BatchWrite(mapCoins, hashBlock, fErase);
+    }
+
+    void Release()
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        fBlocked = false;
+        cond.notify_all();
+    }
+};
+
+/** CCoinsViewTest whose writes can be made to fail */
+class CCoinsViewFailingTest : public CCoinsViewTest
+{
+public:
+    bool fFail;
+
+    CCoinsViewFailingTest() : fFail(false) {}
+
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, bool fErase = true)
+    {
+        if (fFail)
+            return false;
+        return CCoinsViewTest::BatchWrite(mapCoins, hashBlock, fErase);
+    }
+};
+
 class CCoinsViewCacheTest : public CCoinsViewCache
 {
 public:
@@ -107,6 +158,8 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     bool updated_an_entry = false;
     bool found_an_entry = false;
     bool missed_an_entry = false;
+    bool synced_a_cache = false;
+    bool trimmed_a_cache = false;
 
     // A simple map to track what we expect the cache stack to represent.
     std::map<uint256, CCoins> result;
@@ -168,7 +221,22 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
             // Every 100 iterations, flush an intermediate cache
             if (stack.size() > 1 && insecure_rand() % 2 == 0) {
                 unsigned int flushIndex = insecure_rand() % (stack.size() - 1);
-                stack[flushIndex]->Flush();
+                switch (insecure_rand() % 3) {
+                case 0:
+                    stack[flushIndex]->Flush();
+                    break;
+                case 1:
+                    stack[flushIndex]->Sync();
+                    synced_a_cache = true;
+                    break;
+                default:
+                    // Write, then evict everything that is clean
+                    stack[flushIndex]->Sync();
+                    if (stack[flushIndex]->Trim(0) > 0)
+                        trimmed_a_cache = true;
+                    BOOST_CHECK_EQUAL(stack[flushIndex]->GetDirtyCount(), 0U);
+                    break;
+                }
             }
         }
         if (insecure_rand() % 100 == 0) {
@@ -209,6 +277,8 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     BOOST_CHECK(updated_an_entry);
     BOOST_CHECK(found_an_entry);
     BOOST_CHECK(missed_an_entry);
+    BOOST_CHECK(synced_a_cache);
+    BOOST_CHECK(trimmed_a_cache);
 }
 
 // This test is similar to the previous test
@@ -316,7 +386,19 @@ BOOST_AUTO_TEST_CASE(updatecoins_simulation_test)
             // Every 100 iterations, flush an intermediate cache
             if (stack.size() > 1 && insecure_rand() % 2 == 0) {
                 unsigned int flushIndex = insecure_rand() % (stack.size() - 1);
-                stack[flushIndex]->Flush();
+                switch (insecure_rand() % 3) {
+                case 0:
+                    stack[flushIndex]->Flush();
+                    break;
+                case 1:
+                    stack[flushIndex]->Sync();
+                    break;
+                default:
+                    stack[flushIndex]->Sync();
+                    stack[flushIndex]->Trim(0);
+                    BOOST_CHECK_EQUAL(stack[flushIndex]->GetDirtyCount(), 0U);
+                    break;
+                }
             }
         }
         if (insecure_rand() % 100 == 0) {
@@ -415,4 +497,438 @@ BOOST_AUTO_TEST_CASE(ccoins_serialization)
     }
 }
 
+BOOST_AUTO_TEST_CASE(coins_cache_sync_trim)
+{
+    CCoinsViewTest base;
+    CCoinsViewCacheTest cache(&base);
+    std::vector<uint256> vTxid;
+    for (int i = 0; i < 200; i++) {
+        vTxid.push_back(GetRandHash());
+        CCoinsModifier modifier = cache.ModifyCoins(vTxid.back());
+        modifier->vout.resize(1);
+        modifier->vout[0].nValue = i + 1;
+    }
+    BOOST_CHECK_EQUAL(cache.GetDirtyCount(), 200U);
+
+    // Syncing writes everything but keeps it cached
+    BOOST_CHECK(cache.Sync());
+    BOOST_CHECK_EQUAL(cache.GetDirtyCount(), 0U);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 200U);
+    for (int i = 0; i < 200; i++)
+        BOOST_CHECK(base.HaveCoins(vTxid[i]));
+    cache.SelfTest();
+
+    // Spends are written and dropped from the cache
+    cache.ModifyCoins(vTxid[0])->Clear();
+    BOOST_CHECK(cache.Sync());
+    CCoins coins;
+    BOOST_CHECK(!base.GetCoins(vTxid[0], coins) || coins.IsPruned());
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 199U);
+
+    // A target within reach stops the sweep right away
+    size_t nUsage = cache.ActiveMemoryUsage();
+    BOOST_CHECK_EQUAL(cache.Trim(nUsage), 0U);
+
+    // Otherwise all clean entries go, used ones in the second round
+    cache.ModifyCoins(vTxid[1])->vout[0].nValue = 1000;
+    BOOST_CHECK_EQUAL(cache.Trim(0), 198U);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 1U);
+    BOOST_CHECK(cache.ActiveMemoryUsage() < nUsage);
+    BOOST_CHECK(cache.ActiveMemoryUsage() <= cache.DynamicMemoryUsage());
+    cache.SelfTest();
+
+    // Evicted entries are read back from the base
+    BOOST_CHECK_EQUAL(cache.AccessCoins(vTxid[2])->vout[0].nValue, 3);
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(base.GetCoins(vTxid[1], coins));
+    BOOST_CHECK_EQUAL(coins.vout[0].nValue, 1000);
+}
+
+BOOST_AUTO_TEST_CASE(coins_cache_sync_failure)
+{
+    CCoinsViewFailingTest base;
+    CCoinsViewCacheTest cache(&base);
+    uint256 txid = GetRandHash();
+    uint256 txidSpent = GetRandHash();
+    {
+        CCoinsModifier modifier = cache.ModifyCoins(txid);
+        modifier->vout.resize(1);
+        modifier->vout[0].nValue = 5;
+    }
+    {
+        CCoinsModifier modifier = cache.ModifyCoins(txidSpent);
+        modifier->vout.resize(1);
+        modifier->vout[0].nValue = 7;
+    }
+    BOOST_CHECK(cache.Sync());
+    cache.ModifyCoins(txid)->vout[0].nValue = 6;
+    cache.ModifyCoins(txidSpent)->Clear();
+    BOOST_CHECK_EQUAL(cache.GetDirtyCount(), 2U);
+    base.fFail = true;
+
+    // A failed write leaves everything in place, spends included
+    BOOST_CHECK(!cache.Sync());
+    BOOST_CHECK_EQUAL(cache.GetDirtyCount(), 2U);
+    BOOST_CHECK(cache.HaveCoinsInCache(txid));
+    BOOST_CHECK(cache.HaveCoinsInCache(txidSpent));
+    BOOST_CHECK_EQUAL(cache.Trim(0), 0U);
+    BOOST_CHECK_EQUAL(cache.AccessCoins(txid)->vout[0].nValue, 6);
+    cache.SelfTest();
+
+    // So the next write still has them
+    base.fFail = false;
+    BOOST_CHECK(cache.Sync());
+    CCoins coins;
+    BOOST_CHECK(base.GetCoins(txid, coins));
+    BOOST_CHECK_EQUAL(coins.vout[0].nValue, 6);
+    BOOST_CHECK(!base.GetCoins(txidSpent, coins) || coins.IsPruned());
+}
+
+BOOST_AUTO_TEST_CASE(coins_async_writer)
+{
+    CCoinsViewBlockingTest base;
+    CCoinsViewAsyncWriter writer(&base);
+    CCoinsViewCacheTest cache(&writer);
+    uint256 txid = GetRandHash();
+    uint256 hashBlock = GetRandHash();
+    {
+        CCoinsModifier modifier = cache.ModifyCoins(txid);
+        modifier->vout.resize(1);
+        modifier->vout[0].nValue = 5;
+    }
+    cache.SetBestBlock(hashBlock);
+
+    boost::thread thread(boost::bind(&CCoinsViewAsyncWriter::Run, &writer));
+    while (!writer.IsRunning())
+        MilliSleep(1);
+
+    // The write is handed off while the base is still busy
+    BOOST_CHECK(cache.Sync());
+    BOOST_CHECK_EQUAL(cache.GetDirtyCount(), 0U);
+    BOOST_CHECK_EQUAL(writer.GetPendingCount(), 1U);
+    CCoins coins;
+    BOOST_CHECK(!base.GetCoins(txid, coins));
+
+    // Reads are answered from the batch in flight
+    BOOST_CHECK(writer.GetCoins(txid, coins));
+    BOOST_CHECK_EQUAL(coins.vout[0].nValue, 5);
+    BOOST_CHECK(writer.HaveCoins(txid));
+    BOOST_CHECK(writer.GetBestBlock() == hashBlock);
+    cache.Uncache(txid);
+    BOOST_CHECK_EQUAL(cache.AccessCoins(txid)->vout[0].nValue, 5);
+
+    base.Release();
+    BOOST_CHECK(writer.Wait());
+    BOOST_CHECK_EQUAL(writer.GetPendingCount(), 0U);
+    BOOST_CHECK(base.GetCoins(txid, coins));
+    BOOST_CHECK_EQUAL(coins.vout[0].nValue, 5);
+    BOOST_CHECK(base.GetBestBlock() == hashBlock);
+
+    // Once the thread is gone, writes are synchronous
+    thread.interrupt();
+    thread.join();
+    BOOST_CHECK(!writer.IsRunning());
+    cache.ModifyCoins(txid)->Clear();
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK_EQUAL(writer.GetPendingCount(), 0U);
+    BOOST_CHECK(!base.GetCoins(txid, coins) || coins.IsPruned());
+}
+
+BOOST_AUTO_TEST_CASE(coins_async_writer_interrupted)
+{
+    CCoinsViewBlockingTest base;
+    CCoinsViewAsyncWriter writer(&base);
+    CCoinsViewCacheTest cache(&writer);
+    uint256 txid = GetRandHash();
+    uint256 hashBlock = GetRandHash();
+    {
+        CCoinsModifier modifier = cache.ModifyCoins(txid);
+        modifier->vout.resize(1);
+        modifier->vout[0].nValue = 5;
+    }
+    cache.SetBestBlock(hashBlock);
+
+    boost::thread thread(boost::bind(&CCoinsViewAsyncWriter::Run, &writer));
+    while (!writer.IsRunning())
+        MilliSleep(1);
+    BOOST_CHECK(cache.Flush());
+
+    // Interrupted with the batch handed over, the thread still commits it
+    thread.interrupt();
+    base.Release();
+    thread.join();
+    BOOST_CHECK(!writer.IsRunning());
+    BOOST_CHECK_EQUAL(writer.GetPendingCount(), 0U);
+    CCoins coins;
+    BOOST_CHECK(base.GetCoins(txid, coins));
+    BOOST_CHECK_EQUAL(coins.vout[0].nValue, 5);
+    BOOST_CHECK(base.GetBestBlock() == hashBlock);
+
+    // Later writes go to the base directly, on top of it
+    uint256 hashBlock2 = GetRandHash();
+    cache.ModifyCoins(txid)->vout[0].nValue = 6;
+    cache.SetBestBlock(hashBlock2);
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(writer.Wait());
+    BOOST_CHECK(base.GetCoins(txid, coins));
+    BOOST_CHECK_EQUAL(coins.vout[0].nValue, 6);
+    BOOST_CHECK(base.GetBestBlock() == hashBlock2);
+}
+
+BOOST_AUTO_TEST_CASE(coins_cache_prefetch)
+{
+    CCoinsViewTest base;
+    uint256 txidFound = GetRandHash();
+    uint256 txidMissing = GetRandHash();
+
+    CCoinsViewCacheTest writer(&base);
+    {
+        CCoinsModifier modifier = writer.ModifyCoins(txidFound);
+        modifier->vout.resize(1);
+        modifier->vout[0].nValue = 5;
+        modifier->nHeight = 1;
+    }
+    BOOST_CHECK(writer.Flush());
+
+    CCoinsViewCacheTest cache(&base);
+    CCoins coins;
+
+    // Reading from the base leaves the cache alone until the coins are added.
+    BOOST_CHECK(cache.GetCoinsFromBase(txidFound, coins));
+    BOOST_CHECK(!cache.HaveCoinsInCache(txidFound));
+    cache.CacheCoins(txidFound, coins);
+    BOOST_CHECK(cache.HaveCoinsInCache(txidFound));
+    BOOST_CHECK_EQUAL(cache.AccessCoins(txidFound)->vout[0].nValue, 5);
+    cache.SelfTest();
+
+    // An entry that is already cached is kept.
+    CCoins other;
+    other.vout.resize(1);
+    other.vout[0].nValue = 7;
+    cache.CacheCoins(txidFound, other);
+    BOOST_CHECK_EQUAL(cache.AccessCoins(txidFound)->vout[0].nValue, 5);
+
+    // A miss is cached as pruned and isn't written back.
+    CCoins missing;
+    BOOST_CHECK(!cache.GetCoinsFromBase(txidMissing, missing));
+    cache.CacheCoins(txidMissing, missing);
+    BOOST_CHECK(cache.HaveCoinsInCache(txidMissing));
+    BOOST_CHECK(!cache.HaveCoins(txidMissing));
+    cache.SelfTest();
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(!base.HaveCoins(txidMissing));
+    BOOST_CHECK(base.HaveCoins(txidFound));
+}
+
+namespace
+{
+class CCoinsViewDBTest : public CCoinsViewDB
+{
+public:
+    CCoinsViewDBTest(bool fKeepStats = true, bool fMemory = true, bool fWipe = true) : CCoinsViewDB(1 << 20, fMemory, fWipe, fKeepStats) {}
+
+    bool ScanStats(CCoinsDBStats& stats) const
+    {
+        return ComputeStats(stats, false);
+    }
+
+    void WriteLegacyCoins(const uint256& txid, const CCoins& coins)
+    {
+        db.Write(std::make_pair('c', txid), coins);
+    }
+};
+}
+
+BOOST_FIXTURE_TEST_CASE(coins_db_per_output, TestingSetup)
+{
+    CCoinsViewDBTest db;
+    uint256 txid = GetRandHash();
+    CCoins coins;
+    coins.nHeight = 7;
+    coins.nVersion = 2;
+    coins.vout.resize(3);
+    for (unsigned int i = 0; i < coins.vout.size(); i++) {
+        coins.vout[i].nValue = 1000 * (i + 1);
+        coins.vout[i].scriptPubKey = CScript() << OP_TRUE;
+    }
+
+    CCoins read;
+    {
+        CCoinsViewCache cache(&db);
+        {
+            CCoinsModifier modifier = cache.ModifyNewCoins(txid, false);
+            *modifier = coins;
+        }
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK(db.HaveCoins(txid));
+    BOOST_CHECK(db.GetCoins(txid, read) && read == coins);
+    CCoinsDBStats stats;
+    BOOST_CHECK(db.GetStats(stats));
+    BOOST_CHECK_EQUAL(stats.nTransactions, 1U);
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, 3U);
+    BOOST_CHECK_EQUAL(stats.nTotalAmount, 6000);
+
+    // Spending an output leaves the records of the others in place
+    uint256 hashBlock = GetRandHash();
+    {
+        CCoinsViewCache cache(&db);
+        BOOST_CHECK(cache.ModifyCoins(txid)->Spend(1));
+        cache.SetBestBlock(hashBlock);
+        BOOST_CHECK(cache.Flush());
+    }
+    coins.Spend(1);
+    BOOST_CHECK(db.GetCoins(txid, read) && read == coins);
+    BOOST_CHECK(read.IsAvailable(0) && !read.IsAvailable(1) && read.IsAvailable(2));
+    CCoinsDBStats statsSpent;
+    BOOST_CHECK(db.GetStats(statsSpent));
+    BOOST_CHECK(statsSpent.hashBlock == hashBlock);
+    BOOST_CHECK_EQUAL(statsSpent.nTransactions, 1U);
+    BOOST_CHECK_EQUAL(statsSpent.nTransactionOutputs, 2U);
+    BOOST_CHECK_EQUAL(statsSpent.nTotalAmount, 4000);
+    BOOST_CHECK(statsSpent.nSerializedSize < stats.nSerializedSize);
+
+    // Records of older versions are converted in place
+    uint256 txidLegacy = GetRandHash();
+    CCoins legacy = coins;
+    legacy.fCoinBase = true;
+    legacy.nHeight = 3;
+    db.WriteLegacyCoins(txidLegacy, legacy);
+    BOOST_CHECK(!db.HaveCoins(txidLegacy));
+    BOOST_CHECK(db.Upgrade());
+    BOOST_CHECK(db.HaveCoins(txidLegacy));
+    BOOST_CHECK(db.GetCoins(txidLegacy, read) && read == legacy);
+
+    // The totals are computed again from all records after the upgrade
+    BOOST_CHECK(db.GetStats(stats));
+    BOOST_CHECK(stats.hashBlock == hashBlock);
+    BOOST_CHECK_EQUAL(stats.nTransactions, 2U);
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, 4U);
+    BOOST_CHECK_EQUAL(stats.nTotalAmount, 8000);
+
+    // The cursor puts the outputs of each transaction back together
+    boost::scoped_ptr<CCoinsViewCursor> pcursor(db.Cursor());
+    unsigned int nTransactions = 0;
+    while (pcursor->Valid()) {
+        uint256 key;
+        BOOST_CHECK(pcursor->GetKey(key) && pcursor->GetValue(read));
+        BOOST_CHECK(read == (key == txid ? coins : legacy));
+        BOOST_CHECK(pcursor->GetValueSize() > 0);
+        nTransactions++;
+        pcursor->Next();
+    }
+    BOOST_CHECK_EQUAL(nTransactions, 2U);
+
+    // Updating the computed totals gives the same result as keeping them all along
+    {
+        CCoinsViewCache cache(&db);
+        {
+            CCoinsModifier modifier = cache.ModifyCoins(txidLegacy);
+            BOOST_CHECK(modifier->Spend(0) && modifier->Spend(2));
+        }
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK(db.GetStats(stats));
+    BOOST_CHECK_EQUAL(stats.nTransactions, statsSpent.nTransactions);
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, statsSpent.nTransactionOutputs);
+    BOOST_CHECK_EQUAL(stats.nSerializedSize, statsSpent.nSerializedSize);
+    BOOST_CHECK_EQUAL(stats.nTotalAmount, statsSpent.nTotalAmount);
+    BOOST_CHECK(stats.muhash.Finalize() == statsSpent.muhash.Finalize());
+
+    // Spending the rest removes the transaction
+    {
+        CCoinsViewCache cache(&db);
+        {
+            CCoinsModifier modifier = cache.ModifyCoins(txid);
+            BOOST_CHECK(modifier->Spend(0) && modifier->Spend(2));
+        }
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK(!db.HaveCoins(txid));
+    BOOST_CHECK(!db.GetCoins(txid, read));
+    BOOST_CHECK(db.GetStats(stats));
+    BOOST_CHECK_EQUAL(stats.nTransactions, 0U);
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, 0U);
+    BOOST_CHECK_EQUAL(stats.nSerializedSize, 0U);
+    BOOST_CHECK_EQUAL(stats.nTotalAmount, 0);
+    BOOST_CHECK(stats.muhash.Finalize() == MuHash3072().Finalize());
+}
+
+BOOST_FIXTURE_TEST_CASE(coins_db_stats_scan, TestingSetup)
+{
+    // The running totals match a scan of the records; without them GetStats() fails
+    CCoinsViewDBTest dbKept, dbNotKept(false);
+    uint256 hashBlock = GetRandHash();
+    for (int nRound = 0; nRound < 2; nRound++) {
+        CCoinsViewCache cacheKept(&dbKept), cacheNotKept(&dbNotKept);
+        for (int i = 0; i < 20; i++) {
+            uint256 txid;
+            *txid.begin() = i + 1;
+            CCoins coins;
+            // The second round spends half of the transactions and changes the rest
+            if (nRound == 0 || i >= 10) {
+                coins.nHeight = i;
+                coins.vout.resize(i % 3 + 1 + nRound);
+                for (unsigned int n = 0; n < coins.vout.size(); n++) {
+                    coins.vout[n].nValue = 100 * i + n + nRound;
+                    coins.vout[n].scriptPubKey = CScript() << OP_TRUE;
+                }
+            }
+            *cacheKept.ModifyCoins(txid) = coins;
+            *cacheNotKept.ModifyCoins(txid) = coins;
+        }
+        cacheKept.SetBestBlock(hashBlock);
+        cacheNotKept.SetBestBlock(hashBlock);
+        BOOST_CHECK(cacheKept.Flush() && cacheNotKept.Flush());
+
+        CCoinsDBStats statsKept, statsScanned;
+        BOOST_CHECK(dbKept.KeepsStats() && !dbNotKept.KeepsStats());
+        BOOST_CHECK(dbKept.GetStats(statsKept));
+        BOOST_CHECK(!dbNotKept.GetStats(statsScanned));
+        BOOST_CHECK(dbNotKept.ScanStats(statsScanned));
+        BOOST_CHECK(statsScanned.hashBlock == hashBlock);
+        BOOST_CHECK_EQUAL(statsScanned.nTransactions, statsKept.nTransactions);
+        BOOST_CHECK_EQUAL(statsScanned.nTransactionOutputs, statsKept.nTransactionOutputs);
+        BOOST_CHECK_EQUAL(statsScanned.nSerializedSize, statsKept.nSerializedSize);
+        BOOST_CHECK_EQUAL(statsScanned.nTotalAmount, statsKept.nTotalAmount);
+        BOOST_CHECK(statsScanned.muhash.Finalize() == statsKept.muhash.Finalize());
+        hashBlock = GetRandHash();
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(coins_db_tx_markers, TestingSetup)
+{
+    uint256 txid = GetRandHash();
+    CCoins coins;
+    coins.nHeight = 3;
+    coins.vout.resize(2);
+    for (unsigned int i = 0; i < coins.vout.size(); i++) {
+        coins.vout[i].nValue = 10 * (i + 1);
+        coins.vout[i].scriptPubKey = CScript() << OP_TRUE;
+    }
+    CCoins read;
+    {
+        CCoinsViewDBTest db(true, false, true);
+        CCoinsViewCache cache(&db);
+        *cache.ModifyCoins(txid) = coins;
+        BOOST_CHECK(cache.Flush());
+        BOOST_CHECK(db.HaveCoins(txid));
+        BOOST_CHECK(db.GetCoins(txid, read) && read == coins);
+        BOOST_CHECK(!db.HaveCoins(GetRandHash()));
+
+        // Spending one output keeps the marker, spending both removes it
+        BOOST_CHECK(cache.ModifyCoins(txid)->Spend(0));
+        BOOST_CHECK(cache.Flush());
+        BOOST_CHECK(db.HaveCoins(txid));
+        BOOST_CHECK(cache.ModifyCoins(txid)->Spend(1));
+        BOOST_CHECK(cache.Flush());
+        BOOST_CHECK(!db.HaveCoins(txid));
+    }
+    {
+        CCoinsViewDBTest db(true, false, false);
+        BOOST_CHECK(!db.HaveCoins(txid));
+        BOOST_CHECK(!db.GetCoins(txid, read));
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
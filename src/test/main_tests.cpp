@@ -4,6 +4,7 @@
 
 #include "chainparams.h"
 #include "main.h"
+#include "streams.h"
 
 #include "test/test_bitcoin.h"
 
@@ -72,4 +73,24 @@ BOOST_AUTO_TEST_CASE(test_combiner_all)
     Test.disconnect(&ReturnTrue);
     BOOST_CHECK(Test());
 }
+
+BOOST_AUTO_TEST_CASE(read_raw_block)
+{
+    const CChainParams& chainparams = Params();
+    CBlockIndex* pindex = chainActive.Genesis();
+    CDataStream ssBlock(SER_DISK, CLIENT_VERSION);
+    ssBlock << chainparams.GenesisBlock();
+
+    unsigned int nSize = 0;
+    BOOST_CHECK(ReadBlockSizeFromDisk(nSize, pindex->GetBlockPos(), chainparams.MessageStart()));
+    BOOST_CHECK_EQUAL(nSize, ssBlock.size());
+    std::vector<unsigned char> vchBlock;
+    BOOST_CHECK(ReadRawBlockFromDisk(vchBlock, pindex->GetBlockPos(), chainparams.MessageStart()));
+    BOOST_CHECK(vchBlock == std::vector<unsigned char>(ssBlock.begin(), ssBlock.end()));
+
+    // A position that is not the start of a block has no valid index header in front of it
+    CDiskBlockPos pos = pindex->GetBlockPos();
+    pos.nPos += 4;
+    BOOST_CHECK(!ReadRawBlockFromDisk(vchBlock, pos, chainparams.MessageStart()));
+}
 BOOST_AUTO_TEST_SUITE_END()
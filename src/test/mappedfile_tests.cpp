@@ -0,0 +1,72 @@
+// Copyright (c) 2014-2019 The Flashcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "mappedfile.h"
+#include "test/test_bitcoin.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(mappedfile_tests, BasicTestingSetup)
+
+static void AppendToFile(const boost::filesystem::path& path, const std::string& str)
+{
+    FILE* file = fopen(path.string().c_str(), "ab");
+    BOOST_REQUIRE(file);
+    fwrite(str.data(), 1, str.size(), file);
+    fclose(file);
+}
+
+BOOST_AUTO_TEST_CASE(mappedfile_cache)
+{
+    boost::filesystem::path dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    boost::filesystem::create_directories(dir);
+    boost::filesystem::path pathA = dir / "a.dat";
+    boost::filesystem::path pathB = dir / "b.dat";
+    boost::filesystem::path pathC = dir / "c.dat";
+    AppendToFile(pathA, "aaaa");
+    AppendToFile(pathB, "bbbb");
+    AppendToFile(pathC, "cccc");
+
+    CMappedFileCache cache(2);
+    std::shared_ptr<const CMappedFile> fileA = cache.Get(pathA, 4);
+#ifndef WIN32
+    BOOST_REQUIRE(fileA);
+    BOOST_CHECK_EQUAL(fileA->size(), 4U);
+    BOOST_CHECK(memcmp(fileA->data(), "aaaa", 4) == 0);
+    BOOST_CHECK(cache.Get(pathA, 4) == fileA);
+
+    // Reading past the mapped size maps the file again once it has grown
+    BOOST_CHECK(!cache.Get(pathA, 8));
+    AppendToFile(pathA, "AAAA");
+    std::shared_ptr<const CMappedFile> fileA2 = cache.Get(pathA, 8);
+    BOOST_REQUIRE(fileA2);
+    BOOST_CHECK(fileA2 != fileA);
+    BOOST_CHECK(memcmp(fileA2->data(), "aaaaAAAA", 8) == 0);
+    // The old mapping stays valid while held
+    BOOST_CHECK(memcmp(fileA->data(), "aaaa", 4) == 0);
+
+    // Mapping a third file drops the least recently used one
+    BOOST_CHECK(cache.Get(pathB, 4));
+    BOOST_CHECK(cache.Get(pathA, 4) == fileA2);
+    BOOST_CHECK(cache.Get(pathC, 4));
+    BOOST_CHECK(cache.Get(pathA, 4) == fileA2);
+    BOOST_CHECK(cache.Get(pathB, 4));
+    BOOST_CHECK(cache.Get(pathA, 4) == fileA2);
+
+    cache.Erase(pathA);
+    BOOST_CHECK(cache.Get(pathA, 4) != fileA2);
+#else
+    BOOST_CHECK(!fileA);
+#endif
+    BOOST_CHECK(!cache.Get(dir / "missing.dat", 0));
+    BOOST_CHECK(!CMappedFileCache(0).Get(pathA, 0));
+
+    boost::filesystem::remove_all(dir);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
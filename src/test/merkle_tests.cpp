@@ -2,7 +2,10 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "chainparams.h"
 #include "consensus/merkle.h"
+#include "consensus/validation.h"
+#include "main.h"
 #include "test/test_bitcoin.h"
 #include "random.h"
 
@@ -133,4 +136,136 @@ BOOST_AUTO_TEST_CASE(merkle_test)
     }
 }
 
+/**
+ * The root as ParallelBlockMerkleRoot computes it: levels of at least nMinLevelNodes
+ * are hashed with ComputeMerkleLevel in chunks of nChunk nodes, the rest as usual.
+ */
+static uint256 LevelMerkleRoot(std::vector<uint256> level, size_t nMinLevelNodes, size_t nChunk, bool* fMutated)
+{
+    *fMutated = false;
+    while (level.size() >= nMinLevelNodes) {
+        std::vector<uint256> parents((level.size() + 1) / 2);
+        for (size_t n = 0; n < level.size(); n += nChunk) {
+            bool fChunkMutated = false;
+            ComputeMerkleLevel(&level[n], std::min(nChunk, level.size() - n), &parents[n / 2], &fChunkMutated);
+            *fMutated |= fChunkMutated;
+        }
+        level.swap(parents);
+    }
+    bool fTopMutated = false;
+    uint256 root = ComputeMerkleRoot(level, &fTopMutated);
+    *fMutated |= fTopMutated;
+    return root;
+}
+
+/** A block of ntx distinct transactions that passes CheckBlock, followed by copies of its last ones */
+static CBlock BuildBlock(int ntx, int nDuplicates)
+{
+    CBlock block;
+    block.vtx.resize(ntx + nDuplicates);
+    for (int j = 0; j < ntx; j++) {
+        CMutableTransaction mtx;
+        mtx.vin.resize(1);
+        mtx.vout.resize(1);
+        mtx.vout[0].nValue = 1;
+        if (j == 0) {
+            mtx.vin[0].scriptSig = CScript() << OP_0 << OP_0;
+        } else {
+            mtx.vin[0].prevout.hash = GetRandHash();
+            mtx.vin[0].prevout.n = 0;
+        }
+        block.vtx[j] = mtx;
+    }
+    for (int j = 0; j < nDuplicates; j++)
+        block.vtx[ntx + j] = block.vtx[ntx + j - nDuplicates];
+    return block;
+}
+
+BOOST_AUTO_TEST_CASE(merkle_level_test)
+{
+    std::vector<int> vCount;
+    for (int ntx = 0; ntx <= 17; ntx++)
+        vCount.push_back(ntx);
+    // Around the smallest level ParallelBlockMerkleRoot spreads over the threads
+    for (int ntx = 255; ntx <= 257; ntx++)
+        vCount.push_back(ntx);
+    for (int ntx = 511; ntx <= 513; ntx++)
+        vCount.push_back(ntx);
+    for (int i = 0; i < 8; i++)
+        vCount.push_back(17 + insecure_rand() % 4000);
+
+    BOOST_FOREACH(int ntx, vCount) {
+        // Duplicate the last 2^k transactions for a mutation that keeps the root (CVE-2012-2459)
+        for (int mutate = 0; mutate <= 1; mutate++) {
+            int nDuplicates = mutate ? 1 << ctz(ntx) : 0;
+            if (ntx == 0 || nDuplicates >= ntx)
+                continue;
+            CBlock block = BuildBlock(ntx, nDuplicates);
+            std::vector<uint256> leaves(block.vtx.size());
+            for (size_t j = 0; j < block.vtx.size(); j++)
+                leaves[j] = block.vtx[j].GetHash();
+            bool fMutated = false;
+            uint256 root = BlockMerkleRoot(block, &fMutated);
+            BOOST_CHECK(root == ComputeMerkleRoot(leaves));
+            BOOST_CHECK_EQUAL(fMutated, !!mutate);
+
+            // Any split between the levels, and chunks of even and odd leftover sizes
+            const size_t vMinLevelNodes[] = {2, 3, 16, 256};
+            const size_t vChunk[] = {2, 6, 64, 1 << 20};
+            BOOST_FOREACH(size_t nMinLevelNodes, vMinLevelNodes) {
+                BOOST_FOREACH(size_t nChunk, vChunk) {
+                    bool fLevelMutated = !fMutated;
+                    BOOST_CHECK(LevelMerkleRoot(leaves, nMinLevelNodes, nChunk, &fLevelMutated) == root);
+                    BOOST_CHECK_EQUAL(fLevelMutated, fMutated);
+                }
+            }
+        }
+    }
+
+    // A single level: an odd last node is paired with itself, and equal pairs are reported
+    uint256 a = GetRandHash(), b = GetRandHash();
+    uint256 nodes[] = {a, b, a, a, b};
+    uint256 parents[3];
+    bool fMutated = false;
+    ComputeMerkleLevel(nodes, 5, parents, &fMutated);
+    BOOST_CHECK(fMutated);
+    BOOST_CHECK(parents[0] == Hash(a.begin(), a.end(), b.begin(), b.end()));
+    BOOST_CHECK(parents[1] == Hash(a.begin(), a.end(), a.begin(), a.end()));
+    BOOST_CHECK(parents[2] == Hash(b.begin(), b.end(), b.begin(), b.end()));
+    ComputeMerkleLevel(nodes, 2, parents, &fMutated);
+    BOOST_CHECK(!fMutated);
+    ComputeMerkleLevel(nodes + 4, 1, parents, &fMutated);
+    BOOST_CHECK(!fMutated);
+}
+
+BOOST_AUTO_TEST_CASE(merkle_checkblock_parallel_test)
+{
+    // TestingSetup sets nScriptCheckThreads, so blocks this large take ParallelBlockMerkleRoot.
+    // Their trees are odd at the leaves, at the first level (above 256 nodes, so hashed on the
+    // threads) and at the third level (below, so hashed by ComputeMerkleRoot).
+    BOOST_REQUIRE(nScriptCheckThreads > 0);
+    const int vCount[] = {PARALLEL_CHECK_BLOCK_MIN_TXS - 1, PARALLEL_CHECK_BLOCK_MIN_TXS, PARALLEL_CHECK_BLOCK_MIN_TXS + 1, PARALLEL_CHECK_BLOCK_MIN_TXS + 2};
+    BOOST_FOREACH(int ntx, vCount) {
+        CBlock block = BuildBlock(ntx, 0);
+        block.hashMerkleRoot = BlockMerkleRoot(block);
+        CValidationState state;
+        BOOST_CHECK(CheckBlock(block, state, Params().GetConsensus(), false, true, false));
+
+        CBlock blockBad(block);
+        blockBad.hashMerkleRoot = GetRandHash();
+        BOOST_CHECK(!CheckBlock(blockBad, state, Params().GetConsensus(), false, true, false));
+        BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-txnmrklroot");
+
+        // Duplicating the last 2^k transactions keeps the root (CVE-2012-2459)
+        CBlock blockMutated(block);
+        int nDuplicates = 1 << ctz(ntx);
+        for (int j = 0; j < nDuplicates; j++)
+            blockMutated.vtx.push_back(block.vtx[ntx - nDuplicates + j]);
+        BOOST_CHECK(BlockMerkleRoot(blockMutated) == block.hashMerkleRoot);
+        CValidationState stateMutated;
+        BOOST_CHECK(!CheckBlock(blockMutated, stateMutated, Params().GetConsensus(), false, true, false));
+        BOOST_CHECK_EQUAL(stateMutated.GetRejectReason(), "bad-txns-duplicate");
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
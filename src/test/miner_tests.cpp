@@ -10,6 +10,7 @@
 #include "main.h"
 #include "miner.h"
 #include "pubkey.h"
+#include "random.h"
 #include "script/standard.h"
 #include "txmempool.h"
 #include "uint256.h"
@@ -84,4 +85,102 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
 {
 }
 
+// A tracking BlockAssembler only selects the transactions that entered the
+// mempool since its last template, so they end up after the old ones even
+// when a full build would put them first.
+BOOST_AUTO_TEST_CASE(CreateNewBlock_extend)
+{
+    const CChainParams& chainparams = Params();
+    CScript scriptPubKey = CScript() << OP_TRUE;
+    TestMemPoolEntryHelper entry;
+    entry.nFee = 10000;
+    entry.nHeight = chainActive.Height() + 1;
+
+    // Confirmed outputs for the mempool transactions to spend
+    CMutableTransaction txFunding;
+    txFunding.vin.resize(1);
+    txFunding.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    txFunding.vout.resize(4, CTxOut(10 * COIN, scriptPubKey));
+    {
+        LOCK(cs_main);
+        CCoinsModifier coins = pcoinsTip->ModifyNewCoins(txFunding.GetHash(), false);
+        coins->FromTx(txFunding, 0);
+    }
+
+    std::vector<CMutableTransaction> txs(4);
+    for (unsigned int i = 0; i < txs.size(); i++) {
+        txs[i].vin.resize(1);
+        txs[i].vin[0].prevout = COutPoint(txFunding.GetHash(), i);
+        txs[i].vout.resize(1, CTxOut(10 * COIN - entry.nFee, scriptPubKey));
+    }
+    // The last one pays the best feerate
+    txs[3].vout[0].nValue = 10 * COIN - 5 * entry.nFee;
+
+    BlockAssembler assembler(chainparams, true);
+    mempool.addUnchecked(txs[0].GetHash(), entry.Priority(AllowFreeThreshold() * 2).FromTx(txs[0]));
+    std::unique_ptr<CBlockTemplate> pblocktemplate = assembler.CreateNewBlock(scriptPubKey);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 2);
+
+    mempool.addUnchecked(txs[1].GetHash(), entry.Priority(AllowFreeThreshold() * 3).FromTx(txs[1]));
+    pblocktemplate = assembler.CreateNewBlock(scriptPubKey);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 3);
+    BOOST_CHECK(pblocktemplate->block.vtx[1].GetHash() == txs[0].GetHash());
+    BOOST_CHECK(pblocktemplate->block.vtx[2].GetHash() == txs[1].GetHash());
+
+    // A full build orders them by priority
+    pblocktemplate = BlockAssembler(chainparams).CreateNewBlock(scriptPubKey);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 3);
+    BOOST_CHECK(pblocktemplate->block.vtx[1].GetHash() == txs[1].GetHash());
+    BOOST_CHECK(pblocktemplate->block.vtx[2].GetHash() == txs[0].GetHash());
+
+    // So does the tracking one once the template is too old to extend
+    SetMockTime(GetTime() + MAX_TEMPLATE_EXTEND_AGE + 1);
+    pblocktemplate = assembler.CreateNewBlock(scriptPubKey);
+    SetMockTime(0);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 3);
+    BOOST_CHECK(pblocktemplate->block.vtx[1].GetHash() == txs[1].GetHash());
+    BOOST_CHECK(pblocktemplate->block.vtx[2].GetHash() == txs[0].GetHash());
+
+    // Removing a transaction of the template forces a full build
+    std::list<CTransaction> removed;
+    mempool.removeRecursive(txs[0], removed);
+    mempool.addUnchecked(txs[2].GetHash(), entry.Priority(AllowFreeThreshold() * 4).FromTx(txs[2]));
+    pblocktemplate = assembler.CreateNewBlock(scriptPubKey);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 3);
+    BOOST_CHECK(pblocktemplate->block.vtx[1].GetHash() == txs[2].GetHash());
+    BOOST_CHECK(pblocktemplate->block.vtx[2].GetHash() == txs[1].GetHash());
+
+    // Without priority space the new transactions are selected by feerate
+    mapArgs["-blockprioritysize"] = "0";
+    mempool.addUnchecked(txs[3].GetHash(), entry.Fee(5 * entry.nFee).Priority(0).FromTx(txs[3]));
+    pblocktemplate = assembler.CreateNewBlock(scriptPubKey);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 4);
+    BOOST_CHECK(pblocktemplate->block.vtx[3].GetHash() == txs[3].GetHash());
+    pblocktemplate = BlockAssembler(chainparams).CreateNewBlock(scriptPubKey);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 4);
+    BOOST_CHECK(pblocktemplate->block.vtx[1].GetHash() == txs[3].GetHash());
+
+    // In a full block, a new package that pays more than one of the template
+    // displaces it, one that pays the same is left out
+    mempool.clear();
+    unsigned int nTxSize = ::GetSerializeSize(txs[0], SER_NETWORK, PROTOCOL_VERSION);
+    mapArgs["-blockmaxweight"] = strprintf("%u", 4000 + WITNESS_SCALE_FACTOR * nTxSize + 1);
+    BlockAssembler smallAssembler(chainparams, true);
+    mempool.addUnchecked(txs[0].GetHash(), entry.Fee(10000).FromTx(txs[0]));
+    pblocktemplate = smallAssembler.CreateNewBlock(scriptPubKey);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 2);
+    mempool.addUnchecked(txs[1].GetHash(), entry.Fee(10000).FromTx(txs[1]));
+    pblocktemplate = smallAssembler.CreateNewBlock(scriptPubKey);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 2);
+    BOOST_CHECK(pblocktemplate->block.vtx[1].GetHash() == txs[0].GetHash());
+    mempool.addUnchecked(txs[3].GetHash(), entry.Fee(50000).FromTx(txs[3]));
+    pblocktemplate = smallAssembler.CreateNewBlock(scriptPubKey);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 2);
+    BOOST_CHECK(pblocktemplate->block.vtx[1].GetHash() == txs[3].GetHash());
+    mapArgs.erase("-blockmaxweight");
+    mapArgs.erase("-blockprioritysize");
+
+    mempool.clear();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
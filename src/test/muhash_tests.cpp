@@ -0,0 +1,97 @@
+// Copyright (c) 2014-2019 The Flashcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "clientversion.h"
+#include "muhash.h"
+#include "streams.h"
+#include "test/test_bitcoin.h"
+
+#include <algorithm>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(muhash_tests, BasicTestingSetup)
+
+static std::vector<unsigned char> Element(unsigned char n)
+{
+    return std::vector<unsigned char>(n % 7 + 1, n);
+}
+
+BOOST_AUTO_TEST_CASE(muhash_set_semantics)
+{
+    const uint256 hashEmpty = MuHash3072().Finalize();
+
+    // The order of insertion does not matter
+    MuHash3072 a, b;
+    a.Insert(Element(1)).Insert(Element(2)).Insert(Element(3));
+    b.Insert(Element(3)).Insert(Element(1)).Insert(Element(2));
+    BOOST_CHECK(a.Finalize() == b.Finalize());
+    BOOST_CHECK(a.Finalize() != hashEmpty);
+
+    // Different sets hash differently
+    MuHash3072 c;
+    c.Insert(Element(1)).Insert(Element(2)).Insert(Element(4));
+    BOOST_CHECK(a.Finalize() != c.Finalize());
+
+    // Removing an element undoes its insertion, even before it happens
+    MuHash3072 d;
+    d.Remove(Element(4)).Insert(Element(1)).Insert(Element(4)).Insert(Element(2));
+    c.Remove(Element(4));
+    BOOST_CHECK(c.Finalize() == d.Finalize());
+    c.Remove(Element(1)).Remove(Element(2));
+    BOOST_CHECK(c.Finalize() == hashEmpty);
+
+    // Combining disjoint sets gives their union
+    MuHash3072 e, f;
+    e.Insert(Element(1)).Insert(Element(2));
+    f.Insert(Element(3));
+    e.Combine(f);
+    BOOST_CHECK(e.Finalize() == a.Finalize());
+
+    // Copies are independent
+    MuHash3072 g(a);
+    g.Remove(Element(3));
+    BOOST_CHECK(a.Finalize() == b.Finalize());
+    BOOST_CHECK(g.Finalize() != a.Finalize());
+}
+
+BOOST_AUTO_TEST_CASE(muhash_serialization)
+{
+    MuHash3072 a;
+    a.Insert(Element(1)).Insert(Element(2)).Remove(Element(5));
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << a;
+    BOOST_CHECK_EQUAL(ss.size(), 2 * MuHash3072::BYTE_SIZE);
+    MuHash3072 b;
+    ss >> b;
+    BOOST_CHECK(a.Finalize() == b.Finalize());
+
+    // The state keeps working after the round trip
+    a.Insert(Element(5));
+    b.Insert(Element(5));
+    BOOST_CHECK(a.Finalize() == b.Finalize());
+    BOOST_CHECK(a.Finalize() == MuHash3072().Insert(Element(1)).Insert(Element(2)).Finalize());
+}
+
+BOOST_AUTO_TEST_CASE(muhash_known_answer)
+{
+    // Pins the digests and the serialized form stored in the chainstate
+    const unsigned char a = 0, b = 1, c = 2;
+    MuHash3072 hash;
+    hash.Insert(&a, 1).Insert(&b, 1).Remove(&c, 1);
+    BOOST_CHECK_EQUAL(hash.Finalize().GetHex(), "c31e6deea27581b411a7e5919144c9161f1a8d082ddf8af470e710e7c758d605");
+    BOOST_CHECK_EQUAL(MuHash3072().Finalize().GetHex(), "a5565d0f791a956bce308affcc938701a132cbff1a5266d12e14ecfba54216ab");
+
+    // The empty set is stored as 1 / 1, whatever the in-memory representation
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << MuHash3072();
+    std::vector<unsigned char> one(MuHash3072::BYTE_SIZE, 0);
+    one.back() = 1;
+    BOOST_CHECK(std::equal(one.begin(), one.end(), ss.begin()));
+    BOOST_CHECK(std::equal(one.begin(), one.end(), ss.begin() + MuHash3072::BYTE_SIZE));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -164,4 +164,65 @@ BOOST_AUTO_TEST_CASE(cnode_simple_test)
     BOOST_CHECK(pnode2->fFeeler == false);
 }
 
+BOOST_AUTO_TEST_CASE(recv_buffer_pool)
+{
+    CRecvBufferPool pool(2, 10000);
+    CSerializeData vch;
+    pool.Get(vch, 1000);
+    BOOST_CHECK(vch.empty());
+    BOOST_CHECK(vch.capacity() >= 1000);
+    vch.resize(1000, 'x');
+    pool.Put(vch);
+    BOOST_CHECK_EQUAL(vch.capacity(), 0U);
+    CRecvBufferPool::Stats stats = pool.GetStats();
+    BOOST_CHECK_EQUAL(stats.nAllocations, 1U);
+    BOOST_CHECK_EQUAL(stats.nReuses, 0U);
+    BOOST_CHECK_EQUAL(stats.nPooled, 1U);
+
+    // A pooled buffer that is large enough is handed out again, emptied
+    pool.Get(vch, 500);
+    BOOST_CHECK(vch.empty());
+    BOOST_CHECK(vch.capacity() >= 1000);
+    stats = pool.GetStats();
+    BOOST_CHECK_EQUAL(stats.nAllocations, 1U);
+    BOOST_CHECK_EQUAL(stats.nReuses, 1U);
+    BOOST_CHECK_EQUAL(stats.nPooled, 0U);
+    BOOST_CHECK_EQUAL(stats.nPooledBytes, 0U);
+
+    // One too large for the pool is allocated, and freed when returned
+    CSerializeData vchLarge;
+    pool.Get(vchLarge, 20000);
+    pool.Put(vchLarge);
+    pool.Put(vch);
+    stats = pool.GetStats();
+    BOOST_CHECK_EQUAL(stats.nAllocations, 2U);
+    BOOST_CHECK_EQUAL(stats.nPooled, 1U);
+    BOOST_CHECK(stats.nPooledBytes >= 1000 && stats.nPooledBytes < 20000);
+}
+
+BOOST_AUTO_TEST_CASE(cnetmessage_pooled_buffer)
+{
+    // Message data goes into the message's stream as it comes in, and is read from there
+    std::string strPayload("payload");
+    unsigned int nPayloadSize = GetSerializeSize(strPayload, SER_NETWORK, PROTOCOL_VERSION);
+    CMessageHeader hdr(Params().MessageStart(), "dummy", nPayloadSize);
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << hdr << strPayload;
+
+    CNetMessage msg(Params().MessageStart(), SER_NETWORK, PROTOCOL_VERSION);
+    int nHeader = msg.readHeader(&ss[0], 10);
+    BOOST_CHECK_EQUAL(nHeader, 10);
+    BOOST_CHECK(!msg.in_data);
+    nHeader = msg.readHeader(&ss[10], ss.size() - 10);
+    BOOST_CHECK_EQUAL(nHeader, (int)CMessageHeader::HEADER_SIZE - 10);
+    BOOST_CHECK(msg.in_data);
+    BOOST_CHECK(!msg.complete());
+    int nData = msg.readData(&ss[CMessageHeader::HEADER_SIZE], ss.size() - CMessageHeader::HEADER_SIZE);
+    BOOST_CHECK_EQUAL(nData, (int)nPayloadSize);
+    BOOST_CHECK(msg.complete());
+    std::string str;
+    msg.vRecv >> str;
+    BOOST_CHECK_EQUAL(str, "payload");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,104 @@
+// Copyright (c) 2014-2019 The Flashcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "netpoll.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+#ifndef WIN32
+#include <unistd.h>
+#endif
+
+BOOST_FIXTURE_TEST_SUITE(netpoll_tests, BasicTestingSetup)
+
+#ifndef WIN32
+static bool FindEvent(const std::vector<CSocketPoller::Event>& vEvents, void* ctx, bool& fRecv, bool& fSend)
+{
+    for (size_t i = 0; i < vEvents.size(); i++) {
+        if (vEvents[i].ctx == ctx) {
+            fRecv = vEvents[i].fRecv;
+            fSend = vEvents[i].fSend;
+            return true;
+        }
+    }
+    return false;
+}
+
+BOOST_AUTO_TEST_CASE(socket_poller_edges)
+{
+    CSocketPoller poller;
+    if (!CSocketPoller::IsSupported()) {
+        BOOST_CHECK(!poller.IsValid());
+        return;
+    }
+    BOOST_REQUIRE(poller.IsValid());
+
+    int fds[2];
+    BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    int ctx = 0;
+    BOOST_REQUIRE(poller.AddEdge(fds[0], &ctx));
+
+    // Registration reports the current state: writable, nothing to read
+    std::vector<CSocketPoller::Event> vEvents;
+    bool fRecv = false, fSend = false;
+    BOOST_CHECK(poller.Wait(1000, vEvents));
+    BOOST_REQUIRE(FindEvent(vEvents, &ctx, fRecv, fSend));
+    BOOST_CHECK(!fRecv);
+    BOOST_CHECK(fSend);
+
+    // Edge-triggered: no change, no event
+    BOOST_CHECK(poller.Wait(0, vEvents));
+    BOOST_CHECK(!FindEvent(vEvents, &ctx, fRecv, fSend));
+
+    // Incoming data is reported once, even though it is not read
+    BOOST_REQUIRE(write(fds[1], "x", 1) == 1);
+    BOOST_CHECK(poller.Wait(1000, vEvents));
+    BOOST_REQUIRE(FindEvent(vEvents, &ctx, fRecv, fSend));
+    BOOST_CHECK(fRecv);
+    BOOST_CHECK(poller.Wait(0, vEvents));
+    BOOST_CHECK(!FindEvent(vEvents, &ctx, fRecv, fSend));
+
+    // The other side closing is reported as readable
+    close(fds[1]);
+    BOOST_CHECK(poller.Wait(1000, vEvents));
+    BOOST_REQUIRE(FindEvent(vEvents, &ctx, fRecv, fSend));
+    BOOST_CHECK(fRecv);
+
+    // A closed socket drops out
+    close(fds[0]);
+    BOOST_CHECK(poller.Wait(0, vEvents));
+    BOOST_CHECK(!FindEvent(vEvents, &ctx, fRecv, fSend));
+}
+
+BOOST_AUTO_TEST_CASE(socket_wakeup)
+{
+    CSocketWakeup wakeup;
+    BOOST_REQUIRE(wakeup.IsValid());
+
+    CSocketPoller poller;
+    if (!poller.IsValid())
+        return;
+    BOOST_REQUIRE(poller.AddLevel(wakeup.GetSocket(), &wakeup));
+
+    std::vector<CSocketPoller::Event> vEvents;
+    bool fRecv = false, fSend = false;
+    BOOST_CHECK(poller.Wait(0, vEvents));
+    BOOST_CHECK(!FindEvent(vEvents, &wakeup, fRecv, fSend));
+
+    // Level-triggered: reported until drained, however often it was woken
+    wakeup.Wake();
+    wakeup.Wake();
+    BOOST_CHECK(poller.Wait(1000, vEvents));
+    BOOST_CHECK(FindEvent(vEvents, &wakeup, fRecv, fSend) && fRecv);
+    BOOST_CHECK(poller.Wait(0, vEvents));
+    BOOST_CHECK(FindEvent(vEvents, &wakeup, fRecv, fSend) && fRecv);
+
+    wakeup.Drain();
+    BOOST_CHECK(poller.Wait(0, vEvents));
+    BOOST_CHECK(!FindEvent(vEvents, &wakeup, fRecv, fSend));
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
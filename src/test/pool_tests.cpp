@@ -0,0 +1,74 @@
+// Copyright (c) 2014-2019 The Flashcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "memusage.h"
+#include "support/allocators/pool.h"
+#include "test/test_bitcoin.h"
+
+#include <functional>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/unordered_map.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(pool_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(pool_resource_blocks)
+{
+    PoolResource<128, 8> resource(1024);
+    BOOST_CHECK_EQUAL(resource.ChunkSizeBytes(), 1024U);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 0U);
+
+    // Blocks are carved out back to back, without headers in between
+    char* a = static_cast<char*>(resource.Allocate(24, 8));
+    char* b = static_cast<char*>(resource.Allocate(24, 8));
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+    BOOST_CHECK_EQUAL(b - a, 24);
+
+    // A freed block is reused for requests that round to the same size only
+    resource.Deallocate(a, 24, 8);
+    char* c = static_cast<char*>(resource.Allocate(32, 8));
+    BOOST_CHECK(c != a);
+    BOOST_CHECK(resource.Allocate(20, 8) == a);
+
+    // Requests the pool does not serve don't touch its chunks
+    void* pLarge = resource.Allocate(256, 8);
+    void* pAligned = resource.Allocate(8, 16);
+    resource.Deallocate(pLarge, 256, 8);
+    resource.Deallocate(pAligned, 8, 16);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+
+    // 80 bytes are in use; seven more blocks of 128 leave 48 bytes, so the
+    // eighth starts a new chunk and the 48 bytes become a free block
+    for (int i = 0; i < 8; i++)
+        resource.Allocate(128, 8);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 2U);
+    BOOST_CHECK(resource.Allocate(48, 8) == a + 80 + 7 * 128);
+}
+
+BOOST_AUTO_TEST_CASE(pool_allocator_map)
+{
+    typedef boost::unordered_map<int, int, boost::hash<int>, std::equal_to<int>,
+        PoolAllocator<std::pair<const int, int>, 64> > Map;
+    Map::allocator_type::ResourceType resource;
+    Map m(0, boost::hash<int>(), std::equal_to<int>(), &resource);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 0U);
+    BOOST_CHECK(memusage::DynamicUsage(m) < resource.ChunkSizeBytes());
+
+    for (int i = 0; i < 1000; i++)
+        m[i] = i * 2;
+    for (int i = 0; i < 1000; i++)
+        BOOST_CHECK_EQUAL(m[i], i * 2);
+    size_t nChunks = resource.NumAllocatedChunks();
+    BOOST_CHECK(nChunks > 0);
+    BOOST_CHECK(memusage::DynamicUsage(m) >= nChunks * resource.ChunkSizeBytes() + m.bucket_count() * sizeof(void*));
+
+    // Erased nodes are reused instead of growing the pool
+    m.clear();
+    for (int i = 0; i < 1000; i++)
+        m[-i] = i;
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), nChunks);
+    BOOST_CHECK_EQUAL(m.size(), 1000U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
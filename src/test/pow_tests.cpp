@@ -4,8 +4,11 @@
 
 #include "chain.h"
 #include "chainparams.h"
+#include "clientversion.h"
+#include "main.h"
 #include "pow.h"
 #include "random.h"
+#include "streams.h"
 #include "util.h"
 #include "test/test_bitcoin.h"
 
@@ -95,4 +98,73 @@ BOOST_AUTO_TEST_CASE(GetBlockProofEquivalentTime_test)
     }
 }
 
+/* Test that the PoW hash round-trips through the block index and that old entries still load */
+BOOST_AUTO_TEST_CASE(diskblockindex_powhash)
+{
+    CBlockHeader header;
+    header.nVersion = 2;
+    header.hashMerkleRoot = GetRandHash();
+    header.nTime = 1358378777;
+    header.nBits = 0x1c0ac141;
+    header.nNonce = 42;
+
+    CBlockIndex index(header);
+    uint256 hash = header.GetHash();
+    index.phashBlock = &hash;
+    index.nStatus = BLOCK_VALID_TREE;
+
+    // Entry without a stored PoW hash, as written before it was persisted
+    CDataStream ssOld(SER_DISK, CLIENT_VERSION);
+    ssOld << CDiskBlockIndex(&index);
+    CDiskBlockIndex diskOld;
+    ssOld >> diskOld;
+    BOOST_CHECK(ssOld.empty());
+    BOOST_CHECK(!(diskOld.nStatus & BLOCK_HAVE_POWHASH));
+    BOOST_CHECK(diskOld.hashPoW.IsNull());
+    BOOST_CHECK(diskOld.GetBlockHash() == hash);
+
+    // Entry with the PoW hash stored
+    index.SetBlockPoWHash(header.GetPoWHash());
+    BOOST_CHECK(index.GetBlockPoWHash() == header.GetPoWHash());
+    CDataStream ssNew(SER_DISK, CLIENT_VERSION);
+    ssNew << CDiskBlockIndex(&index);
+    BOOST_CHECK_EQUAL(ssNew.size(), ssOld.size() + 32);
+    CDiskBlockIndex diskNew;
+    ssNew >> diskNew;
+    BOOST_CHECK(ssNew.empty());
+    BOOST_CHECK(diskNew.nStatus & BLOCK_HAVE_POWHASH);
+    BOOST_CHECK(diskNew.hashPoW == header.GetPoWHash());
+    BOOST_CHECK(diskNew.GetBlockHeader().GetPoWHash() == diskNew.hashPoW);
+}
+
+/** Runs a test on the regtest params and selects the main params again afterwards */
+struct RegTestParamsSetup : public BasicTestingSetup {
+    RegTestParamsSetup() : BasicTestingSetup(CBaseChainParams::REGTEST) {}
+    ~RegTestParamsSetup() { SelectParams(CBaseChainParams::MAIN); }
+};
+
+/* Test that a header PoW check computes the same hashes as GetPoWHash and catches a bad header */
+BOOST_FIXTURE_TEST_CASE(header_pow_check, RegTestParamsSetup)
+{
+    const Consensus::Params& params = Params().GetConsensus();
+
+    std::vector<CBlockHeader> headers(10);
+    for (size_t i = 0; i < headers.size(); i++) {
+        headers[i].nVersion = 4;
+        headers[i].hashMerkleRoot = GetRandHash();
+        headers[i].nTime = 1558378777 + i;
+        headers[i].nBits = 0x207fffff;
+        while (!CheckProofOfWork(headers[i].GetPoWHash(), headers[i].nBits, params, headers[i]))
+            headers[i].nNonce++;
+    }
+
+    std::vector<uint256> vHashPoW(headers.size());
+    BOOST_CHECK(CHeaderPoWCheck(&headers[0], &vHashPoW[0], headers.size(), params)());
+    for (size_t i = 0; i < headers.size(); i++)
+        BOOST_CHECK(vHashPoW[i] == headers[i].GetPoWHash());
+
+    headers[7].nBits = 0x1d00ffff;
+    BOOST_CHECK(!CHeaderPoWCheck(&headers[0], &vHashPoW[0], headers.size(), params)());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
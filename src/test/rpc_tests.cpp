@@ -6,12 +6,18 @@
 #include "rpc/client.h"
 
 #include "base58.h"
+#include "chainparams.h"
+#include "consensus/merkle.h"
+#include "main.h"
+#include "miner.h"
 #include "netbase.h"
+#include "rpc/jsonstream.h"
 
 #include "test/test_bitcoin.h"
 
 #include <boost/algorithm/string.hpp>
 #include <boost/assign/list_of.hpp>
+#include <boost/bind.hpp>
 #include <boost/test/unit_test.hpp>
 
 #include <univalue.h>
@@ -309,4 +315,133 @@ BOOST_AUTO_TEST_CASE(rpc_ban)
     BOOST_CHECK_EQUAL(adr.get_str(), "2001:4d48:ac57:400:cacf:e9ff:fe1d:9c63/128");
 }
 
+static void AppendChunk(std::vector<std::string>* vChunks, const std::string& strChunk)
+{
+    vChunks->push_back(strChunk);
+}
+
+BOOST_AUTO_TEST_CASE(rpc_json_stream)
+{
+    UniValue inner(UniValue::VOBJ);
+    inner.push_back(Pair("a\"b", 1));
+    inner.push_back(Pair("c", UniValue(UniValue::VARR)));
+    UniValue doc(UniValue::VARR);
+    for (int i = 0; i < 100; i++) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("n", i));
+        obj.push_back(Pair("inner", inner));
+        doc.push_back(obj);
+    }
+
+    std::vector<std::string> vChunks;
+    CJSONStreamWriter writer(boost::bind(&AppendChunk, &vChunks, _1), 100);
+    writer.BeginArray();
+    for (int i = 0; i < 100; i++) {
+        writer.BeginObject();
+        writer.Key("n");
+        writer.Value(i);
+        writer.Key("inner");
+        writer.BeginObject();
+        writer.Members(inner);
+        writer.EndObject();
+        writer.EndObject();
+    }
+    writer.EndArray();
+    BOOST_CHECK(writer.Flushed());
+    BOOST_CHECK(vChunks.size() > 10);
+    std::string strStreamed;
+    BOOST_FOREACH(const std::string& strChunk, vChunks)
+        strStreamed += strChunk;
+    strStreamed += writer.TakeBuffer();
+    BOOST_CHECK_EQUAL(strStreamed, doc.write());
+
+    // The streamed form of getblock matches the regular one
+    UniValue params(UniValue::VARR);
+    params.push_back(chainActive.Tip()->GetBlockHash().GetHex());
+    const CRPCCommand* pcmd = tableRPC["getblock"];
+    BOOST_CHECK(pcmd && pcmd->streamActor);
+    CJSONStreamWriter blockWriter(boost::bind(&AppendChunk, &vChunks, _1));
+    BOOST_CHECK(pcmd->streamActor(params, blockWriter));
+    BOOST_CHECK(!blockWriter.Flushed());
+    BOOST_CHECK_EQUAL(blockWriter.TakeBuffer(), pcmd->actor(params, false).write());
+    params.push_back(false);
+    BOOST_CHECK(!pcmd->streamActor(params, blockWriter));
+}
+
+static boost::thread_group batchThreads;
+
+static bool DispatchBatchTask(const boost::function<void(void)>& task)
+{
+    batchThreads.create_thread(task);
+    return true;
+}
+
+static UniValue BatchRequest(const std::string& strMethod, const UniValue& params, int id)
+{
+    UniValue req(UniValue::VOBJ);
+    req.push_back(Pair("method", strMethod));
+    req.push_back(Pair("params", params));
+    req.push_back(Pair("id", id));
+    return req;
+}
+
+BOOST_AUTO_TEST_CASE(rpc_batch_order)
+{
+    SetRPCWarmupFinished();
+    mapArgs["-rpcbatchthreads"] = "3";
+
+    UniValue noParams(UniValue::VARR);
+    UniValue vReq(UniValue::VARR);
+    for (int i = 0; i < 20; i++)
+        vReq.push_back(BatchRequest("getblockcount", noParams, i));
+    // Not read-only: waits for the entries before it and runs on its own
+    vReq.push_back(BatchRequest("sendrawtransaction", noParams, 20));
+    vReq.push_back(BatchRequest("nosuchmethod", noParams, 21));
+    for (int i = 22; i < 30; i++)
+        vReq.push_back(BatchRequest("getbestblockhash", noParams, i));
+
+    std::string strSerial = JSONRPCExecBatch(vReq);
+    std::string strParallel = JSONRPCExecBatch(vReq, &DispatchBatchTask);
+    batchThreads.join_all();
+    BOOST_CHECK_EQUAL(strSerial, strParallel);
+
+    UniValue ret;
+    BOOST_CHECK(ret.read(strParallel));
+    BOOST_CHECK_EQUAL(ret.size(), vReq.size());
+    for (unsigned int i = 0; i < ret.size(); i++) {
+        BOOST_CHECK_EQUAL(find_value(ret[i], "id").get_int(), (int)i);
+        BOOST_CHECK_EQUAL(find_value(ret[i], "error").isNull(), i != 20 && i != 21);
+    }
+
+    mapArgs.erase("-rpcbatchthreads");
+}
+
+static std::string BlockToHex(const CBlock& block)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << block;
+    return HexStr(ss.begin(), ss.end());
+}
+
+BOOST_AUTO_TEST_CASE(rpc_getblocktemplate)
+{
+    // No template without peers, with or without long polling
+    BOOST_CHECK_THROW(CallRPC("getblocktemplate"), runtime_error);
+    BOOST_CHECK_THROW(CallRPC("getblocktemplate {\"longpollid\":\"00\"}"), runtime_error);
+    BOOST_CHECK_THROW(CallRPC("getblocktemplate {\"mode\":\"nosuchmode\"}"), runtime_error);
+    BOOST_CHECK_THROW(CallRPC("getblocktemplate {\"mode\":\"proposal\"}"), runtime_error);
+
+    // Proposals are checked without peers
+    CBlock genesis = Params().GenesisBlock();
+    BOOST_CHECK_EQUAL(CallRPC("getblocktemplate {\"mode\":\"proposal\",\"data\":\"" + BlockToHex(genesis) + "\"}").get_str(), "duplicate");
+
+    CBlock block = BlockAssembler(Params()).CreateNewBlock(CScript() << OP_TRUE)->block;
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    BOOST_CHECK(CallRPC("getblocktemplate {\"mode\":\"proposal\",\"data\":\"" + BlockToHex(block) + "\"}").isNull());
+
+    block.hashPrevBlock.SetNull();
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    BOOST_CHECK_EQUAL(CallRPC("getblocktemplate {\"mode\":\"proposal\",\"data\":\"" + BlockToHex(block) + "\"}").get_str(), "inconclusive-not-best-prevblk");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
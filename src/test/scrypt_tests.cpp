@@ -30,6 +30,19 @@ BOOST_AUTO_TEST_CASE(scrypt_hashtest)
         scrypt_1024_1_1_256_sp_generic((const char*)&inputbytes[0], BEGIN(scrypthash), scratchpad);
         BOOST_CHECK_EQUAL(scrypthash.ToString().c_str(), expected[i]);
     }
+
+    // Test multi-buffer scrypt with every batch size up to all inputs, covering partially filled lanes
+    std::vector<unsigned char> batchbytes;
+    for (int i = 0; i < HASHCOUNT; i++) {
+        inputbytes = ParseHex(inputhex[i]);
+        batchbytes.insert(batchbytes.end(), inputbytes.begin(), inputbytes.end());
+    }
+    for (int n = 1; n <= HASHCOUNT; n++) {
+        std::vector<uint256> batchhashes(n);
+        scrypt_1024_1_1_256_multi((const char*)&batchbytes[0], BEGIN(batchhashes[0]), n);
+        for (int i = 0; i < n; i++)
+            BOOST_CHECK_EQUAL(batchhashes[i].ToString().c_str(), expected[i]);
+    }
 }
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "chain.h"
+#include "main.h"
 #include "random.h"
 #include "util.h"
 #include "test/test_bitcoin.h"
@@ -100,4 +101,48 @@ BOOST_AUTO_TEST_CASE(getlocator_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(chainsnapshot_test)
+{
+    // A main chain of 1000 blocks and a fork branching off at height 500.
+    std::vector<CBlockIndex> vBlocksMain(1000);
+    std::vector<CBlockIndex> vBlocksSide(100);
+    for (unsigned int i=0; i<vBlocksMain.size(); i++) {
+        vBlocksMain[i].nHeight = i;
+        vBlocksMain[i].pprev = i ? &vBlocksMain[i - 1] : NULL;
+        vBlocksMain[i].BuildSkip();
+    }
+    for (unsigned int i=0; i<vBlocksSide.size(); i++) {
+        vBlocksSide[i].nHeight = i + 501;
+        vBlocksSide[i].pprev = i ? &vBlocksSide[i - 1] : &vBlocksMain[500];
+        vBlocksSide[i].BuildSkip();
+    }
+
+    CChain chain;
+    chain.SetTip(&vBlocksMain.back());
+    CChainSnapshot snapshot(&vBlocksMain.back());
+    BOOST_CHECK_EQUAL(snapshot.Height(), chain.Height());
+    BOOST_CHECK(snapshot.Tip() == chain.Tip());
+    for (int i=0; i < 1000; i++) {
+        int nHeight = insecure_rand() % 1000;
+        BOOST_CHECK(snapshot[nHeight] == chain[nHeight]);
+        BOOST_CHECK(snapshot.Contains(&vBlocksMain[nHeight]));
+        BOOST_CHECK(snapshot.Next(&vBlocksMain[nHeight]) == chain.Next(&vBlocksMain[nHeight]));
+    }
+    BOOST_CHECK(snapshot[-1] == NULL);
+    BOOST_CHECK(snapshot[1000] == NULL);
+    BOOST_CHECK(!snapshot.Contains(&vBlocksSide[0]));
+    BOOST_CHECK(snapshot.Next(&vBlocksSide[0]) == NULL);
+    BOOST_CHECK(snapshot.Next(&vBlocksMain.back()) == NULL);
+
+    // Snapshots stay unchanged when the chain moves on.
+    chain.SetTip(&vBlocksSide.back());
+    BOOST_CHECK(snapshot.Contains(&vBlocksMain[999]));
+    BOOST_CHECK(!chain.Contains(&vBlocksMain[999]));
+
+    CChainSnapshot empty(NULL);
+    BOOST_CHECK_EQUAL(empty.Height(), -1);
+    BOOST_CHECK(empty[0] == NULL);
+    BOOST_CHECK(!empty.Contains(&vBlocksMain[0]));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
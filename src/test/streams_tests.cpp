@@ -2,6 +2,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "clientversion.h"
 #include "streams.h"
 #include "support/allocators/zeroafterfree.h"
 #include "test/test_bitcoin.h"
@@ -64,4 +65,26 @@ BOOST_AUTO_TEST_CASE(streams_serializedata_xor)
             std::string(ds.begin(), ds.end()));  
 }         
 
+BOOST_AUTO_TEST_CASE(streams_memory_reader)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    std::vector<unsigned char> vch(300, 0x5a);
+    ss << (uint32_t)12345 << vch << std::string("end");
+
+    CMemoryReader reader(&ss[0], ss.size(), SER_DISK, CLIENT_VERSION);
+    uint32_t n;
+    std::vector<unsigned char> vchRead;
+    std::string str;
+    reader >> n >> vchRead >> str;
+    BOOST_CHECK_EQUAL(n, 12345U);
+    BOOST_CHECK(vchRead == vch);
+    BOOST_CHECK_EQUAL(str, "end");
+    BOOST_CHECK(reader.empty());
+    BOOST_CHECK_THROW(reader >> n, std::ios_base::failure);
+
+    // A truncated range fails instead of reading past its end
+    CMemoryReader truncated(&ss[0], 100, SER_DISK, CLIENT_VERSION);
+    BOOST_CHECK_THROW(truncated >> n >> vchRead, std::ios_base::failure);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
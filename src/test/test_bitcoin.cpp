@@ -58,7 +58,8 @@ TestingSetup::TestingSetup(const std::string& chainName) : BasicTestingSetup(cha
         mempool.setSanityCheck(1.0);
         pblocktree = new CBlockTreeDB(1 << 20, true);
         pcoinsdbview = new CCoinsViewDB(1 << 23, true);
-        pcoinsTip = new CCoinsViewCache(pcoinsdbview);
+        pcoinsWriter = new CCoinsViewAsyncWriter(pcoinsdbview);
+        pcoinsTip = new CCoinsViewCache(pcoinsWriter);
         InitBlockIndex(chainparams);
         {
             CValidationState state;
@@ -78,6 +79,7 @@ TestingSetup::~TestingSetup()
         threadGroup.join_all();
         UnloadBlockIndex();
         delete pcoinsTip;
+        delete pcoinsWriter;
         delete pcoinsdbview;
         delete pblocktree;
         boost::filesystem::remove_all(pathTemp);
@@ -0,0 +1,56 @@
+// Copyright (c) 2014-2019 The Flashcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TIMESTAMPINDEX_H
+#define BITCOIN_TIMESTAMPINDEX_H
+
+#include "serialize.h"
+#include "uint256.h"
+
+/** Key of a timestamp index entry, the timestamp is stored big endian so entries are ordered by time */
+struct CTimestampIndexKey
+{
+    unsigned int timestamp;
+    uint256 blockHash;
+
+    CTimestampIndexKey() : timestamp(0) {}
+
+    CTimestampIndexKey(unsigned int timestampIn, const uint256& blockHashIn) :
+        timestamp(timestampIn), blockHash(blockHashIn) {}
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const {
+        return 4 + 32;
+    }
+
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        ser_writedata32be(s, timestamp);
+        blockHash.Serialize(s, nType, nVersion);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        timestamp = ser_readdata32be(s);
+        blockHash.Unserialize(s, nType, nVersion);
+    }
+};
+
+/** Prefix of CTimestampIndexKey used to seek to the first block at or after a timestamp */
+struct CTimestampIndexIteratorKey
+{
+    unsigned int timestamp;
+
+    CTimestampIndexIteratorKey(unsigned int timestampIn) : timestamp(timestampIn) {}
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const {
+        return 4;
+    }
+
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        ser_writedata32be(s, timestamp);
+    }
+};
+
+#endif // BITCOIN_TIMESTAMPINDEX_H
@@ -7,8 +7,11 @@
 
 #include "chainparams.h"
 #include "hash.h"
+#include "init.h"
 #include "pow.h"
+#include "ui_interface.h"
 #include "uint256.h"
+#include "util.h"
 
 #include <stdint.h>
 
@@ -16,27 +19,172 @@
 
 using namespace std;
 
-static const char DB_COINS = 'c';
+static const char DB_COINS = 'c'; // Per-transaction records of older versions, see CCoinsViewDB::Upgrade()
+static const char DB_COIN = 'C';
+static const char DB_COIN_TX = 'T'; // Present for every transaction with unspent outputs, see CCoinsViewDB::HaveCoins()
 static const char DB_BLOCK_FILES = 'f';
 static const char DB_TXINDEX = 't';
 static const char DB_BLOCK_INDEX = 'b';
+static const char DB_ADDRESSINDEX = 'a';
+static const char DB_ADDRESSUNSPENTINDEX = 'u';
+static const char DB_SPENTINDEX = 'p';
+static const char DB_TIMESTAMPINDEX = 's';
 
 static const char DB_BEST_BLOCK = 'B';
+static const char DB_COINS_STATS = 'S';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
 
+//! Legacy transactions converted per batch by CCoinsViewDB::Upgrade()
+static const size_t UPGRADE_BATCH_TRANSACTIONS = 10000;
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true) 
+namespace {
+
+/** Key of an unspent output record */
+struct CoinEntry
+{
+    uint256 txid;
+    uint32_t n;
+
+    CoinEntry() : n(0) {}
+    CoinEntry(const uint256 &txidIn, uint32_t nIn) : txid(txidIn), n(nIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(txid);
+        READWRITE(VARINT(n));
+    }
+};
+
+/**
+ * Value of an unspent output record: the output itself plus the metadata of its
+ * transaction, which every record of that transaction repeats.
+ *
+ * Serialized format:
+ * - VARINT(nHeight * 2 + fCoinBase)
+ * - VARINT(nTxVersion)
+ * - the CTxOut (via CTxOutCompressor)
+ */
+struct CoinRecord
+{
+    int nHeight;
+    bool fCoinBase;
+    int nTxVersion;
+    CTxOut txout;
+
+    CoinRecord() : nHeight(0), fCoinBase(false), nTxVersion(0) {}
+    CoinRecord(const CCoins &coins, unsigned int nPos) :
+        nHeight(coins.nHeight), fCoinBase(coins.fCoinBase), nTxVersion(coins.nVersion), txout(coins.vout[nPos]) {}
+
+    //! Whether this record describes output nPos of coins
+    bool Matches(const CCoins &coins, unsigned int nPos) const {
+        return nHeight == coins.nHeight && fCoinBase == coins.fCoinBase &&
+               nTxVersion == coins.nVersion && txout == coins.vout[nPos];
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        unsigned int nCode = nHeight * 2 + (fCoinBase ? 1 : 0);
+        READWRITE(VARINT(nCode));
+        nHeight = nCode >> 1;
+        fCoinBase = nCode & 1;
+        READWRITE(VARINT(nTxVersion));
+        READWRITE(REF(CTxOutCompressor(txout)));
+    }
+};
+
+/**
+ * Read the records of txid starting at the cursor position into coins, leaving
+ * the cursor at the first record after them. Returns false if there are none.
+ */
+bool ReadTxCoins(CDBIterator *pcursor, const uint256 &txid, CCoins &coins, unsigned int *pnValueSize = NULL)
+{
+    coins.Clear();
+    bool fFound = false;
+    while (pcursor->Valid()) {
+        std::pair<char, CoinEntry> key;
+        if (!pcursor->GetKey(key) || key.first != DB_COIN || key.second.txid != txid)
+            break;
+        CoinRecord record;
+        if (!pcursor->GetValue(record))
+            throw std::runtime_error("Database read failure");
+        if (key.second.n >= coins.vout.size())
+            coins.vout.resize(key.second.n + 1);
+        CTxOut &txout = coins.vout[key.second.n];
+        txout.nValue = record.txout.nValue;
+        txout.scriptPubKey.swap(record.txout.scriptPubKey);
+        coins.nHeight = record.nHeight;
+        coins.fCoinBase = record.fCoinBase;
+        coins.nVersion = record.nTxVersion;
+        if (pnValueSize)
+            *pnValueSize += pcursor->GetValueSize();
+        fFound = true;
+        pcursor->Next();
+    }
+    return fFound;
+}
+
+/** Add the record of an output to the totals, or take it out. ss is scratch space reused across calls. */
+void UpdateStats(CCoinsDBStats &stats, CDataStream &ss, const CoinEntry &key, const CoinRecord &record, bool fAdd)
 {
+    ss.clear();
+    ss << make_pair(DB_COIN, key) << record;
+    const unsigned char* pData = (const unsigned char*)&ss[0];
+    if (fAdd) {
+        stats.nTransactionOutputs++;
+        stats.nSerializedSize += ss.size();
+        stats.nTotalAmount += record.txout.nValue;
+        stats.muhash.Insert(pData, ss.size());
+    } else {
+        stats.nTransactionOutputs--;
+        stats.nSerializedSize -= ss.size();
+        stats.nTotalAmount -= record.txout.nValue;
+        stats.muhash.Remove(pData, ss.size());
+    }
+}
+
+/** Whether the database holds any record of type chType */
+bool HasRecords(CDBWrapper &db, char chType)
+{
+    boost::scoped_ptr<CDBIterator> pcursor(db.NewIterator());
+    pcursor->Seek(chType);
+    char chKey;
+    return pcursor->Valid() && pcursor->GetKey(chKey) && chKey == chType;
+}
+
+}
+
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe, bool fKeepStatsIn) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true), fStatsValid(false), fKeepStats(fKeepStatsIn)
+{
+    if (!fKeepStats)
+        return;
+    // Totals written by a version that no longer matches the best block, or not
+    // written at all, are recomputed by Upgrade(). An empty database needs none.
+    uint256 hashBestBlock = GetBestBlock();
+    if (db.Read(DB_COINS_STATS, stats) && stats.hashBlock == hashBestBlock) {
+        fStatsValid = true;
+    } else {
+        stats = CCoinsDBStats();
+        fStatsValid = hashBestBlock.IsNull() && !HasRecords(db, DB_COIN) && !HasRecords(db, DB_COINS);
+    }
 }
 
 bool CCoinsViewDB::GetCoins(const uint256 &txid, CCoins &coins) const {
-    return db.Read(make_pair(DB_COINS, txid), coins);
+    // The point lookup is answered by the bloom filters, a seek is not
+    if (!db.Exists(make_pair(DB_COIN_TX, txid)))
+        return false;
+    boost::scoped_ptr<CDBIterator> pcursor(const_cast<CDBWrapper*>(&db)->NewIterator());
+    pcursor->Seek(make_pair(DB_COIN, CoinEntry(txid, 0)));
+    return ReadTxCoins(pcursor.get(), txid, coins);
 }
 
 bool CCoinsViewDB::HaveCoins(const uint256 &txid) const {
-    return db.Exists(make_pair(DB_COINS, txid));
+    return db.Exists(make_pair(DB_COIN_TX, txid));
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const {
@@ -46,27 +194,441 @@ uint256 CCoinsViewDB::GetBestBlock() const {
     return hashBestChain;
 }
 
-bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool fErase) {
     CDBBatch batch(db);
+    boost::scoped_ptr<CDBIterator> pcursor(db.NewIterator());
     size_t count = 0;
     size_t changed = 0;
+    size_t written = 0;
+    size_t erased = 0;
+    std::vector<bool> vUnchanged;
+    // The totals are updated with every record that is replaced, erased or added
+    CCoinsDBStats statsNew;
+    CDataStream ssStats(SER_DISK, CLIENT_VERSION);
+    bool fStats;
+    {
+        boost::unique_lock<boost::mutex> lock(cs_stats);
+        fStats = fStatsValid;
+        if (fStats)
+            statsNew = stats;
+    }
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
-            if (it->second.coins.IsPruned())
-                batch.Erase(make_pair(DB_COINS, it->first));
-            else
-                batch.Write(make_pair(DB_COINS, it->first), it->second.coins);
+            const CCoins &coins = it->second.coins;
+            vUnchanged.assign(coins.vout.size(), false);
+            unsigned int nBefore = 0, nAfter = 0;
+            // Only the outputs that differ from what is stored are touched. A
+            // FRESH entry has no records yet, so there is nothing to compare,
+            // and neither has a transaction without a marker.
+            if (!(it->second.flags & CCoinsCacheEntry::FRESH) && db.Exists(make_pair(DB_COIN_TX, it->first))) {
+                pcursor->Seek(make_pair(DB_COIN, CoinEntry(it->first, 0)));
+                while (pcursor->Valid()) {
+                    std::pair<char, CoinEntry> key;
+                    if (!pcursor->GetKey(key) || key.first != DB_COIN || key.second.txid != it->first)
+                        break;
+                    nBefore++;
+                    CoinRecord record;
+                    bool fRead = pcursor->GetValue(record);
+                    if (coins.IsAvailable(key.second.n) && fRead && record.Matches(coins, key.second.n)) {
+                        vUnchanged[key.second.n] = true;
+                    } else {
+                        if (!coins.IsAvailable(key.second.n)) {
+                            batch.Erase(key);
+                            erased++;
+                        }
+                        // Without the old record the totals can't be corrected; they are recomputed on the next start.
+                        if (fStats && fRead)
+                            UpdateStats(statsNew, ssStats, key.second, record, false);
+                        else
+                            fStats = false;
+                    }
+                    pcursor->Next();
+                }
+            }
+            for (unsigned int i = 0; i < coins.vout.size(); i++) {
+                if (!coins.IsAvailable(i))
+                    continue;
+                nAfter++;
+                if (!vUnchanged[i]) {
+                    CoinRecord record(coins, i);
+                    batch.Write(make_pair(DB_COIN, CoinEntry(it->first, i)), record);
+                    if (fStats)
+                        UpdateStats(statsNew, ssStats, CoinEntry(it->first, i), record, true);
+                    written++;
+                }
+            }
+            if (nAfter > 0 && nBefore == 0)
+                batch.Write(make_pair(DB_COIN_TX, it->first), '1');
+            else if (nBefore > 0 && nAfter == 0)
+                batch.Erase(make_pair(DB_COIN_TX, it->first));
+            if (nBefore == 0 && nAfter > 0)
+                statsNew.nTransactions++;
+            else if (nBefore > 0 && nAfter == 0)
+                statsNew.nTransactions--;
             changed++;
         }
         count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
+        if (fErase) {
+            CCoinsMap::iterator itOld = it++;
+            mapCoins.erase(itOld);
+        } else {
+            ++it;
+        }
     }
     if (!hashBlock.IsNull())
         batch.Write(DB_BEST_BLOCK, hashBlock);
+    if (fStats) {
+        if (!hashBlock.IsNull())
+            statsNew.hashBlock = hashBlock;
+        batch.Write(DB_COINS_STATS, statsNew);
+    } else {
+        batch.Erase(DB_COINS_STATS);
+    }
+
+    LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database: %u outputs written, %u erased...\n",
+        (unsigned int)changed, (unsigned int)count, (unsigned int)written, (unsigned int)erased);
+    if (!db.WriteBatch(batch))
+        return false;
+    boost::unique_lock<boost::mutex> lock(cs_stats);
+    fStatsValid = fStats;
+    if (fStats)
+        stats = statsNew;
+    return true;
+}
+
+bool CCoinsViewDB::Upgrade() {
+    boost::scoped_ptr<CDBIterator> pcursor(db.NewIterator());
+    pcursor->Seek(make_pair(DB_COINS, uint256()));
+    std::pair<char, uint256> key;
+    if (!pcursor->Valid() || !pcursor->GetKey(key) || key.first != DB_COINS)
+        return InitStats();
+
+    // Converted records are not counted, start over once all of them are
+    {
+        boost::unique_lock<boost::mutex> lock(cs_stats);
+        fStatsValid = false;
+    }
+    if (!db.Erase(DB_COINS_STATS))
+        return false;
+
+    LogPrintf("Upgrading chainstate database to per-output records...\n");
+    uiInterface.InitMessage(_("Upgrading chainstate database..."));
+    size_t nTransactions = 0, nOutputs = 0;
+    int nLastProgress = -1;
+    bool fDone = false;
+    while (!fDone) {
+        CDBBatch batch(db);
+        for (size_t nBatch = 0; nBatch < UPGRADE_BATCH_TRANSACTIONS; nBatch++) {
+            boost::this_thread::interruption_point();
+            if (ShutdownRequested() || !pcursor->Valid() || !pcursor->GetKey(key) || key.first != DB_COINS) {
+                fDone = true;
+                break;
+            }
+            CCoins coins;
+            if (!pcursor->GetValue(coins))
+                return error("%s: unable to read coins of %s", __func__, key.second.ToString());
+            bool fUnspent = false;
+            for (unsigned int i = 0; i < coins.vout.size(); i++) {
+                if (!coins.vout[i].IsNull()) {
+                    batch.Write(make_pair(DB_COIN, CoinEntry(key.second, i)), CoinRecord(coins, i));
+                    nOutputs++;
+                    fUnspent = true;
+                }
+            }
+            if (fUnspent)
+                batch.Write(make_pair(DB_COIN_TX, key.second), '1');
+            batch.Erase(key);
+            nTransactions++;
+            pcursor->Next();
+        }
+        if (!db.WriteBatch(batch))
+            return false;
+        // Txids are spread evenly, so the leading key byte tells how far along we are
+        int nProgress = (int)(*key.second.begin()) * 100 / 256;
+        if (!fDone && nProgress != nLastProgress) {
+            uiInterface.ShowProgress(_("Upgrading chainstate database..."), nProgress);
+            nLastProgress = nProgress;
+        }
+    }
+    uiInterface.ShowProgress("", 100);
+    LogPrintf("Upgraded %u transactions with %u unspent outputs%s\n", (unsigned int)nTransactions, (unsigned int)nOutputs,
+        ShutdownRequested() ? ", interrupted" : "");
+    if (ShutdownRequested())
+        return false;
+    return InitStats();
+}
+
+bool CCoinsViewDB::InitStats() {
+    if (!fKeepStats) {
+        // Totals left by an earlier run would not follow the writes from now on
+        return db.Erase(DB_COINS_STATS);
+    }
+    {
+        boost::unique_lock<boost::mutex> lock(cs_stats);
+        if (fStatsValid)
+            return true;
+    }
+
+    LogPrintf("Computing UTXO set statistics...\n");
+    uiInterface.InitMessage(_("Computing UTXO set statistics..."));
+    CCoinsDBStats statsNew;
+    bool fOk = ComputeStats(statsNew, true);
+    uiInterface.ShowProgress("", 100);
+    if (!fOk) {
+        if (ShutdownRequested())
+            LogPrintf("Computing UTXO set statistics interrupted\n");
+        return false;
+    }
+    if (!db.Write(DB_COINS_STATS, statsNew))
+        return false;
+    LogPrintf("UTXO set: %u transactions with %u unspent outputs\n", (unsigned int)statsNew.nTransactions, (unsigned int)statsNew.nTransactionOutputs);
+
+    boost::unique_lock<boost::mutex> lock(cs_stats);
+    stats = statsNew;
+    fStatsValid = true;
+    return true;
+}
+
+bool CCoinsViewDB::ComputeStats(CCoinsDBStats &statsOut, bool fShowProgress) const {
+    CCoinsDBStats statsNew;
+    CDataStream ssStats(SER_DISK, CLIENT_VERSION);
+    // The iterator reads a snapshot, so the best block is taken from it as well
+    // in case the database is written to while the scan runs.
+    boost::scoped_ptr<CDBIterator> pcursor(const_cast<CDBWrapper*>(&db)->NewIterator());
+    pcursor->Seek(DB_BEST_BLOCK);
+    char chKey;
+    if (pcursor->Valid() && pcursor->GetKey(chKey) && chKey == DB_BEST_BLOCK && !pcursor->GetValue(statsNew.hashBlock))
+        return error("%s: unable to read best block", __func__);
+    pcursor->Seek(DB_COIN);
+    uint256 txidLast;
+    int nLastProgress = -1;
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        if (ShutdownRequested())
+            return false;
+        std::pair<char, CoinEntry> key;
+        if (!pcursor->GetKey(key) || key.first != DB_COIN)
+            break;
+        CoinRecord record;
+        if (!pcursor->GetValue(record))
+            return error("%s: unable to read output %s:%u", __func__, key.second.txid.ToString(), key.second.n);
+        if (statsNew.nTransactionOutputs == 0 || key.second.txid != txidLast) {
+            statsNew.nTransactions++;
+            txidLast = key.second.txid;
+        }
+        UpdateStats(statsNew, ssStats, key.second, record, true);
+        int nProgress = (int)(*key.second.txid.begin()) * 100 / 256;
+        if (fShowProgress && nProgress != nLastProgress) {
+            uiInterface.ShowProgress(_("Computing UTXO set statistics..."), nProgress);
+            nLastProgress = nProgress;
+        }
+        pcursor->Next();
+    }
+    statsOut = statsNew;
+    return true;
+}
+
+bool CCoinsViewDB::GetStats(CCoinsDBStats &statsOut) const {
+    if (!fKeepStats)
+        return false;
+    boost::unique_lock<boost::mutex> lock(cs_stats);
+    if (!fStatsValid)
+        return false;
+    statsOut = stats;
+    return true;
+}
+
+CCoinsViewAsyncWriter::CCoinsViewAsyncWriter(CCoinsView* viewIn) : CCoinsViewBacked(viewIn), fRunning(false), fFailed(false), nLastWriteMicros(0) {}
+
+void CCoinsViewAsyncWriter::WaitIdle(boost::unique_lock<boost::mutex>& lock) const
+{
+    // Callers hold cs_main; being interrupted here would leave their flush half done.
+    boost::this_thread::disable_interruption di;
+    while (pending && fRunning)
+        cond.wait(lock);
+}
+
+bool CCoinsViewAsyncWriter::GetCoins(const uint256 &txid, CCoins &coins) const
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (pending) {
+            CCoinsMap::const_iterator it = pending->mapCoins.find(txid);
+            if (it != pending->mapCoins.end()) {
+                coins = it->second.coins;
+                return true;
+            }
+        }
+    }
+    return base->GetCoins(txid, coins);
+}
+
+bool CCoinsViewAsyncWriter::HaveCoins(const uint256 &txid) const
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (pending) {
+            CCoinsMap::const_iterator it = pending->mapCoins.find(txid);
+            if (it != pending->mapCoins.end())
+                return !it->second.coins.IsPruned();
+        }
+    }
+    return base->HaveCoins(txid);
+}
+
+uint256 CCoinsViewAsyncWriter::GetBestBlock() const
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (pending && !pending->hashBlock.IsNull())
+            return pending->hashBlock;
+    }
+    return base->GetBestBlock();
+}
+
+bool CCoinsViewAsyncWriter::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool fErase)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    WaitIdle(lock);
+    if (fFailed)
+        return false;
+    if (!fRunning) {
+        // Anything the thread left behind goes first, it is older than this
+        if (!CommitPending())
+            return false;
+        return base->BatchWrite(mapCoins, hashBlock, fErase);
+    }
+
+    std::unique_ptr<PendingBatch> pbatch(new PendingBatch());
+    pbatch->hashBlock = hashBlock;
+    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
+        if (it->second.flags & CCoinsCacheEntry::DIRTY) {
+            CCoinsCacheEntry& entry = pbatch->mapCoins[it->first];
+            entry.flags = it->second.flags;
+            if (fErase)
+                entry.coins.swap(it->second.coins);
+            else
+                entry.coins = it->second.coins;
+        }
+        if (fErase) {
+            CCoinsMap::iterator itOld = it++;
+            mapCoins.erase(itOld);
+        } else {
+            ++it;
+        }
+    }
+    pending.swap(pbatch);
+    cond.notify_all();
+    return true;
+}
+
+CCoinsViewCursor *CCoinsViewAsyncWriter::Cursor() const
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        WaitIdle(lock);
+    }
+    return base->Cursor();
+}
+
+void CCoinsViewAsyncWriter::Run()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (fFailed)
+            return;
+        fRunning = true;
+    }
+    try {
+        while (true) {
+            PendingBatch* pbatch;
+            {
+                boost::unique_lock<boost::mutex> lock(cs);
+                while (!pending)
+                    cond.wait(lock);
+                pbatch = pending.get();
+            }
+            // The batch does not change until it is released below, and
+            // concurrent readers only look things up in it, so write it
+            // without holding cs.
+            int64_t nStart = GetTimeMicros();
+            bool fOk = false;
+            try {
+                fOk = base->BatchWrite(pbatch->mapCoins, pbatch->hashBlock, false);
+            } catch (const std::runtime_error& e) {
+                LogPrintf("%s: %s\n", __func__, e.what());
+            }
+            std::unique_ptr<PendingBatch> done;
+            {
+                boost::unique_lock<boost::mutex> lock(cs);
+                nLastWriteMicros = GetTimeMicros() - nStart;
+                if (fOk) {
+                    done.swap(pending);
+                } else {
+                    fFailed = true;
+                    fRunning = false;
+                }
+                cond.notify_all();
+            }
+            if (!fOk) {
+                uiInterface.ThreadSafeMessageBox(_("Error writing to database, shutting down."), "", CClientUIInterface::MSG_ERROR);
+                StartShutdown();
+                return;
+            }
+            LogPrint("coindb", "%s: committed %u transactions in %.2fms\n", __func__, done->mapCoins.size(), nLastWriteMicros * 0.001);
+        }
+    } catch (const boost::thread_interrupted&) {
+        // A batch may have been handed over just as the thread was interrupted.
+        // Later writes bypass the thread, so commit it before leaving.
+        boost::unique_lock<boost::mutex> lock(cs);
+        fRunning = false;
+        CommitPending();
+        cond.notify_all();
+        throw;
+    }
+}
 
-    LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
-    return db.WriteBatch(batch);
+bool CCoinsViewAsyncWriter::CommitPending()
+{
+    if (!pending)
+        return true;
+    boost::this_thread::disable_interruption di;
+    bool fOk = false;
+    try {
+        fOk = base->BatchWrite(pending->mapCoins, pending->hashBlock, false);
+    } catch (const std::runtime_error& e) {
+        LogPrintf("%s: %s\n", __func__, e.what());
+    }
+    if (fOk)
+        pending.reset();
+    else
+        fFailed = true;
+    return fOk;
+}
+
+bool CCoinsViewAsyncWriter::Wait()
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    WaitIdle(lock);
+    return !fFailed;
+}
+
+bool CCoinsViewAsyncWriter::IsRunning() const
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    return fRunning;
+}
+
+size_t CCoinsViewAsyncWriter::GetPendingCount() const
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    return pending ? pending->mapCoins.size() : 0;
+}
+
+int64_t CCoinsViewAsyncWriter::GetLastWriteMicros() const
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    return nLastWriteMicros;
 }
 
 CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
@@ -98,17 +660,28 @@ CCoinsViewCursor *CCoinsViewDB::Cursor() const
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
        that restriction.  */
-    i->pcursor->Seek(DB_COINS);
-    // Cache key of first record
-    i->pcursor->GetKey(i->keyTmp);
+    i->pcursor->Seek(DB_COIN);
+    // Collect the first transaction
+    i->ReadCurrent();
     return i;
 }
 
+void CCoinsViewDBCursor::ReadCurrent()
+{
+    std::pair<char, CoinEntry> key;
+    fValid = pcursor->Valid() && pcursor->GetKey(key) && key.first == DB_COIN;
+    nValueSize = 0;
+    if (fValid) {
+        txidTmp = key.second.txid;
+        ReadTxCoins(pcursor.get(), txidTmp, coinsTmp, &nValueSize);
+    }
+}
+
 bool CCoinsViewDBCursor::GetKey(uint256 &key) const
 {
     // Return cached key
-    if (keyTmp.first == DB_COINS) {
-        key = keyTmp.second;
+    if (fValid) {
+        key = txidTmp;
         return true;
     }
     return false;
@@ -116,24 +689,26 @@ bool CCoinsViewDBCursor::GetKey(uint256 &key) const
 
 bool CCoinsViewDBCursor::GetValue(CCoins &coins) const
 {
-    return pcursor->GetValue(coins);
+    if (!fValid)
+        return false;
+    coins = coinsTmp;
+    return true;
 }
 
 unsigned int CCoinsViewDBCursor::GetValueSize() const
 {
-    return pcursor->GetValueSize();
+    return nValueSize;
 }
 
 bool CCoinsViewDBCursor::Valid() const
 {
-    return keyTmp.first == DB_COINS;
+    return fValid;
 }
 
 void CCoinsViewDBCursor::Next()
 {
-    pcursor->Next();
-    if (!pcursor->Valid() || !pcursor->GetKey(keyTmp))
-        keyTmp.first = 0; // Invalidate cached key after last record so that Valid() and GetKey() return false
+    // The cursor already points past the records of the current transaction
+    ReadCurrent();
 }
 
 bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo) {
@@ -159,6 +734,116 @@ bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos>
     return WriteBatch(batch);
 }
 
+bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> >&vect) {
+    CDBBatch batch(*this);
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
+        batch.Write(make_pair(DB_ADDRESSINDEX, it->first), it->second);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> >&vect) {
+    CDBBatch batch(*this);
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
+        batch.Erase(make_pair(DB_ADDRESSINDEX, it->first));
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadAddressIndex(unsigned int type, const uint160 &addressHash, std::vector<std::pair<CAddressIndexKey, CAmount> > &vect, int start, int end) {
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+
+    if (start > 0)
+        pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash, start)));
+    else
+        pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash)));
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, CAddressIndexKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSINDEX || key.second.type != type || key.second.hashBytes != addressHash)
+            break;
+        if (end > 0 && key.second.blockHeight > end)
+            break;
+        CAmount nValue;
+        if (!pcursor->GetValue(nValue))
+            return error("%s: failed to read value", __func__);
+        vect.push_back(make_pair(key.second, nValue));
+        pcursor->Next();
+    }
+
+    return true;
+}
+
+bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >&vect) {
+    CDBBatch batch(*this);
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
+        if (it->second.IsNull())
+            batch.Erase(make_pair(DB_ADDRESSUNSPENTINDEX, it->first));
+        else
+            batch.Write(make_pair(DB_ADDRESSUNSPENTINDEX, it->first), it->second);
+    }
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadAddressUnspentIndex(unsigned int type, const uint160 &addressHash, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect) {
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+
+    pcursor->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, CAddressUnspentIteratorKey(type, addressHash)));
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, CAddressUnspentKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSUNSPENTINDEX || key.second.type != type || key.second.hashBytes != addressHash)
+            break;
+        CAddressUnspentValue value;
+        if (!pcursor->GetValue(value))
+            return error("%s: failed to read value", __func__);
+        vect.push_back(make_pair(key.second, value));
+        pcursor->Next();
+    }
+
+    return true;
+}
+
+bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect) {
+    CDBBatch batch(*this);
+    for (std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
+        if (it->second.IsNull())
+            batch.Erase(make_pair(DB_SPENTINDEX, it->first));
+        else
+            batch.Write(make_pair(DB_SPENTINDEX, it->first), it->second);
+    }
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadSpentIndex(const CSpentIndexKey &key, CSpentIndexValue &value) {
+    return Read(make_pair(DB_SPENTINDEX, key), value);
+}
+
+bool CBlockTreeDB::WriteTimestampIndex(const CTimestampIndexKey &key) {
+    return Write(make_pair(DB_TIMESTAMPINDEX, key), '1');
+}
+
+bool CBlockTreeDB::EraseTimestampIndex(const CTimestampIndexKey &key) {
+    return Erase(make_pair(DB_TIMESTAMPINDEX, key));
+}
+
+bool CBlockTreeDB::ReadTimestampIndex(unsigned int high, unsigned int low, std::vector<uint256> &vect) {
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+
+    pcursor->Seek(make_pair(DB_TIMESTAMPINDEX, CTimestampIndexIteratorKey(low)));
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, CTimestampIndexKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_TIMESTAMPINDEX || key.second.timestamp >= high)
+            break;
+        vect.push_back(key.second.blockHash);
+        pcursor->Next();
+    }
+
+    return true;
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
 }
@@ -198,15 +883,15 @@ bool CBlockTreeDB::LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256
                 pindexNew->nNonce         = diskindex.nNonce;
                 pindexNew->nStatus        = diskindex.nStatus;
                 pindexNew->nTx            = diskindex.nTx;
-
-                // Flashcoin: Disable PoW Sanity check while loading block index from disk.
-                // We use the sha256 hash for the block index for performance reasons, which is recorded for later use.
-                // CheckProofOfWork() uses the scrypt hash which is discarded after a block is accepted.
-                // While it is technically feasible to verify the PoW, doing so takes several minutes as it
-                // requires recomputing every PoW hash during every Flashcoin startup.
-                // We opt instead to simply trust the data that is on your local disk.
-                //if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits, Params().GetConsensus()))
-                //    return error("LoadBlockIndex(): CheckProofOfWork failed: %s", pindexNew->ToString());
+                pindexNew->hashPoW        = diskindex.hashPoW;
+
+                // Flashcoin: CheckProofOfWork() uses the scrypt hash, which is expensive to recompute
+                // for every block index entry on every startup. Entries that carry the persisted PoW hash
+                // are checked against their target here; whether the stored hash actually matches the
+                // header is verified in the background with -checkpowhashes, see ThreadCheckBlockIndexPoW().
+                if ((pindexNew->nStatus & BLOCK_HAVE_POWHASH) &&
+                    !CheckProofOfWork(pindexNew->hashPoW, pindexNew->nBits, Params().GetConsensus(), diskindex.GetBlockHeader()))
+                    return error("LoadBlockIndex(): CheckProofOfWork failed: %s", pindexNew->ToString());
 
                 pcursor->Next();
             } else {
@@ -6,16 +6,24 @@
 #ifndef BITCOIN_TXDB_H
 #define BITCOIN_TXDB_H
 
+#include "addressindex.h"
+#include "amount.h"
 #include "coins.h"
 #include "dbwrapper.h"
 #include "chain.h"
+#include "muhash.h"
+#include "spentindex.h"
+#include "timestampindex.h"
 
 #include <map>
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include <boost/function.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
 
 class CBlockIndex;
 class CCoinsViewDBCursor;
@@ -29,7 +37,7 @@ static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 16384 : 1024;
 static const int64_t nMinDbCache = 4;
 //! Max memory allocated to block tree DB specific cache, if no -txindex (MiB)
 static const int64_t nMaxBlockDBCache = 2;
-//! Max memory allocated to block tree DB specific cache, if -txindex (MiB)
+//! Max memory allocated to block tree DB specific cache, if -txindex or another optional index (MiB)
 // Unlike for the UTXO database, for the txindex scenario the leveldb cache make
 // a meaningful difference: https://github.com/bitcoin/bitcoin/pull/8273#issuecomment-229601991
 static const int64_t nMaxBlockDBAndTxIndexCache = 1024;
@@ -61,19 +69,148 @@ struct CDiskTxPos : public CDiskBlockPos
     }
 };
 
-/** CCoinsView backed by the coin database (chainstate/) */
+/**
+ * Totals over the unspent outputs in the coin database. They are stored next to
+ * the best block and updated in the same batch as the outputs, so they always
+ * describe the set on disk.
+ */
+struct CCoinsDBStats
+{
+    //! Best block of the database the totals belong to
+    uint256 hashBlock;
+    uint64_t nTransactions;
+    uint64_t nTransactionOutputs;
+    //! Size of the output records, keys included
+    uint64_t nSerializedSize;
+    CAmount nTotalAmount;
+    //! Set hash of the output records
+    MuHash3072 muhash;
+
+    CCoinsDBStats() : nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), nTotalAmount(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(hashBlock);
+        READWRITE(VARINT(nTransactions));
+        READWRITE(VARINT(nTransactionOutputs));
+        READWRITE(VARINT(nSerializedSize));
+        READWRITE(nTotalAmount);
+        READWRITE(muhash);
+    }
+};
+
+/**
+ * CCoinsView backed by the coin database (chainstate/)
+ *
+ * Every unspent output is a record of its own, keyed by txid and output index,
+ * so spending an output only deletes that record instead of rewriting what is
+ * left of its transaction. The CCoins of a txid is put together from all its
+ * records, which sort next to each other. A separate marker record per
+ * transaction answers whether it has any with a point lookup, which unlike a
+ * seek is filtered by the bloom filters.
+ */
 class CCoinsViewDB : public CCoinsView
 {
 protected:
     CDBWrapper db;
+
+    //! Compute the totals with a scan over a snapshot of the database
+    bool ComputeStats(CCoinsDBStats &statsOut, bool fShowProgress) const;
+private:
+    mutable boost::mutex cs_stats;
+    //! Totals of the records on disk, valid unless they still have to be computed
+    CCoinsDBStats stats;
+    bool fStatsValid;
+    //! Whether the totals are kept up to date with every write
+    bool fKeepStats;
+
+    //! Compute the totals with a scan over all records, unless they are up to date or not kept
+    bool InitStats();
 public:
-    CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool fKeepStatsIn = true);
 
     bool GetCoins(const uint256 &txid, CCoins &coins) const;
     bool HaveCoins(const uint256 &txid) const;
     uint256 GetBestBlock() const;
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool fErase = true);
     CCoinsViewCursor *Cursor() const;
+
+    /**
+     * Convert per-transaction records written by older versions to per-output
+     * records. Converted transactions are committed in batches, so an
+     * interrupted upgrade just continues on the next start. Afterwards the
+     * totals returned by GetStats() are computed if the database has none.
+     */
+    bool Upgrade();
+
+    //! Whether running totals are kept, see GetStats()
+    bool KeepsStats() const { return fKeepStats; }
+    //! Get the running totals over all unspent outputs on disk. Fails if they are not kept or not known yet.
+    bool GetStats(CCoinsDBStats &statsOut) const;
+};
+
+/**
+ * CCoinsView that hands the writes for its backend to a writer thread.
+ *
+ * BatchWrite() moves the dirty entries into a pending batch and returns; the
+ * thread started with Run() commits the batch while the caller carries on. Until
+ * the commit is done, reads are answered from the batch first, so the view
+ * never shows the backend's older state. Only one batch is in flight: the next
+ * BatchWrite() waits for the previous one. The best block is committed in the
+ * same database batch as the coins, so a crash loses at most the last batch and
+ * leaves a consistent chainstate behind.
+ *
+ * Without a running writer thread BatchWrite() writes synchronously. All methods
+ * may be called from any thread.
+ */
+class CCoinsViewAsyncWriter : public CCoinsViewBacked
+{
+private:
+    struct PendingBatch
+    {
+        CCoinsMapMemoryResource resource;
+        CCoinsMap mapCoins;
+        uint256 hashBlock;
+
+        PendingBatch() : mapCoins(0, SaltedTxidHasher(), CCoinsMap::key_equal(), &resource) {}
+    };
+
+    mutable boost::mutex cs;
+    mutable boost::condition_variable cond;
+    //! Batch handed to the writer thread, until it is committed
+    std::unique_ptr<PendingBatch> pending;
+    bool fRunning;
+    //! A background write failed; the failed batch stays in pending so reads remain consistent
+    bool fFailed;
+    int64_t nLastWriteMicros;
+
+    //! Wait until no batch is in flight. Requires cs.
+    void WaitIdle(boost::unique_lock<boost::mutex>& lock) const;
+    //! Write the pending batch on the calling thread. Requires cs.
+    bool CommitPending();
+
+public:
+    CCoinsViewAsyncWriter(CCoinsView* viewIn);
+
+    bool GetCoins(const uint256 &txid, CCoins &coins) const;
+    bool HaveCoins(const uint256 &txid) const;
+    uint256 GetBestBlock() const;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool fErase = true);
+    //! Waits for the pending batch, so the cursor sees everything written so far
+    CCoinsViewCursor *Cursor() const;
+
+    //! Commit batches as they come in, until the thread is interrupted
+    void Run();
+    //! Wait until everything written so far is committed. Returns false if a write failed.
+    bool Wait();
+    //! Whether writes are currently handed to the writer thread
+    bool IsRunning() const;
+    //! Number of transactions in the batch being committed
+    size_t GetPendingCount() const;
+    //! Time the last background commit took
+    int64_t GetLastWriteMicros() const;
 };
 
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
@@ -91,9 +228,15 @@ public:
 
 private:
     CCoinsViewDBCursor(CDBIterator* pcursorIn, const uint256 &hashBlockIn):
-        CCoinsViewCursor(hashBlockIn), pcursor(pcursorIn) {}
+        CCoinsViewCursor(hashBlockIn), pcursor(pcursorIn), fValid(false), nValueSize(0) {}
+    //! Collect the records of the transaction at the cursor position
+    void ReadCurrent();
+
     boost::scoped_ptr<CDBIterator> pcursor;
-    std::pair<char, uint256> keyTmp;
+    bool fValid;
+    uint256 txidTmp;
+    CCoins coinsTmp;
+    unsigned int nValueSize;
 
     friend class CCoinsViewDB;
 };
@@ -114,6 +257,20 @@ public:
     bool ReadReindexing(bool &fReindex);
     bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos);
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &list);
+    bool WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
+    bool EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
+    /** Read the index entries of an address, from height start to end (inclusive), either bound is ignored if 0 */
+    bool ReadAddressIndex(unsigned int type, const uint160 &addressHash, std::vector<std::pair<CAddressIndexKey, CAmount> > &vect, int start = 0, int end = 0);
+    /** Write the unspent index entries, erasing those with a null value */
+    bool UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect);
+    bool ReadAddressUnspentIndex(unsigned int type, const uint160 &addressHash, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect);
+    /** Write the spent index entries, erasing those with a null value */
+    bool UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > &vect);
+    bool ReadSpentIndex(const CSpentIndexKey &key, CSpentIndexValue &value);
+    bool WriteTimestampIndex(const CTimestampIndexKey &key);
+    bool EraseTimestampIndex(const CTimestampIndexKey &key);
+    /** Read the hashes of the blocks with timestamps from low (inclusive) to high (exclusive) */
+    bool ReadTimestampIndex(unsigned int high, unsigned int low, std::vector<uint256> &vect);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256&)> insertBlockIndex);
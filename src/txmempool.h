@@ -21,6 +21,8 @@
 #include "boost/multi_index/ordered_index.hpp"
 #include "boost/multi_index/hashed_index.hpp"
 
+#include <boost/signals2/signal.hpp>
+
 class CAutoFile;
 class CBlockIndex;
 
@@ -490,6 +492,10 @@ public:
     indirectmap<COutPoint, const CTransaction*> mapNextTx;
     std::map<uint256, std::pair<double, CAmount> > mapDeltas;
 
+    /** Fired with cs held, after an entry was added to mapTx and before one is removed from it */
+    boost::signals2::signal<void (txiter)> NotifyEntryAdded;
+    boost::signals2::signal<void (txiter)> NotifyEntryRemoved;
+
     /** Create a new CTxMemPool.
      *  minReasonableRelayFee should be a feerate which is, roughly, somewhere
      *  around what it "costs" to relay a transaction around the network and